@@ -0,0 +1,319 @@
+/* itrapc batch mode. runs many programs in one process, each in its own
+ * engine, on a pool of worker threads */
+
+#include "interpreter.h"
+#include "heap.h"
+#include "profile.h"
+
+#if defined(UNIX_HOST) || defined(WIN32)
+#include <threads.h>
+#include <stdatomic.h>
+
+/* one program to run and what became of it */
+struct BatchJob {
+    char *FileName;
+    IOFILE *Out;                /* captured stdout */
+    IOFILE *Err;                /* captured stderr */
+    Program *Prog;              /* if the file's run more than once */
+    int Compiled;               /* ProgramCompile() has been tried, and
+                                    reported any error in Out */
+    int ExitValue;
+    double Seconds;
+};
+
+/* shared by the workers. jobs never make more jobs, so taking the next
+    one from a single cursor balances the load as well as stealing would */
+struct Batch {
+    struct BatchJob *Job;
+    int NumJobs;
+    atomic_int NextJob;
+    int StackSize;
+    Engine *Limits;             /* memory limits for each engine, or NULL */
+};
+
+static double BatchNow(void)
+{
+    return ProfileNow() / 1e9;
+}
+
+/* wait for the threads a job's program started and didn't join. they
+    write to the job's output and use its engine, so neither can go
+    until they're done */
+static void BatchWaitForThreads(Engine *pc)
+{
+    struct timespec Pause = { 0, 1000000 };
+
+    while (atomic_load(&pc->ThreadsRunning) > 0)
+        thrd_sleep(&Pause, NULL);
+}
+
+/* run one program in a fresh engine */
+static void BatchRunJob(struct Batch *B, struct BatchJob *Job)
+{
+    double Start = BatchNow();
+    char *Argv[1];
+    Engine *pc;
+
+    if (Job->Compiled && Job->Prog == NULL) {
+        /* it didn't compile and we've already said why */
+        Job->ExitValue = 1;
+        return;
+    }
+
+    pc = malloc(sizeof(Engine));
+    if (pc == NULL || Job->Out == NULL || Job->Err == NULL) {
+        free(pc);
+        Job->ExitValue = 1;
+        return;
+    }
+
+    Argv[0] = Job->FileName;
+    if (Job->Prog != NULL)
+        EngineInitializeProgram(pc, B->StackSize, Job->Prog);
+    else
+        EngineInitialize(pc, B->StackSize);
+
+    if (B->Limits != NULL)
+        HeapCopyLimits(pc, B->Limits);
+
+    EngineSetOutput(pc, Job->Out, Job->Err);
+    if (!EnginePlatformSetExitPoint(pc)) {
+        if (Job->Prog != NULL)
+            EngineParseProgram(pc);
+        else
+            EnginePlatformScanFile(pc, Job->FileName);
+
+        EngineCallMain(pc, 1, Argv);
+    }
+
+    Job->ExitValue = pc->EngineExitValue;
+    BatchWaitForThreads(pc);
+    pc->ArenaTeardown = true;
+    EngineCleanup(pc);
+    free(pc);
+    Job->Seconds = BatchNow() - Start;
+}
+
+static int BatchWorker(void *Arg)
+{
+    struct Batch *B = Arg;
+    int Next;
+
+    while ((Next = atomic_fetch_add(&B->NextJob, 1)) < B->NumJobs)
+        BatchRunJob(B, &B->Job[Next]);
+
+    return 0;
+}
+
+/* copy a job's captured output to where it should have gone */
+static void BatchCopy(IOFILE *From, IOFILE *To)
+{
+    char Buf[4096];
+    size_t Len;
+
+    if (From == NULL)
+        return;
+
+    rewind(From);
+    while ((Len = fread(Buf, 1, sizeof(Buf), From)) > 0)
+        fwrite(Buf, 1, Len, To);
+
+    fclose(From);
+}
+
+/* free the list of program file names */
+static void BatchFreeNames(char **Names, int NumNames)
+{
+    int Count;
+
+    for (Count = 0; Count < NumNames; Count++)
+        free(Names[Count]);
+
+    free(Names);
+}
+
+/* add a copy of a program file name to the list. returns false if out of
+    memory, leaving the list as it was */
+static int BatchAddName(char ***Names, int *NumNames, int *MaxNames,
+    const char *Name)
+{
+    char *Copy;
+
+    if (*NumNames == *MaxNames) {
+        char **Grown = realloc(*Names, sizeof(char*) * *MaxNames * 2);
+
+        if (Grown == NULL)
+            return false;
+
+        *Names = Grown;
+        *MaxNames *= 2;
+    }
+
+    if ((Copy = strdup(Name)) == NULL)
+        return false;
+
+    (*Names)[(*NumNames)++] = Copy;
+    return true;
+}
+
+/* read a manifest - one program file name per line */
+static int BatchReadManifest(const char *FileName, char ***Names, int *NumNames,
+    int *MaxNames)
+{
+    char Line[FILENAME_MAX];
+    FILE *Manifest = fopen(FileName, "r");
+
+    if (Manifest == NULL) {
+        fprintf(stderr, "can't read manifest %s\n", FileName);
+        return false;
+    }
+
+    while (fgets(Line, sizeof(Line), Manifest) != NULL) {
+        size_t Len = strcspn(Line, "\r\n");
+
+        Line[Len] = '\0';
+        if (Len == 0 || Line[0] == '#')
+            continue;
+
+        if (!BatchAddName(Names, NumNames, MaxNames, Line)) {
+            fprintf(stderr, "out of memory reading manifest %s\n", FileName);
+            fclose(Manifest);
+            return false;
+        }
+    }
+
+    fclose(Manifest);
+    return true;
+}
+
+/* run each program in its own engine using Jobs worker threads, or one
+    per processor if Jobs is 0. an argument starting with '@' names a
+    manifest of more programs. each program's output is shown in order once
+    they've all finished, followed by its exit value and run time on
+    stderr. each engine gets the memory limits set on Limits, unless
+    that's NULL. returns 0 if every program exited with 0 */
+int EngineRunBatch(int NumFiles, char **FileNames, int Jobs, int StackSize,
+    Engine *Limits)
+{
+    struct Batch B;
+    thrd_t *Worker;
+    int MaxNames = NumFiles + 16;
+    char **Names = malloc(sizeof(char*) * MaxNames);
+    int NumNames = 0;
+    int Failed = 0;
+    int Count;
+    double Start = BatchNow();
+
+    if (Names == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    /* there's an engine per job, so each gets a bounded stack */
+    if (StackSize > WORKER_STACK_SIZE_MAX)
+        StackSize = WORKER_STACK_SIZE_MAX;
+
+    for (Count = 0; Count < NumFiles; Count++) {
+        if (FileNames[Count][0] == '@') {
+            if (!BatchReadManifest(&FileNames[Count][1], &Names, &NumNames,
+                    &MaxNames)) {
+                BatchFreeNames(Names, NumNames);
+                return 1;
+            }
+        } else if (!BatchAddName(&Names, &NumNames, &MaxNames, FileNames[Count])) {
+            fprintf(stderr, "out of memory\n");
+            BatchFreeNames(Names, NumNames);
+            return 1;
+        }
+    }
+
+    B.Job = calloc(NumNames > 0 ? NumNames : 1, sizeof(struct BatchJob));
+    if (B.Job == NULL) {
+        fprintf(stderr, "out of memory\n");
+        BatchFreeNames(Names, NumNames);
+        return 1;
+    }
+    B.NumJobs = NumNames;
+    B.StackSize = StackSize;
+    B.Limits = Limits;
+    atomic_init(&B.NextJob, 0);
+    for (Count = 0; Count < NumNames; Count++) {
+        B.Job[Count].FileName = Names[Count];
+        B.Job[Count].Out = tmpfile();
+        B.Job[Count].Err = tmpfile();
+    }
+
+    /* a file which is run more than once is only lexed once */
+    for (Count = 1; Count < NumNames; Count++) {
+        struct BatchJob *First = &B.Job[0];
+
+        while (strcmp(First->FileName, Names[Count]) != 0)
+            First++;
+
+        if (First == &B.Job[Count])
+            continue;
+
+        if (!First->Compiled && First->Out != NULL && First->Err != NULL) {
+            First->Prog = ProgramCompile(First->FileName, StackSize,
+                First->Out, First->Err);
+            First->Compiled = true;
+        }
+
+        if (First->Prog != NULL) {
+            ProgramRetain(First->Prog);
+            B.Job[Count].Prog = First->Prog;
+        }
+    }
+
+#ifdef UNIX_HOST
+    if (Jobs < 1)
+        Jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (Jobs < 1)
+        Jobs = 1;
+    if (Jobs > NumNames)
+        Jobs = NumNames;
+
+    Worker = malloc(sizeof(thrd_t) * (Jobs > 0 ? Jobs : 1));
+    if (Worker == NULL)
+        Jobs = 0;
+    for (Count = 0; Count < Jobs; Count++) {
+        if (thrd_create(&Worker[Count], BatchWorker, &B) != thrd_success) {
+            Jobs = Count;
+            break;
+        }
+    }
+
+    /* if no threads could be made do it all on this one */
+    if (Jobs == 0)
+        BatchWorker(&B);
+
+    for (Count = 0; Count < Jobs; Count++)
+        thrd_join(Worker[Count], NULL);
+
+    for (Count = 0; Count < NumNames; Count++) {
+        struct BatchJob *Job = &B.Job[Count];
+
+        BatchCopy(Job->Out, stdout);
+        fflush(stdout);
+        BatchCopy(Job->Err, stderr);
+        fprintf(stderr, "%s: exit %d, %.3f ms\n", Job->FileName,
+            Job->ExitValue, Job->Seconds * 1000.0);
+        if (Job->ExitValue != 0)
+            Failed++;
+
+        if (Job->Prog != NULL)
+            ProgramRelease(Job->Prog);
+
+        free(Job->FileName);
+    }
+
+    fprintf(stderr, "%d programs, %d failed, %.3f ms\n", NumNames, Failed,
+        (BatchNow() - Start) * 1000.0);
+
+    free(Worker);
+    free(B.Job);
+    free(Names);
+    return Failed != 0;
+}
+#endif
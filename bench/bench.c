@@ -0,0 +1,269 @@
+/* itrapc_bench - runs each benchmark program under itrapc a number of
+ * times and writes how long it took as JSON, so runs can be compared.
+ * each benchmark does OPS operations, from its "#define OPS" line. the
+ * operations per second leave out the median time of the "startup"
+ * benchmark, if it's one of them, so they aren't diluted by starting
+ * the interpreter */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "bench_util.h"
+
+#define WARMUP_DEFAULT 2
+#define REPS_DEFAULT 15
+
+struct Result {
+    char Name[64];
+    long long Ops;
+    double MedianMs;
+    double P95Ms;
+    double MinMs;
+    int Failed;
+};
+
+/* run the program once with its output thrown away. returns the
+    nanoseconds it took, or -1 if it didn't exit with 0 */
+static long long RunOnce(const char *Itrapc, const char *FileName)
+{
+    long long Start = BenchNow();
+    int Status;
+    pid_t Pid = fork();
+
+    if (Pid == 0) {
+        int Null = open("/dev/null", O_WRONLY);
+
+        if (Null >= 0)
+            dup2(Null, STDOUT_FILENO);
+
+        execl(Itrapc, Itrapc, FileName, (char *)NULL);
+        _exit(127);
+    }
+
+    if (Pid < 0 || waitpid(Pid, &Status, 0) < 0)
+        return -1;
+
+    if (!WIFEXITED(Status) || WEXITSTATUS(Status) != 0)
+        return -1;
+
+    return BenchNow() - Start;
+}
+
+/* how many operations a run of the benchmark does */
+static long long ReadOps(const char *FileName)
+{
+    FILE *In = fopen(FileName, "r");
+    char Line[256];
+    long long Ops = 1;
+
+    if (In == NULL)
+        return Ops;
+
+    while (fgets(Line, sizeof(Line), In) != NULL) {
+        if (strncmp(Line, "#define OPS ", 12) == 0) {
+            Ops = strtoll(&Line[12], NULL, 10);
+            break;
+        }
+    }
+
+    fclose(In);
+    return Ops > 0 ? Ops : 1;
+}
+
+static int CompareTimes(const void *A, const void *B)
+{
+    long long TimeA = *(const long long *)A;
+    long long TimeB = *(const long long *)B;
+
+    return (TimeA > TimeB) - (TimeA < TimeB);
+}
+
+/* run a benchmark Warmup times to settle caches, then Reps times timed */
+static void Bench(struct Result *Res, const char *Itrapc,
+    const char *FileName, int Warmup, int Reps)
+{
+    const char *Base = strrchr(FileName, '/');
+    long long *Time = malloc(sizeof(long long) * Reps);
+    int Count;
+
+    snprintf(Res->Name, sizeof(Res->Name), "%s", Base != NULL ? Base+1 : FileName);
+    if (strrchr(Res->Name, '.') != NULL)
+        *strrchr(Res->Name, '.') = '\0';
+
+    Res->Ops = ReadOps(FileName);
+    Res->Failed = Time == NULL;
+    for (Count = 0; Count < Warmup && !Res->Failed; Count++)
+        Res->Failed = RunOnce(Itrapc, FileName) < 0;
+
+    for (Count = 0; Count < Reps && !Res->Failed; Count++)
+        Res->Failed = (Time[Count] = RunOnce(Itrapc, FileName)) < 0;
+
+    if (!Res->Failed) {
+        qsort(Time, Reps, sizeof(long long), CompareTimes);
+        Res->MinMs = Time[0] / 1e6;
+        Res->MedianMs = (Reps % 2 ? Time[Reps/2] :
+            (Time[Reps/2 - 1] + Time[Reps/2]) / 2) / 1e6;
+        Res->P95Ms = Time[(Reps * 95 + 99) / 100 - 1] / 1e6;
+    }
+
+    free(Time);
+}
+
+/* operations per second, leaving out the time it takes to start up.
+    the startup benchmark itself keeps its whole time */
+static double OpsPerSec(struct Result *R, double StartupMs)
+{
+    double Ms = R->MedianMs - StartupMs;
+
+    if (Ms <= 0)
+        Ms = R->MedianMs;
+
+    return R->Ops / (Ms / 1e3);
+}
+
+/* the index of the "startup" benchmark, or -1 */
+static int FindStartup(char **FileNames, int NumFiles)
+{
+    int Count;
+
+    for (Count = 0; Count < NumFiles; Count++) {
+        const char *Base = strrchr(FileNames[Count], '/');
+
+        if (strcmp(Base != NULL ? Base+1 : FileNames[Count], "startup.c") == 0)
+            return Count;
+    }
+
+    return -1;
+}
+
+/* the median a baseline file has for a benchmark, or 0 if it's not there */
+static double BaselineMedian(const char *Baseline, const char *Name)
+{
+    char Key[80];
+    const char *Found;
+
+    snprintf(Key, sizeof(Key), "\"name\": \"%s\"", Name);
+    if (Baseline == NULL || (Found = strstr(Baseline, Key)) == NULL ||
+            (Found = strstr(Found, "\"median_ms\": ")) == NULL)
+        return 0;
+
+    return strtod(Found + 13, NULL);
+}
+
+static void WriteJson(FILE *Out, const char *Itrapc, int Warmup, int Reps,
+    double StartupMs, struct Result *Res, int NumResults)
+{
+    int Count;
+
+    fprintf(Out, "{\n  \"itrapc\": \"%s\",\n  \"warmup\": %d,\n  \"reps\": %d,\n"
+        "  \"startup_ms\": %.3f,\n  \"benchmarks\": [\n", Itrapc, Warmup, Reps,
+        StartupMs);
+    for (Count = 0; Count < NumResults; Count++) {
+        struct Result *R = &Res[Count];
+
+        if (R->Failed)
+            fprintf(Out, "    {\"name\": \"%s\", \"failed\": true}", R->Name);
+        else
+            fprintf(Out, "    {\"name\": \"%s\", \"ops\": %lld, \"median_ms\": %.3f, "
+                "\"p95_ms\": %.3f, \"min_ms\": %.3f, \"ops_per_sec\": %.0f}",
+                R->Name, R->Ops, R->MedianMs, R->P95Ms, R->MinMs,
+                OpsPerSec(R, StartupMs));
+
+        fprintf(Out, "%s\n", Count < NumResults-1 ? "," : "");
+    }
+
+    fprintf(Out, "  ]\n}\n");
+}
+
+int main(int argc, char **argv)
+{
+    int Warmup = WARMUP_DEFAULT;
+    int Reps = REPS_DEFAULT;
+    const char *OutName = NULL;
+    char *Baseline = NULL;
+    const char *Itrapc;
+    struct Result *Res;
+    int NumResults;
+    int Startup;
+    double StartupMs = 0;
+    int Failures = 0;
+    int ArgCount = 1;
+    int Count;
+    FILE *Out = stdout;
+
+    for (; ArgCount < argc-1 && argv[ArgCount][0] == '-'; ArgCount += 2) {
+        if (strcmp(argv[ArgCount], "--warmup") == 0)
+            Warmup = atoi(argv[ArgCount+1]);
+        else if (strcmp(argv[ArgCount], "--reps") == 0)
+            Reps = atoi(argv[ArgCount+1]);
+        else if (strcmp(argv[ArgCount], "--out") == 0)
+            OutName = argv[ArgCount+1];
+        else if (strcmp(argv[ArgCount], "--baseline") == 0) {
+            if ((Baseline = BenchReadFile(argv[ArgCount+1])) == NULL)
+                fprintf(stderr, "can't read baseline %s\n", argv[ArgCount+1]);
+        } else
+            break;
+    }
+
+    if (argc - ArgCount < 2 || Reps < 1) {
+        printf("Format:\n\n"
+            "> itrapc_bench [--warmup N] [--reps N] [--out results.json] "
+            "[--baseline old.json] itrapc <bench.c>...\n");
+        return 1;
+    }
+
+    Itrapc = argv[ArgCount++];
+    NumResults = argc - ArgCount;
+    Res = calloc(NumResults, sizeof(struct Result));
+    if (Res == NULL)
+        return 1;
+
+    /* time starting up first, so the others can leave it out */
+    Startup = FindStartup(&argv[ArgCount], NumResults);
+    if (Startup >= 0) {
+        Bench(&Res[Startup], Itrapc, argv[ArgCount + Startup], Warmup, Reps);
+        if (!Res[Startup].Failed)
+            StartupMs = Res[Startup].MedianMs;
+    }
+
+    fprintf(stderr, "%-16s %12s %12s %14s%s\n", "benchmark", "median ms",
+        "p95 ms", "ops/sec", Baseline != NULL ? "     baseline ms  change" : "");
+    for (Count = 0; Count < NumResults; Count++) {
+        struct Result *R = &Res[Count];
+        double Was;
+
+        if (Count != Startup)
+            Bench(R, Itrapc, argv[ArgCount + Count], Warmup, Reps);
+
+        if (R->Failed) {
+            fprintf(stderr, "%-16s failed\n", R->Name);
+            Failures++;
+            continue;
+        }
+
+        fprintf(stderr, "%-16s %12.3f %12.3f %14.0f", R->Name, R->MedianMs,
+            R->P95Ms, OpsPerSec(R, StartupMs));
+        if ((Was = BaselineMedian(Baseline, R->Name)) > 0)
+            fprintf(stderr, " %15.3f %+6.1f%%", Was,
+                (R->MedianMs - Was) * 100 / Was);
+
+        fprintf(stderr, "\n");
+    }
+
+    if (OutName != NULL && (Out = fopen(OutName, "w")) == NULL) {
+        fprintf(stderr, "can't write %s\n", OutName);
+        return 1;
+    }
+
+    WriteJson(Out, Itrapc, Warmup, Reps, StartupMs, Res, NumResults);
+    if (Out != stdout)
+        fclose(Out);
+
+    free(Baseline);
+    free(Res);
+    return Failures > 0;
+}
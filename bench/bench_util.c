@@ -0,0 +1,37 @@
+/* bench_util.c - helpers shared by the benchmark programs */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "bench_util.h"
+
+/* nanoseconds on the monotonic clock */
+long long BenchNow(void)
+{
+    struct timespec Time;
+
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    return Time.tv_sec * 1000000000LL + Time.tv_nsec;
+}
+
+/* read a whole file into a string the caller frees, or NULL */
+char *BenchReadFile(const char *FileName)
+{
+    FILE *In = fopen(FileName, "rb");
+    char *Text;
+    long Size;
+
+    if (In == NULL)
+        return NULL;
+
+    fseek(In, 0, SEEK_END);
+    Size = ftell(In);
+    rewind(In);
+    Text = malloc(Size + 1);
+    if (Text != NULL)
+        Text[fread(Text, 1, Size, In)] = '\0';
+
+    fclose(In);
+    return Text;
+}
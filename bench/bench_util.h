@@ -0,0 +1,8 @@
+/* bench_util.h - helpers shared by the benchmark programs */
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+long long BenchNow(void);
+char *BenchReadFile(const char *FileName);
+
+#endif /* BENCH_UTIL_H */
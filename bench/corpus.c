@@ -0,0 +1,428 @@
+/* itrapc_corpus - runs a corpus of test programs, such as test/csmith,
+ * under itrapc in parallel. each program's output is checked against its
+ * .expect file, and its run time and peak memory are compared with the
+ * same program compiled natively by the host's cc. the native builds are
+ * run one at a time once the rest is done, so they have the machine to
+ * themselves, and the slowdown compares processor time, which doesn't
+ * depend on how many jobs itrapc shared the machine with */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "bench_util.h"
+
+#define TIMEOUT_DEFAULT 60          /* seconds of processor time a run can have */
+
+/* what's next for a program */
+enum Step {
+    StepCompile,                    /* compile it natively */
+    StepItrapc,                     /* run it under itrapc */
+    StepNative,                     /* run the native build, on its own */
+    StepDone
+};
+
+struct Program {
+    const char *FileName;
+    char Name[64];
+    enum Step Step;
+    pid_t Pid;                      /* of the step that's running */
+    long long Start;
+    int Ok;                         /* itrapc's output was as expected */
+    int NativeBuilt;
+    int NativeOk;                   /* the native build ran */
+    double ItrapcMs;
+    double NativeMs;
+    double ItrapcCpuMs;             /* processor time, user and system */
+    double NativeCpuMs;
+    long RssKb;                     /* itrapc's peak resident memory */
+};
+
+static const char *TempDir;
+
+/* a file in the temporary directory for this program */
+static void TempName(char *Buf, size_t Size, struct Program *Prog,
+    const char *Suffix)
+{
+    snprintf(Buf, Size, "%s/%s%s", TempDir, Prog->Name, Suffix);
+}
+
+/* start a child with its output going to OutName, or thrown away if
+    that's NULL. the child is limited to Timeout seconds of processor time */
+static pid_t Spawn(char *const Argv[], const char *OutName, int Timeout)
+{
+    pid_t Pid = fork();
+
+    if (Pid == 0) {
+        struct rlimit Limit;
+        int Out = open(OutName != NULL ? OutName : "/dev/null",
+            O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+        Limit.rlim_cur = Limit.rlim_max = Timeout;
+        setrlimit(RLIMIT_CPU, &Limit);
+        if (Out >= 0) {
+            dup2(Out, STDOUT_FILENO);
+            dup2(Out, STDERR_FILENO);
+        }
+
+        execvp(Argv[0], Argv);
+        _exit(127);
+    }
+
+    return Pid;
+}
+
+/* start the next step of a program. returns false if there isn't one */
+static int StartStep(struct Program *Prog, const char *Itrapc, const char *Cc,
+    int Timeout)
+{
+    char Binary[512];
+    char Output[512];
+
+    TempName(Binary, sizeof(Binary), Prog, "");
+    if (Prog->Step == StepCompile) {
+        char *Argv[] = { (char *)Cc, "-O2", "-w", "-o", Binary,
+            (char *)Prog->FileName, "-lm", NULL };
+
+        Prog->Pid = Spawn(Argv, NULL, Timeout);
+    } else if (Prog->Step == StepNative) {
+        char *Argv[] = { Binary, NULL };
+
+        Prog->Pid = Spawn(Argv, NULL, Timeout);
+    } else if (Prog->Step == StepItrapc) {
+        char *Argv[] = { (char *)Itrapc, (char *)Prog->FileName, NULL };
+
+        TempName(Output, sizeof(Output), Prog, ".out");
+        Prog->Pid = Spawn(Argv, Output, Timeout);
+    } else
+        return false;
+
+    Prog->Start = BenchNow();
+    return Prog->Pid > 0;
+}
+
+/* true if two files hold the same bytes */
+static int SameFile(const char *NameA, const char *NameB)
+{
+    FILE *A = fopen(NameA, "rb");
+    FILE *B = fopen(NameB, "rb");
+    int Same = A != NULL && B != NULL;
+    int Char;
+
+    while (Same && (Char = getc(A)) != EOF)
+        Same = Char == getc(B);
+
+    if (Same)
+        Same = getc(B) == EOF;
+
+    if (A != NULL)
+        fclose(A);
+    if (B != NULL)
+        fclose(B);
+
+    return Same;
+}
+
+/* a step's finished. decide what the program does next */
+static void FinishStep(struct Program *Prog, int Status, struct rusage *Usage)
+{
+    double Ms = (BenchNow() - Prog->Start) / 1e6;
+    double CpuMs = (Usage->ru_utime.tv_sec + Usage->ru_stime.tv_sec) * 1e3 +
+        (Usage->ru_utime.tv_usec + Usage->ru_stime.tv_usec) / 1e3;
+    int Exited = WIFEXITED(Status) && WEXITSTATUS(Status) == 0;
+    char Name[512];
+
+    Prog->Pid = 0;
+    switch (Prog->Step) {
+    case StepCompile:
+        Prog->NativeBuilt = Exited;
+        Prog->Step = StepItrapc;
+        break;
+
+    case StepNative:
+        Prog->NativeOk = Exited;
+        Prog->NativeMs = Ms;
+        Prog->NativeCpuMs = CpuMs;
+        TempName(Name, sizeof(Name), Prog, "");
+        unlink(Name);
+        Prog->Step = StepDone;
+        break;
+
+    default:
+        Prog->ItrapcMs = Ms;
+        Prog->ItrapcCpuMs = CpuMs;
+        Prog->RssKb = Usage->ru_maxrss;
+        TempName(Name, sizeof(Name), Prog, ".out");
+        if (WIFEXITED(Status)) {
+            const char *Dot = strrchr(Prog->FileName, '.');
+            char Expect[512];
+
+            snprintf(Expect, sizeof(Expect), "%.*s.expect",
+                Dot != NULL ? (int)(Dot - Prog->FileName) :
+                    (int)strlen(Prog->FileName), Prog->FileName);
+            Prog->Ok = SameFile(Name, Expect);
+        }
+
+        unlink(Name);
+        Prog->Step = Prog->NativeBuilt ? StepNative : StepDone;
+        break;
+    }
+}
+
+/* find a number in a baseline after Key, at or after From. returns
+    -1 if it's not there */
+static double BaselineNumber(const char *From, const char *Key)
+{
+    const char *Found;
+
+    if (From == NULL || (Found = strstr(From, Key)) == NULL)
+        return -1;
+
+    return strtod(Found + strlen(Key), NULL);
+}
+
+/* whether a program passed in the baseline. false if its entry has no
+    "ok" field */
+static bool BaselineOk(const char *Was)
+{
+    const char *Found;
+    const char *End;
+
+    if (Was == NULL || (Found = strstr(Was, "\"ok\": ")) == NULL)
+        return false;
+
+    End = strchr(Was, '}');
+    if (End != NULL && Found > End)
+        return false;
+
+    return strncmp(Found, "\"ok\": true", 10) == 0;
+}
+
+/* where a program is in a baseline file */
+static const char *BaselineProgram(const char *Baseline, const char *Name)
+{
+    char Key[80];
+
+    snprintf(Key, sizeof(Key), "{\"name\": \"%s\",", Name);
+    return Baseline != NULL ? strstr(Baseline, Key) : NULL;
+}
+
+int main(int argc, char **argv)
+{
+    int Jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int Timeout = TIMEOUT_DEFAULT;
+    const char *Cc = "cc";
+    const char *OutName = NULL;
+    char *Baseline = NULL;
+    int Native = true;
+    const char *Itrapc;
+    struct Program *Prog;
+    int NumProgs;
+    int Running = 0;
+    int Next = 0;
+    int Passed = 0;
+    int Regressions = 0;
+    int NumSlowdowns = 0;
+    double LogSlowdown = 0;
+    double ItrapcMs = 0;
+    double WasMs = 0;               /* the same programs in the baseline */
+    double NowMs = 0;
+    long PeakRssKb = 0;
+    double WallMs;
+    long long Start;
+    char Template[] = "/tmp/itrapc_corpusXXXXXX";
+    int ArgCount = 1;
+    int Count;
+    FILE *Out = stdout;
+
+    for (; ArgCount < argc-1 && argv[ArgCount][0] == '-'; ArgCount++) {
+        if (strcmp(argv[ArgCount], "--no-native") == 0)
+            Native = false;
+        else if (strcmp(argv[ArgCount], "--jobs") == 0)
+            Jobs = atoi(argv[++ArgCount]);
+        else if (strcmp(argv[ArgCount], "--timeout") == 0)
+            Timeout = atoi(argv[++ArgCount]);
+        else if (strcmp(argv[ArgCount], "--cc") == 0)
+            Cc = argv[++ArgCount];
+        else if (strcmp(argv[ArgCount], "--out") == 0)
+            OutName = argv[++ArgCount];
+        else if (strcmp(argv[ArgCount], "--baseline") == 0) {
+            if ((Baseline = BenchReadFile(argv[++ArgCount])) == NULL)
+                fprintf(stderr, "can't read baseline %s\n", argv[ArgCount]);
+        } else
+            break;
+    }
+
+    if (argc - ArgCount < 2) {
+        printf("Format:\n\n"
+            "> itrapc_corpus [--jobs N] [--timeout secs] [--cc cc] [--no-native]\n"
+            "      [--out results.json] [--baseline old.json] itrapc <program.c>...\n");
+        return 1;
+    }
+
+    if (Jobs < 1)
+        Jobs = 1;
+
+    Itrapc = argv[ArgCount++];
+    NumProgs = argc - ArgCount;
+    Prog = calloc(NumProgs, sizeof(struct Program));
+    if (Prog == NULL || (TempDir = mkdtemp(Template)) == NULL) {
+        fprintf(stderr, "can't set up: out of memory or no /tmp\n");
+        return 1;
+    }
+
+    for (Count = 0; Count < NumProgs; Count++) {
+        const char *Base = strrchr(argv[ArgCount + Count], '/');
+
+        Prog[Count].FileName = argv[ArgCount + Count];
+        snprintf(Prog[Count].Name, sizeof(Prog[Count].Name), "%s",
+            Base != NULL ? Base+1 : Prog[Count].FileName);
+        if (strrchr(Prog[Count].Name, '.') != NULL)
+            *strrchr(Prog[Count].Name, '.') = '\0';
+
+        Prog[Count].Step = Native ? StepCompile : StepItrapc;
+    }
+
+    /* keep Jobs steps running until every program's only its native run
+        left. each step's timed from when it starts to when it's reaped */
+    Start = BenchNow();
+    while (Next < NumProgs || Running > 0) {
+        struct rusage Usage;
+        int Status;
+        pid_t Pid;
+
+        while (Running < Jobs && Next < NumProgs) {
+            if (StartStep(&Prog[Next], Itrapc, Cc, Timeout))
+                Running++;
+            else
+                Prog[Next].Step = StepDone;
+
+            Next++;
+        }
+
+        if (Running == 0)
+            continue;
+
+        if ((Pid = wait4(-1, &Status, 0, &Usage)) < 0)
+            break;
+
+        for (Count = 0; Count < NumProgs && Prog[Count].Pid != Pid; Count++)
+            ;
+
+        if (Count == NumProgs)
+            continue;
+
+        Running--;
+        FinishStep(&Prog[Count], Status, &Usage);
+        if (Prog[Count].Step != StepDone && Prog[Count].Step != StepNative) {
+            if (StartStep(&Prog[Count], Itrapc, Cc, Timeout))
+                Running++;
+            else
+                Prog[Count].Step = StepDone;
+        }
+    }
+    WallMs = (BenchNow() - Start) / 1e6;
+
+    /* then the native builds, one at a time */
+    for (Count = 0; Count < NumProgs; Count++) {
+        struct rusage Usage;
+        int Status;
+
+        if (Prog[Count].Step != StepNative)
+            continue;
+
+        if (StartStep(&Prog[Count], Itrapc, Cc, Timeout) &&
+                wait4(Prog[Count].Pid, &Status, 0, &Usage) == Prog[Count].Pid)
+            FinishStep(&Prog[Count], Status, &Usage);
+        else {
+            char Binary[512];
+
+            TempName(Binary, sizeof(Binary), &Prog[Count], "");
+            unlink(Binary);
+            Prog[Count].Step = StepDone;
+        }
+    }
+    rmdir(TempDir);
+
+    if (OutName != NULL && (Out = fopen(OutName, "w")) == NULL) {
+        fprintf(stderr, "can't write %s\n", OutName);
+        return 1;
+    }
+
+    fprintf(Out, "{\n  \"itrapc\": \"%s\",\n  \"jobs\": %d,\n  \"programs\": [\n",
+        Itrapc, Jobs);
+    for (Count = 0; Count < NumProgs; Count++) {
+        struct Program *P = &Prog[Count];
+        const char *Was = BaselineProgram(Baseline, P->Name);
+
+        fprintf(Out, "    {\"name\": \"%s\", \"ok\": %s, \"itrapc_ms\": %.3f, "
+            "\"rss_kb\": %ld", P->Name, P->Ok ? "true" : "false",
+            P->ItrapcMs, P->RssKb);
+        if (P->NativeOk && P->NativeCpuMs > 0 && P->ItrapcCpuMs > 0) {
+            fprintf(Out, ", \"native_ms\": %.3f, \"itrapc_cpu_ms\": %.3f, "
+                "\"native_cpu_ms\": %.3f, \"slowdown\": %.1f", P->NativeMs,
+                P->ItrapcCpuMs, P->NativeCpuMs, P->ItrapcCpuMs / P->NativeCpuMs);
+            LogSlowdown += log(P->ItrapcCpuMs / P->NativeCpuMs);
+            NumSlowdowns++;
+        }
+        fprintf(Out, "}%s\n", Count < NumProgs-1 ? "," : "");
+
+        ItrapcMs += P->ItrapcMs;
+        if (Was != NULL) {
+            WasMs += BaselineNumber(Was, "\"itrapc_ms\": ");
+            NowMs += P->ItrapcMs;
+        }
+
+        if (P->RssKb > PeakRssKb)
+            PeakRssKb = P->RssKb;
+
+        if (P->Ok)
+            Passed++;
+        else if (BaselineOk(Was)) {
+            fprintf(stderr, "%s passed in the baseline but fails now\n", P->Name);
+            Regressions++;
+        } else
+            fprintf(stderr, "%s fails\n", P->Name);
+    }
+
+    fprintf(Out, "  ],\n  \"passed\": %d,\n  \"failed\": %d,\n  \"wall_ms\": %.3f,\n"
+        "  \"itrapc_ms\": %.3f,\n  \"programs_per_sec\": %.2f,\n  \"peak_rss_kb\": %ld",
+        Passed, NumProgs - Passed, WallMs, ItrapcMs, NumProgs / (WallMs / 1e3),
+        PeakRssKb);
+    if (NumSlowdowns > 0)
+        fprintf(Out, ",\n  \"geomean_slowdown\": %.2f", exp(LogSlowdown / NumSlowdowns));
+    fprintf(Out, "\n}\n");
+    if (Out != stdout)
+        fclose(Out);
+
+    fprintf(stderr, "%d of %d programs passed in %.0f ms on %d jobs, %.2f "
+        "programs/sec, %.0f ms under itrapc in all, peak RSS %ld KB\n",
+        Passed, NumProgs, WallMs, Jobs, NumProgs / (WallMs / 1e3), ItrapcMs,
+        PeakRssKb);
+    if (NumSlowdowns > 0)
+        fprintf(stderr, "itrapc is %.1f times slower than native code "
+            "(geometric mean of %d programs)\n", exp(LogSlowdown / NumSlowdowns),
+            NumSlowdowns);
+
+    if (Baseline != NULL) {
+        double WasSlowdown = BaselineNumber(strstr(Baseline, "  ],"),
+            "\"geomean_slowdown\": ");
+
+        if (WasMs > 0)
+            fprintf(stderr, "baseline: %.0f ms under itrapc for the same "
+                "programs, %+.1f%% now\n", WasMs, (NowMs - WasMs) * 100 / WasMs);
+        if (WasSlowdown > 0 && NumSlowdowns > 0)
+            fprintf(stderr, "baseline: %.1f times slower than native\n", WasSlowdown);
+    }
+
+    free(Baseline);
+    free(Prog);
+    return Regressions > 0;
+}
@@ -0,0 +1,21 @@
+/* indexing an array, OPS reads and writes */
+#include <stdio.h>
+
+#define OPS 300000
+#define SIZE 1000
+
+int Data[SIZE];
+
+int main()
+{
+    int i;
+    unsigned int Sum = 0;
+
+    for (i = 0; i < OPS; i++) {
+        Data[i % SIZE] = i;
+        Sum += Data[(i * 7) % SIZE];
+    }
+
+    printf("%u\n", Sum);
+    return 0;
+}
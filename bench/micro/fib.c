@@ -0,0 +1,18 @@
+/* function call overhead. OPS is the number of calls fib(25) makes */
+#include <stdio.h>
+
+#define OPS 242785
+
+int fib(int n)
+{
+    if (n < 2)
+        return n;
+
+    return fib(n - 1) + fib(n - 2);
+}
+
+int main()
+{
+    printf("%d\n", fib(25));
+    return 0;
+}
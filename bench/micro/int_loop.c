@@ -0,0 +1,16 @@
+/* integer arithmetic in a tight loop */
+#include <stdio.h>
+
+#define OPS 500000
+
+int main()
+{
+    int i;
+    unsigned int Sum = 0;
+
+    for (i = 0; i < OPS; i++)
+        Sum = (Sum + i * 3) ^ (i >> 2);
+
+    printf("%u\n", Sum);
+    return 0;
+}
@@ -0,0 +1,19 @@
+/* expanding function-like macros */
+#include <stdio.h>
+
+#define OPS 200000
+
+#define SQUARE(a) ((a) * (a))
+#define MASK(a, b) ((a) & (b))
+
+int main()
+{
+    int i;
+    int Sum = 0;
+
+    for (i = 0; i < OPS; i++)
+        Sum += SQUARE(MASK(i, 15)) + MASK(i, 255);
+
+    printf("%d\n", Sum);
+    return 0;
+}
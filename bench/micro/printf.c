@@ -0,0 +1,14 @@
+/* formatted output. the runner throws stdout away */
+#include <stdio.h>
+
+#define OPS 100000
+
+int main()
+{
+    int i;
+
+    for (i = 0; i < OPS; i++)
+        printf("%d %s %c %x\n", i, "line", 'a' + i % 26, i);
+
+    return 0;
+}
@@ -0,0 +1,12 @@
+/* starting up, including the usual headers, and exiting. run with
+    --time-startup to see where the time goes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define OPS 1
+
+int main()
+{
+    return 0;
+}
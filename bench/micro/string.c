@@ -0,0 +1,23 @@
+/* the string.h functions */
+#include <stdio.h>
+#include <string.h>
+
+#define OPS 50000
+
+int main()
+{
+    char Buf[64];
+    int i;
+    int Total = 0;
+
+    for (i = 0; i < OPS; i++) {
+        strcpy(Buf, "the quick brown fox");
+        strcat(Buf, " jumps");
+        Total += strlen(Buf);
+        if (strcmp(Buf, "the quick brown fox jumps") == 0)
+            Total++;
+    }
+
+    printf("%d\n", Total);
+    return 0;
+}
@@ -0,0 +1,29 @@
+/* reading and writing struct members, directly and through a pointer */
+#include <stdio.h>
+
+#define OPS 200000
+
+struct Point {
+    unsigned int x;
+    unsigned int y;
+    unsigned int z;
+};
+
+int main()
+{
+    struct Point P;
+    struct Point *Q = &P;
+    int i;
+
+    P.x = 0;
+    P.y = 0;
+    P.z = 0;
+    for (i = 0; i < OPS; i++) {
+        P.x += i;
+        Q->y = P.x - Q->z;
+        Q->z = P.y & 255;
+    }
+
+    printf("%u %u %u\n", P.x, P.y, P.z);
+    return 0;
+}
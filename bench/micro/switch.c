@@ -0,0 +1,26 @@
+/* dispatching on a switch, like a bytecode interpreter would */
+#include <stdio.h>
+
+#define OPS 100000
+
+int main()
+{
+    int i;
+    unsigned int Acc = 0;
+
+    for (i = 0; i < OPS; i++) {
+        switch (i & 7) {
+        case 0: Acc += 1; break;
+        case 1: Acc -= 2; break;
+        case 2: Acc ^= i; break;
+        case 3: Acc += i >> 3; break;
+        case 4: Acc = Acc * 3; break;
+        case 5: Acc &= 0xffff; break;
+        case 6: Acc |= 1; break;
+        default: Acc--; break;
+        }
+    }
+
+    printf("%u\n", Acc);
+    return 0;
+}
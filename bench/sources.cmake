@@ -0,0 +1,2 @@
+bench.c
+bench_util.c
\ No newline at end of file
@@ -0,0 +1,254 @@
+/* itrapc benchmark mode. the program's parsed once, then main() is called
+ * a number of times and timed, with the global variables put back how
+ * they were before each call */
+
+#include "interpreter.h"
+#include "type.h"
+#include "table.h"
+#include "variable.h"
+#include "profile.h"
+
+#if defined(UNIX_HOST) || defined(WIN32)
+#include <math.h>
+
+#if defined(UNIX_HOST) && defined(__linux__)
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#define USE_PERF_COUNTERS
+#endif
+
+/* a global variable's value before main() first ran */
+struct BenchGlobal {
+    struct Value *Var;
+    int Size;
+    void *Saved;
+};
+
+#ifdef USE_PERF_COUNTERS
+static const struct {
+    const char *Name;
+    unsigned long long Config;
+} BenchCounter[] = {
+    { "cycles", PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions", PERF_COUNT_HW_INSTRUCTIONS },
+    { "branch misses", PERF_COUNT_HW_BRANCH_MISSES },
+    { "cache misses", PERF_COUNT_HW_CACHE_MISSES }
+};
+
+#define BENCH_COUNTERS (sizeof(BenchCounter) / sizeof(BenchCounter[0]))
+
+/* count Config in this thread. returns -1 if the hardware or the
+    system won't let us */
+static int BenchOpenCounter(unsigned long long Config)
+{
+    struct perf_event_attr Attr;
+
+    memset(&Attr, 0, sizeof(Attr));
+    Attr.size = sizeof(Attr);
+    Attr.type = PERF_TYPE_HARDWARE;
+    Attr.config = Config;
+    Attr.disabled = 1;
+    Attr.exclude_kernel = 1;
+    Attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &Attr, 0, -1, -1, 0);
+}
+#endif
+
+/* note the values of the program's global variables. library variables,
+    which have no declaration, are left alone */
+static struct BenchGlobal *BenchSaveGlobals(Engine *pc, int *NumGlobals)
+{
+    struct BenchGlobal *Global = NULL;
+    struct TableEntry *Entry;
+    int Count;
+
+    *NumGlobals = 0;
+    for (Count = 0; Count < pc->GlobalTable.Size; Count++) {
+        for (Entry = pc->GlobalTable.HashTable[Count]; Entry != NULL;
+                Entry = Entry->Next) {
+            struct Value *Var = Entry->p.v.Val;
+            struct BenchGlobal *More;
+
+            if (Entry->DeclFileName == NULL || !Var->IsLValue)
+                continue;
+
+            switch (Var->Typ->Base) {
+            case TypeFunction:
+            case TypeMacro:
+            case Type_Type:
+            case TypeVoid:
+                continue;
+            default:
+                break;
+            }
+
+            More = realloc(Global, sizeof(struct BenchGlobal) * (*NumGlobals + 1));
+            if (More == NULL)
+                ProgramFailNoParser(pc, "(BenchSaveGlobals) out of memory");
+
+            Global = More;
+            Global[*NumGlobals].Var = Var;
+            Global[*NumGlobals].Size = TypeSizeValue(Var, false);
+            Global[*NumGlobals].Saved = malloc(Global[*NumGlobals].Size);
+            if (Global[*NumGlobals].Saved == NULL)
+                ProgramFailNoParser(pc, "(BenchSaveGlobals) out of memory");
+
+            memcpy(Global[*NumGlobals].Saved, Var->Val, Global[*NumGlobals].Size);
+            (*NumGlobals)++;
+        }
+    }
+
+    return Global;
+}
+
+/* forget the static variables in functions main() defined as it ran, so
+    they're defined and initialized again next time */
+static void BenchForgetStatics(Engine *pc, struct BenchGlobal *Global,
+    int NumGlobals)
+{
+    struct TableEntry *Entry;
+    struct TableEntry *NextEntry;
+    int Count;
+    int Saved;
+
+    for (Count = 0; Count < pc->GlobalTable.Size; Count++) {
+        for (Entry = pc->GlobalTable.HashTable[Count]; Entry != NULL;
+                Entry = NextEntry) {
+            NextEntry = Entry->Next;
+            if (((uintptr_t)Entry->p.v.Key & 1) || Entry->p.v.Key[0] != '/')
+                continue;
+
+            for (Saved = 0; Saved < NumGlobals &&
+                    Global[Saved].Var != Entry->p.v.Val; Saved++)
+                ;
+
+            if (Saved == NumGlobals)
+                VariableFree(pc, TableDelete(pc, &pc->GlobalTable,
+                    Entry->p.v.Key));
+        }
+    }
+}
+
+static int BenchCompareTimes(const void *A, const void *B)
+{
+    double TimeA = *(const double*)A;
+    double TimeB = *(const double*)B;
+
+    return (TimeA > TimeB) - (TimeA < TimeB);
+}
+
+/* call main() Runs times and show how long it took on stderr. a run
+    which returns or exits with anything but 0, or fails, is the last.
+    returns the last exit value */
+int EngineBench(Engine *pc, int Runs, int argc, char **argv)
+{
+    struct BenchGlobal *Global;
+    int NumGlobals;
+    double *Time = malloc(sizeof(double) * (Runs > 0 ? Runs : 1));
+    void *StackTop = pc->HeapStackTop;
+    void *StackFrame = pc->StackFrame;
+    struct StackFrame *TopStackFrame = pc->TopStackFrame;
+    volatile int Run;
+    double Sum = 0;
+    double SumSquares = 0;
+    int Count;
+    jmp_buf ExitBuf;
+#ifdef USE_PERF_COUNTERS
+    int Counter[BENCH_COUNTERS];
+    unsigned long long CounterTotal[BENCH_COUNTERS];
+
+    for (Count = 0; Count < (int)BENCH_COUNTERS; Count++) {
+        Counter[Count] = BenchOpenCounter(BenchCounter[Count].Config);
+        CounterTotal[Count] = 0;
+    }
+#endif
+
+    if (Time == NULL)
+        ProgramFailNoParser(pc, "(EngineBench) out of memory");
+
+    /* each run's exit() comes back here, rather than ending everything */
+    memcpy(ExitBuf, pc->EngineExitBuf, sizeof(jmp_buf));
+    Global = BenchSaveGlobals(pc, &NumGlobals);
+    for (Run = 0; Run < Runs; Run++) {
+        long long Start;
+
+        for (Count = 0; Count < NumGlobals; Count++)
+            memcpy(Global[Count].Var->Val, Global[Count].Saved, Global[Count].Size);
+
+        pc->EngineExitValue = 0;
+#ifdef USE_PERF_COUNTERS
+        for (Count = 0; Count < (int)BENCH_COUNTERS; Count++) {
+            if (Counter[Count] >= 0) {
+                ioctl(Counter[Count], PERF_EVENT_IOC_RESET, 0);
+                ioctl(Counter[Count], PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+        Start = ProfileNow();
+        if (!EnginePlatformSetExitPoint(pc))
+            EngineCallMain(pc, argc, argv);
+
+        Time[Run] = (ProfileNow() - Start) / 1e6;
+#ifdef USE_PERF_COUNTERS
+        for (Count = 0; Count < (int)BENCH_COUNTERS; Count++) {
+            unsigned long long Value;
+
+            if (Counter[Count] >= 0) {
+                ioctl(Counter[Count], PERF_EVENT_IOC_DISABLE, 0);
+                if (read(Counter[Count], &Value, sizeof(Value)) == sizeof(Value))
+                    CounterTotal[Count] += Value;
+            }
+        }
+#endif
+
+        /* an exit() leaves main()'s frames on the stack */
+        pc->HeapStackTop = StackTop;
+        pc->StackFrame = StackFrame;
+        pc->TopStackFrame = TopStackFrame;
+        BenchForgetStatics(pc, Global, NumGlobals);
+        Sum += Time[Run];
+        SumSquares += Time[Run] * Time[Run];
+        if (pc->EngineExitValue != 0) {
+            Run++;
+            break;
+        }
+    }
+    memcpy(pc->EngineExitBuf, ExitBuf, sizeof(jmp_buf));
+
+    fflush(pc->StdoutValue);
+    if (Run > 0) {
+        double Mean = Sum / Run;
+        double Variance = SumSquares / Run - Mean * Mean;
+
+        qsort(Time, Run, sizeof(double), BenchCompareTimes);
+        fprintf(stderr, "bench: %d runs of main(), %d globals reset between them\n",
+            Run, NumGlobals);
+        fprintf(stderr, "bench: min %.3f ms, median %.3f ms, max %.3f ms, "
+            "mean %.3f ms, stddev %.3f ms\n", Time[0],
+            Run % 2 ? Time[Run/2] : (Time[Run/2 - 1] + Time[Run/2]) / 2,
+            Time[Run-1], Mean, Variance > 0 ? sqrt(Variance) : 0.0);
+    }
+
+    if (Run < Runs)
+        fprintf(stderr, "bench: stopped after run %d, which exited with %d\n",
+            Run, pc->EngineExitValue);
+
+#ifdef USE_PERF_COUNTERS
+    for (Count = 0; Count < (int)BENCH_COUNTERS; Count++) {
+        if (Counter[Count] >= 0) {
+            if (Run > 0)
+                fprintf(stderr, "bench: %.0f %s per run\n",
+                    (double)CounterTotal[Count] / Run, BenchCounter[Count].Name);
+            close(Counter[Count]);
+        }
+    }
+#endif
+
+    for (Count = 0; Count < NumGlobals; Count++)
+        free(Global[Count].Saved);
+    free(Global);
+    free(Time);
+    return pc->EngineExitValue;
+}
+#endif
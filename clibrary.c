@@ -7,8 +7,6 @@
 
 /* endian-ness checking */
 static const int __ENDIAN_CHECK__ = 1;
-static int BigEndian;
-static int LittleEndian;
 
 
 /* global initialisation for libraries */
@@ -21,13 +19,13 @@ void LibraryInit(Engine *pc)
         (union AnyValue*)&pc->VersionString, false);
 
     /* define endian-ness macros */
-    BigEndian = ((*(char*)&__ENDIAN_CHECK__) == 0);
-    LittleEndian = ((*(char*)&__ENDIAN_CHECK__) == 1);
+    pc->BigEndian = ((*(char*)&__ENDIAN_CHECK__) == 0);
+    pc->LittleEndian = ((*(char*)&__ENDIAN_CHECK__) == 1);
 
     VariableDefinePlatformVar(pc, NULL, "BIG_ENDIAN", &pc->IntType,
-        (union AnyValue*)&BigEndian, false);
+        (union AnyValue*)&pc->BigEndian, false);
     VariableDefinePlatformVar(pc, NULL, "LITTLE_ENDIAN", &pc->IntType,
-        (union AnyValue*)&LittleEndian, false);
+        (union AnyValue*)&pc->LittleEndian, false);
 }
 
 /* add a library */
@@ -2,6 +2,7 @@
 #include <errno.h>
 
 #include "../interpreter.h"
+#include "../table.h"
 
 
 #ifdef EACCES
@@ -733,3 +734,17 @@ void StdErrnoSetupFunc(Engine *pc)
         (union AnyValue*)&errno, true);
 }
 
+/* errno is per thread, and it was set up on whichever thread included
+    <errno.h>. point it at the errno of the thread which runs the program */
+void StdErrnoThreadSetup(Engine *pc)
+{
+    struct Value *Errno;
+    const char *DeclFileName;
+    int DeclLine;
+    int DeclColumn;
+
+    /* a program's own errno was declared in one of its files */
+    if (TableGet(&pc->GlobalTable, TableStrRegister(pc, "errno", 5), &Errno,
+            &DeclFileName, &DeclLine, &DeclColumn) && DeclFileName == NULL)
+        Errno->Val = (union AnyValue*)&errno;
+}
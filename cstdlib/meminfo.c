@@ -0,0 +1,49 @@
+/* meminfo.h - what the engine's memory is used for */
+#include "../interpreter.h"
+#include "../heap.h"
+
+/* the category a name passed to us stands for */
+static int MemInfoCategory(struct ParseState *Parser, const char *Name)
+{
+    int Category = HeapCategoryByName(Name);
+
+    if (Category < 0)
+        ProgramFail(Parser, "unknown memory category '%s'", Name);
+
+    return Category;
+}
+
+void MemInfoReport(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    EnginePrintMemory(Parser->pc, Parser->pc->CStdOut);
+}
+
+void MemInfoInUse(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    struct MemStats *Mem = &Parser->pc->MemStats;
+    int Category = MemInfoCategory(Parser, Param[0]->Val->Pointer);
+
+    ReturnValue->Val->UnsignedLongInteger = Category == MemCategories ?
+        Mem->TotalInUse : Mem->InUse[Category];
+}
+
+void MemInfoPeak(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    struct MemStats *Mem = &Parser->pc->MemStats;
+    int Category = MemInfoCategory(Parser, Param[0]->Val->Pointer);
+
+    ReturnValue->Val->UnsignedLongInteger = Category == MemCategories ?
+        Mem->TotalPeak : Mem->Peak[Category];
+}
+
+/* all meminfo.h functions */
+struct LibraryFunction MemInfoFunctions[] =
+{
+    {MemInfoReport,     "void mem_report();"},
+    {MemInfoInUse,      "unsigned long mem_in_use(char *);"},
+    {MemInfoPeak,       "unsigned long mem_peak(char *);"},
+    {NULL,              NULL }
+};
@@ -0,0 +1,19 @@
+/* parallel.h - share a loop's iterations between threads */
+#include "../interpreter.h"
+#include "../worker.h"
+
+#if defined(UNIX_HOST) || defined(WIN32)
+void ParallelFor(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    WorkerFor(Parser, Param[0]->Val->Integer, Param[1]->Val->Integer,
+        Param[2]->Val->Pointer);
+}
+
+/* all parallel.h functions */
+struct LibraryFunction ParallelFunctions[] =
+{
+    {ParallelFor,   "void parallel_for(int,int,char *);"},
+    {NULL,          NULL }
+};
+#endif
@@ -2,9 +2,13 @@ sources.cmake
 ctype.c
 errno.c
 math.c
+meminfo.c
+parallel.c
 stdbool.c
 stdio.c
 stdlib.c
 string.c
+thread.c
 time.c
+trace.c
 unistd.c
@@ -23,9 +23,6 @@ static int _IONBFValue = _IONBF;
 static int L_tmpnamValue = L_tmpnam;
 static int GETS_MAXValue = 255;  /* arbitrary maximum size of a gets() file */
 
-static FILE *stdinValue;
-static FILE *stdoutValue;
-static FILE *stderrValue;
 
 
 /* our own internal output stream which can output to FILE * or strings */
@@ -49,9 +46,9 @@ struct StdVararg
 void BasicIOInit(Engine *pc)
 {
     pc->CStdOut = stdout;
-    stdinValue = stdin;
-    stdoutValue = stdout;
-    stderrValue = stderr;
+    pc->StdinValue = stdin;
+    pc->StdoutValue = stdout;
+    pc->StderrValue = stderr;
 }
 
 /* output a single character to either a FILE * or a string */
@@ -627,7 +624,8 @@ void StdioPutc(struct ParseState *Parser, struct Value *ReturnValue,
 void StdioPutchar(struct ParseState *Parser, struct Value *ReturnValue,
     struct Value **Param, int NumArgs)
 {
-    ReturnValue->Val->Integer = putchar(Param[0]->Val->Integer);
+    ReturnValue->Val->Integer = putc(Param[0]->Val->Integer,
+        Parser->pc->StdoutValue);
 }
 
 void StdioSetbuf(struct ParseState *Parser, struct Value *ReturnValue,
@@ -653,14 +651,19 @@ void StdioUngetc(struct ParseState *Parser, struct Value *ReturnValue,
 void StdioPuts(struct ParseState *Parser, struct Value *ReturnValue,
     struct Value **Param, int NumArgs)
 {
-    ReturnValue->Val->Integer = puts(Param[0]->Val->Pointer);
+    IOFILE *Stream = Parser->pc->StdoutValue;
+
+    if (fputs(Param[0]->Val->Pointer, Stream) == EOF)
+        ReturnValue->Val->Integer = EOF;
+    else
+        ReturnValue->Val->Integer = putc('\n', Stream);
 }
 
 void StdioGets(struct ParseState *Parser, struct Value *ReturnValue,
     struct Value **Param, int NumArgs)
 {
     ReturnValue->Val->Pointer = fgets(Param[0]->Val->Pointer,
-        GETS_MAXValue, stdin);
+        GETS_MAXValue, Parser->pc->StdinValue);
     if (ReturnValue->Val->Pointer != NULL) {
         char *EOLPos = strchr(Param[0]->Val->Pointer, '\n');
         if (EOLPos != NULL)
@@ -671,7 +674,7 @@ void StdioGets(struct ParseState *Parser, struct Value *ReturnValue,
 void StdioGetchar(struct ParseState *Parser, struct Value *ReturnValue,
     struct Value **Param, int NumArgs)
 {
-    ReturnValue->Val->Integer = getchar();
+    ReturnValue->Val->Integer = getc(Parser->pc->StdinValue);
 }
 
 void StdioPrintf(struct ParseState *Parser, struct Value *ReturnValue,
@@ -681,16 +684,17 @@ void StdioPrintf(struct ParseState *Parser, struct Value *ReturnValue,
 
     PrintfArgs.Param = Param;
     PrintfArgs.NumArgs = NumArgs - 1;
-    ReturnValue->Val->Integer = StdioBasePrintf(Parser, stdout, NULL, 0,
-        Param[0]->Val->Pointer, &PrintfArgs);
-    fflush(stdout);  /* Flush output immediately for Windows console */
+    ReturnValue->Val->Integer = StdioBasePrintf(Parser,
+        Parser->pc->StdoutValue, NULL, 0, Param[0]->Val->Pointer, &PrintfArgs);
+    fflush(Parser->pc->StdoutValue);  /* Flush output immediately for Windows console */
 }
 
 void StdioVprintf(struct ParseState *Parser, struct Value *ReturnValue,
     struct Value **Param, int NumArgs)
 {
-    ReturnValue->Val->Integer = StdioBasePrintf(Parser, stdout, NULL, 0,
-        Param[0]->Val->Pointer, Param[1]->Val->Pointer);
+    ReturnValue->Val->Integer = StdioBasePrintf(Parser,
+        Parser->pc->StdoutValue, NULL, 0, Param[0]->Val->Pointer,
+        Param[1]->Val->Pointer);
 }
 
 void StdioFprintf(struct ParseState *Parser, struct Value *ReturnValue,
@@ -741,8 +745,8 @@ void StdioScanf(struct ParseState *Parser, struct Value *ReturnValue,
 
     ScanfArgs.Param = Param;
     ScanfArgs.NumArgs = NumArgs - 1;
-    ReturnValue->Val->Integer = StdioBaseScanf(Parser, stdin, NULL,
-        Param[0]->Val->Pointer, &ScanfArgs);
+    ReturnValue->Val->Integer = StdioBaseScanf(Parser,
+        Parser->pc->StdinValue, NULL, Param[0]->Val->Pointer, &ScanfArgs);
 }
 
 void StdioFscanf(struct ParseState *Parser, struct Value *ReturnValue,
@@ -786,8 +790,9 @@ void StdioVsnprintf(struct ParseState *Parser, struct Value *ReturnValue,
 void StdioVscanf(struct ParseState *Parser, struct Value *ReturnValue,
     struct Value **Param, int NumArgs)
 {
-    ReturnValue->Val->Integer = StdioBaseScanf(Parser, stdin, NULL,
-        Param[0]->Val->Pointer, Param[1]->Val->Pointer);
+    ReturnValue->Val->Integer = StdioBaseScanf(Parser,
+        Parser->pc->StdinValue, NULL, Param[0]->Val->Pointer,
+        Param[1]->Val->Pointer);
 }
 
 void StdioVfscanf(struct ParseState *Parser, struct Value *ReturnValue,
@@ -909,11 +914,11 @@ void StdioSetupFunc(Engine *pc)
 
     /* define stdin, stdout and stderr */
     VariableDefinePlatformVar(pc, NULL, "stdin", FilePtrType,
-        (union AnyValue*)&stdinValue, false);
+        (union AnyValue*)&pc->StdinValue, false);
     VariableDefinePlatformVar(pc, NULL, "stdout", FilePtrType,
-        (union AnyValue*)&stdoutValue, false);
+        (union AnyValue*)&pc->StdoutValue, false);
     VariableDefinePlatformVar(pc, NULL, "stderr", FilePtrType,
-        (union AnyValue*)&stderrValue, false);
+        (union AnyValue*)&pc->StderrValue, false);
 
     /* define NULL, true and false */
     if (!VariableDefined(pc, TableStrRegister(pc, "NULL",4)))
@@ -2,6 +2,23 @@
 #include <stdlib.h>
 
 #include "../interpreter.h"
+#include "../table.h"
+#include "../heap.h"
+
+/* how big a block malloc() really gave us, so the program's memory can be
+    counted against the engine. where we can't tell it isn't counted */
+#if defined(__GLIBC__)
+#include <malloc.h>
+#define MALLOC_SIZE(Ptr) malloc_usable_size(Ptr)
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#define MALLOC_SIZE(Ptr) malloc_size(Ptr)
+#elif defined(WIN32)
+#include <malloc.h>
+#define MALLOC_SIZE(Ptr) _msize(Ptr)
+#else
+#define MALLOC_SIZE(Ptr) 0
+#endif
 
 
 static int Stdlib_ZeroValue = 0;
@@ -48,26 +65,61 @@ void StdlibStrtoul(struct ParseState *Parser, struct Value *ReturnValue,
 void StdlibMalloc(struct ParseState *Parser, struct Value *ReturnValue,
     struct Value **Param, int NumArgs)
 {
-    ReturnValue->Val->Pointer = malloc(Param[0]->Val->Integer);
+    Engine *pc = Parser->pc;
+    void *Mem = NULL;
+
+    if (HeapMemAvailable(pc, MemMalloc, Param[0]->Val->Integer))
+        Mem = malloc(Param[0]->Val->Integer);
+
+    if (Mem != NULL)
+        HeapAccount(pc, MemMalloc, MALLOC_SIZE(Mem));
+
+    ReturnValue->Val->Pointer = Mem;
 }
 
 void StdlibCalloc(struct ParseState *Parser, struct Value *ReturnValue,
     struct Value **Param, int NumArgs)
 {
-    ReturnValue->Val->Pointer = calloc(Param[0]->Val->Integer,
-        Param[1]->Val->Integer);
+    Engine *pc = Parser->pc;
+    void *Mem = NULL;
+
+    if (HeapMemAvailable(pc, MemMalloc,
+            (unsigned long)Param[0]->Val->Integer * Param[1]->Val->Integer))
+        Mem = calloc(Param[0]->Val->Integer, Param[1]->Val->Integer);
+
+    if (Mem != NULL)
+        HeapAccount(pc, MemMalloc, MALLOC_SIZE(Mem));
+
+    ReturnValue->Val->Pointer = Mem;
 }
 
 void StdlibRealloc(struct ParseState *Parser, struct Value *ReturnValue,
     struct Value **Param, int NumArgs)
 {
-    ReturnValue->Val->Pointer = realloc(Param[0]->Val->Pointer,
-        Param[1]->Val->Integer);
+    Engine *pc = Parser->pc;
+    void *Old = Param[0]->Val->Pointer;
+    long OldSize = Old != NULL ? (long)MALLOC_SIZE(Old) : 0;
+    long Size = Param[1]->Val->Integer;
+    void *Mem = NULL;
+
+    if (Size <= OldSize || HeapMemAvailable(pc, MemMalloc, Size - OldSize)) {
+        Mem = realloc(Old, Size);
+
+        /* a realloc() to 0 bytes can free the block and give back NULL */
+        if (Mem != NULL || Size == 0)
+            HeapAccount(pc, MemMalloc,
+                (Mem != NULL ? (long)MALLOC_SIZE(Mem) : 0) - OldSize);
+    }
+
+    ReturnValue->Val->Pointer = Mem;
 }
 
 void StdlibFree(struct ParseState *Parser, struct Value *ReturnValue,
     struct Value **Param, int NumArgs)
 {
+    if (Param[0]->Val->Pointer != NULL)
+        HeapAccount(Parser->pc, MemMalloc, -(long)MALLOC_SIZE(Param[0]->Val->Pointer));
+
     free(Param[0]->Val->Pointer);
 }
 
@@ -192,7 +244,7 @@ struct LibraryFunction StdlibFunctions[] =
 void StdlibSetupFunc(Engine *pc)
 {
     /* define NULL, TRUE and FALSE */
-    if (!VariableDefined(pc, TableStrRegister(pc, "NULL")))
+    if (!VariableDefined(pc, TableStrRegister(pc, "NULL", 4)))
         VariableDefinePlatformVar(pc, NULL, "NULL", &pc->IntType,
             (union AnyValue*)&Stdlib_ZeroValue, false);
 }
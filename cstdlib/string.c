@@ -2,6 +2,7 @@
 #include <string.h>
 
 #include "../interpreter.h"
+#include "../table.h"
 
 
 static int String_ZeroValue = 0;
@@ -229,7 +230,7 @@ struct LibraryFunction StringFunctions[] =
 void StringSetupFunc(Engine *pc)
 {
     /* define NULL */
-    if (!VariableDefined(pc, TableStrRegister(pc, "NULL")))
+    if (!VariableDefined(pc, TableStrRegister(pc, "NULL", 4)))
         VariableDefinePlatformVar(pc, NULL, "NULL", &pc->IntType,
             (union AnyValue*)&String_ZeroValue, false);
 }
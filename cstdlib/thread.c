@@ -0,0 +1,251 @@
+/* thread.h - threads and channels between them */
+#include "../interpreter.h"
+#include "../worker.h"
+
+#if defined(UNIX_HOST) || defined(WIN32)
+#include <threads.h>
+
+enum ChannelKind {
+    ChannelInt,
+    ChannelDouble,
+    ChannelPointer
+};
+
+struct ChannelItem {
+    enum ChannelKind Kind;
+    union {
+        int Integer;
+#ifndef NO_FP
+        double FP;
+#endif
+        void *Pointer;
+    } Val;
+};
+
+/* a bounded queue any number of threads can send to and receive from */
+struct Channel {
+    mtx_t Lock;
+    cnd_t NotEmpty;
+    cnd_t NotFull;
+    int Capacity;
+    int Count;
+    int Head;                       /* the oldest item */
+    int Closed;
+    struct ChannelItem Item[1];     /* Capacity of them */
+};
+
+static const char *ChannelKindName[] = { "int", "double", "pointer" };
+
+/* wait for room then add an item */
+static void ChannelSend(struct ParseState *Parser, struct Channel *Chan,
+    struct ChannelItem *Item)
+{
+    if (Chan == NULL)
+        ProgramFail(Parser, "can't send on a NULL channel");
+
+    mtx_lock(&Chan->Lock);
+    while (Chan->Count == Chan->Capacity && !Chan->Closed)
+        cnd_wait(&Chan->NotFull, &Chan->Lock);
+
+    if (Chan->Closed) {
+        mtx_unlock(&Chan->Lock);
+        ProgramFail(Parser, "can't send on a closed channel");
+    }
+
+    Chan->Item[(Chan->Head + Chan->Count) % Chan->Capacity] = *Item;
+    Chan->Count++;
+    cnd_signal(&Chan->NotEmpty);
+    mtx_unlock(&Chan->Lock);
+}
+
+/* wait for an item and take it. returns false if the channel's closed and
+    there's nothing left in it */
+static int ChannelRecv(struct ParseState *Parser, struct Channel *Chan,
+    enum ChannelKind Kind, struct ChannelItem *Item)
+{
+    if (Chan == NULL)
+        ProgramFail(Parser, "can't receive on a NULL channel");
+
+    mtx_lock(&Chan->Lock);
+    while (Chan->Count == 0 && !Chan->Closed)
+        cnd_wait(&Chan->NotEmpty, &Chan->Lock);
+
+    if (Chan->Count == 0) {
+        mtx_unlock(&Chan->Lock);
+        return false;
+    }
+
+    *Item = Chan->Item[Chan->Head];
+    if (Item->Kind != Kind) {
+        mtx_unlock(&Chan->Lock);
+        ProgramFail(Parser, "received a%s %s from a channel, not a%s %s",
+            Item->Kind == ChannelInt ? "n" : "", ChannelKindName[Item->Kind],
+            Kind == ChannelInt ? "n" : "", ChannelKindName[Kind]);
+    }
+
+    Chan->Head = (Chan->Head + 1) % Chan->Capacity;
+    Chan->Count--;
+    cnd_signal(&Chan->NotFull);
+    mtx_unlock(&Chan->Lock);
+    return true;
+}
+
+void ThreadSpawn(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    ReturnValue->Val->Pointer = WorkerSpawn(Parser, Param[0]->Val->Pointer,
+        Param[1]->Val->Integer);
+}
+
+void ThreadJoin(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    ReturnValue->Val->Integer = WorkerJoin(Parser, Param[0]->Val->Pointer);
+}
+
+void ThreadChanNew(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    int Capacity = Param[0]->Val->Integer;
+    struct Channel *Chan;
+
+    if (Capacity < 1)
+        Capacity = 1;
+
+    Chan = malloc(sizeof(struct Channel) +
+        sizeof(struct ChannelItem) * (Capacity - 1));
+    if (Chan == NULL)
+        ProgramFail(Parser, "(ThreadChanNew) out of memory");
+
+    mtx_init(&Chan->Lock, mtx_plain);
+    cnd_init(&Chan->NotEmpty);
+    cnd_init(&Chan->NotFull);
+    Chan->Capacity = Capacity;
+    Chan->Count = 0;
+    Chan->Head = 0;
+    Chan->Closed = false;
+    ReturnValue->Val->Pointer = Chan;
+}
+
+void ThreadChanSend(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    struct ChannelItem Item;
+
+    Item.Kind = ChannelInt;
+    Item.Val.Integer = Param[1]->Val->Integer;
+    ChannelSend(Parser, Param[0]->Val->Pointer, &Item);
+}
+
+#ifndef NO_FP
+void ThreadChanSendDouble(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    struct ChannelItem Item;
+
+    Item.Kind = ChannelDouble;
+    Item.Val.FP = Param[1]->Val->FP;
+    ChannelSend(Parser, Param[0]->Val->Pointer, &Item);
+}
+#endif
+
+void ThreadChanSendPtr(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    struct ChannelItem Item;
+
+    Item.Kind = ChannelPointer;
+    Item.Val.Pointer = Param[1]->Val->Pointer;
+    ChannelSend(Parser, Param[0]->Val->Pointer, &Item);
+}
+
+void ThreadChanRecv(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    struct ChannelItem Item;
+
+    ReturnValue->Val->Integer = ChannelRecv(Parser, Param[0]->Val->Pointer,
+        ChannelInt, &Item);
+    if (ReturnValue->Val->Integer && Param[1]->Val->Pointer != NULL)
+        *(int*)Param[1]->Val->Pointer = Item.Val.Integer;
+}
+
+#ifndef NO_FP
+void ThreadChanRecvDouble(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    struct ChannelItem Item;
+
+    ReturnValue->Val->Integer = ChannelRecv(Parser, Param[0]->Val->Pointer,
+        ChannelDouble, &Item);
+    if (ReturnValue->Val->Integer && Param[1]->Val->Pointer != NULL)
+        *(double*)Param[1]->Val->Pointer = Item.Val.FP;
+}
+#endif
+
+void ThreadChanRecvPtr(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    struct ChannelItem Item;
+
+    ReturnValue->Val->Integer = ChannelRecv(Parser, Param[0]->Val->Pointer,
+        ChannelPointer, &Item);
+    if (ReturnValue->Val->Integer && Param[1]->Val->Pointer != NULL)
+        *(void**)Param[1]->Val->Pointer = Item.Val.Pointer;
+}
+
+/* nothing more can be sent. receivers get what's left, then 0 */
+void ThreadChanClose(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    struct Channel *Chan = Param[0]->Val->Pointer;
+
+    if (Chan == NULL)
+        ProgramFail(Parser, "can't close a NULL channel");
+
+    mtx_lock(&Chan->Lock);
+    Chan->Closed = true;
+    cnd_broadcast(&Chan->NotEmpty);
+    cnd_broadcast(&Chan->NotFull);
+    mtx_unlock(&Chan->Lock);
+}
+
+/* nobody may be using the channel when it's freed */
+void ThreadChanFree(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    struct Channel *Chan = Param[0]->Val->Pointer;
+
+    if (Chan == NULL)
+        return;
+
+    mtx_destroy(&Chan->Lock);
+    cnd_destroy(&Chan->NotEmpty);
+    cnd_destroy(&Chan->NotFull);
+    free(Chan);
+}
+
+/* handy structure definitions */
+const char ThreadDefs[] = "typedef void *thread_t; typedef void *chan_t;";
+
+/* all thread.h functions */
+struct LibraryFunction ThreadFunctions[] =
+{
+    {ThreadSpawn,           "thread_t thread_spawn(char *,int);"},
+    {ThreadJoin,            "int thread_join(thread_t);"},
+    {ThreadChanNew,         "chan_t chan_new(int);"},
+    {ThreadChanSend,        "void chan_send(chan_t,int);"},
+#ifndef NO_FP
+    {ThreadChanSendDouble,  "void chan_send_double(chan_t,double);"},
+#endif
+    {ThreadChanSendPtr,     "void chan_send_ptr(chan_t,void *);"},
+    {ThreadChanRecv,        "int chan_recv(chan_t,int *);"},
+#ifndef NO_FP
+    {ThreadChanRecvDouble,  "int chan_recv_double(chan_t,double *);"},
+#endif
+    {ThreadChanRecvPtr,     "int chan_recv_ptr(chan_t,void **);"},
+    {ThreadChanClose,       "void chan_close(chan_t);"},
+    {ThreadChanFree,        "void chan_free(chan_t);"},
+    {NULL,                  NULL }
+};
+#endif
@@ -2,6 +2,7 @@
 #include <time.h>
 
 #include "../interpreter.h"
+#include "../table.h"
 
 
 static int CLOCKS_PER_SECValue = CLOCKS_PER_SEC;
@@ -125,7 +126,7 @@ struct LibraryFunction StdTimeFunctions[] =
 void StdTimeSetupFunc(Engine *pc)
 {
     /* make a "struct tm" which is the same size as a native tm structure */
-    TypeCreateOpaqueStruct(pc, NULL, TableStrRegister(pc, "tm"),
+    TypeCreateOpaqueStruct(pc, NULL, TableStrRegister(pc, "tm", 2),
         sizeof(struct tm));
 
     /* define CLK_PER_SEC etc. */
@@ -0,0 +1,33 @@
+/* trace.h - mark spans of the program on the --trace timeline */
+#include "../interpreter.h"
+#include "../table.h"
+#include "../tracer.h"
+
+void TraceMarkerBegin(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    const char *Name = Param[0]->Val->Pointer;
+
+    if (Parser->pc->Trace == NULL)
+        return;
+
+    if (Name == NULL)
+        ProgramFail(Parser, "trace_begin() needs a name");
+
+    TraceMarker(Parser->pc, TableStrRegister(Parser->pc, Name, strlen(Name)));
+}
+
+void TraceMarkerEnd(struct ParseState *Parser, struct Value *ReturnValue,
+    struct Value **Param, int NumArgs)
+{
+    if (Parser->pc->Trace != NULL)
+        TraceMarker(Parser->pc, NULL);
+}
+
+/* all trace.h functions */
+struct LibraryFunction TraceFunctions[] =
+{
+    {TraceMarkerBegin,  "void trace_begin(char *);"},
+    {TraceMarkerEnd,    "void trace_end();"},
+    {NULL,              NULL }
+};
@@ -7,6 +7,7 @@
 #define PATH_MAX _MAX_PATH
 #endif
 #include "../interpreter.h"
+#include "../table.h"
 
 
 static int ZeroValue = 0;
@@ -594,7 +595,7 @@ extern int optind, opterr, optopt;
 void UnistdSetupFunc(Engine *pc)
 {
     /* define NULL */
-    if (!VariableDefined(pc, TableStrRegister(pc, "NULL")))
+    if (!VariableDefined(pc, TableStrRegister(pc, "NULL", 4)))
         VariableDefinePlatformVar(pc, NULL, "NULL", &pc->IntType,
             (union AnyValue*)&ZeroValue, false);
 
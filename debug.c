@@ -105,7 +105,7 @@ void DebugCheckStatement(struct ParseState *Parser)
     Engine *pc = Parser->pc;
 
     /* has the user manually pressed break? */
-    if (pc->DebugManualBreak) {
+    if (pc->DebugManualBreak || PlatformBreakRequested()) {
         PlatformPrintf(pc->CStdOut, "break\n");
         DoBreak = true;
         pc->DebugManualBreak = false;
@@ -138,7 +138,7 @@ void ShowX(const char* function,const char* table,const char* word,size_t length
 	{	return;
 	}
 	if(length)
-	{	const char* semi = strchr(word,';');
+	{	const char* semi = memchr(word,';',length);
         if(semi)
         {   length = semi-word+1;
         }
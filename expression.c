@@ -54,8 +54,6 @@ struct OpPrecedence OperatorPrecedence[] = {
     /* TokenRightSquareBracket, */ {0, 15, 0, "]"},
     /* TokenDot, */ {0, 0, 15, "."},
     /* TokenArrow, */ {0, 0, 15, "->"},
-    /* TokenDotDot, */ {14, 0, 0, ".."},      /* Prefix operator for global scope */
-    /* TokenScopeRes, */ {14, 0, 0, "::"},       /* Prefix operator for global scope */
     /* TokenOpenParen, */ {15, 0, 0, "("},
     /* TokenCloseParen, */ {0, 15, 0, ")"}
 };
@@ -222,7 +220,7 @@ static int HandlePrefixOperator(ParseState *Parser, ExpressionStack **StackTop,
                 TokenCast, Precedence);
         } else {
             /* boost the bracket operator precedence */
-            return 1; /* Caller should increment BracketPrecedence */
+            return 0; /* Caller increments BracketPrecedence */
         }
     } else if (Token == TokenDotDot || Token == TokenScoper) {
         /* Handle .. and :: operators (scope resolution) */
@@ -230,11 +228,8 @@ static int HandlePrefixOperator(ParseState *Parser, ExpressionStack **StackTop,
     } else if (Token == TokenDot) {
         /* Check if this is .member (dot-this operator) */
         /* Peek ahead to see if next token is an identifier */
-        ParseState PeekParser;
         Value *PeekIdent;
-        
-        ParserCopy(&PeekParser, Parser);
-        enum LexToken NextToken = LexGetToken(&PeekParser, &PeekIdent, false);
+        enum LexToken NextToken = LexGetToken(Parser, NULL, false);
         
         if (NextToken == TokenIdentifier) {
             /* It's .member - consume the identifier */
@@ -309,13 +304,9 @@ static int HandleInfixOrPostfixOperator(ParseState *Parser, ExpressionStack **St
         
         /* Special handling for dot and arrow operators */
         if ((Token == TokenDot || Token == TokenArrow) && Parser->Mode == RunModeRun) {
-            ParseState PeekState;
-            Value *MemberIdent;
-            ParserCopy(&PeekState, Parser);
-            
             /* Check if this is a member function call: obj.method() or ptr->method() */
-            if (LexGetToken(&PeekState, &MemberIdent, true) == TokenIdentifier &&
-                LexGetToken(&PeekState, NULL, false) == TokenOpenParen) {
+            if (LexPeekToken(Parser, 0, NULL) == TokenIdentifier &&
+                LexPeekToken(Parser, 1, NULL) == TokenOpenParen) {
                 /* It's a member function call */
                 const char* get_from_stack = NULL;
                 char *FuncName = GetMangleName(Parser, StackTop, get_from_stack);
@@ -393,7 +384,7 @@ static int HandleInfixOrPostfixOperator(ParseState *Parser, ExpressionStack **St
 /* In expression.c, in HandleValueOrType function: */
 static int HandleValueOrType(ParseState *Parser, ExpressionStack **StackTop,
                              enum LexToken Token, Value *LexValue,
-                             int *PrefixState, ParseState *PreState)
+                             int *PrefixState, ParseCheckpoint *PreState)
 {
     if (Token == TokenIdentifier) {
         /* ParseTokenIdentifier needs Precedence and IgnorePrecedence parameters */
@@ -423,7 +414,7 @@ static int HandleValueOrType(ParseState *Parser, ExpressionStack **StackTop,
             ProgramFail(Parser, "type not expected here");
 
         *PrefixState = 0;
-        ParserCopy(Parser, PreState);
+        ParserRewind(Parser, PreState);
         TypeParse(Parser, &Typ, &Identifier, NULL);
         TypeValue = VariableAllocValueFromType(Parser->pc, Parser,
             &Parser->pc->TypeType, false, NULL, false);
@@ -432,7 +423,7 @@ static int HandleValueOrType(ParseState *Parser, ExpressionStack **StackTop,
         return 1;
     } else {
         /* it isn't a token from an expression */
-        ParserCopy(Parser, PreState);
+        ParserRewind(Parser, PreState);
         return 0; /* Signal that we're done */
     }
 }
@@ -455,10 +446,10 @@ int ExpressionParse(ParseState *Parser, Value **Result)
 #endif
 
     do {
-        ParseState PreState;
+        ParseCheckpoint PreState;
         enum LexToken Token;
 
-        ParserCopy(&PreState, Parser);
+        ParserCheckpoint(Parser, &PreState);
         Token = LexGetToken(Parser, &LexValue, 1);
         
         /* Check if it's an operator */
@@ -485,7 +476,7 @@ int ExpressionParse(ParseState *Parser, Value **Result)
                 
                 if (!Continue) {
                     /* Operator indicated we're done (e.g., closing bracket at top level) */
-                    ParserCopy(Parser, &PreState);
+                    ParserRewind(Parser, &PreState);
                     Done = 1;
                 } else {
                     BracketPrecedence = NewBracketPrecedence;
@@ -90,7 +90,7 @@ void ExpressionParseFunctionCall(ParseState *Parser,
     ExpressionStack **StackTop, const char *FuncName, int RunIt);
 void ExpressionParseMacroCall(ParseState *Parser,
     ExpressionStack **StackTop, const char *MacroName,
-    struct MacroDef *MDef);
+    struct MacroDef *MDef, int HasArgs, int RunIt);
 
 /* Utility functions */
 int IsTypeToken(ParseState *Parser, enum LexToken t, Value *LexValue);
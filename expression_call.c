@@ -7,84 +7,42 @@
 #include "parse.h"
 #include "heap.h"
 #include "expression_stack.h"
+#include "parse_macro.h"
+#include "profile.h"
+#include "tracer.h"
+#include "probes.h"
 
-/* do a parameterized macro call */
+/* use a macro. the body is expanded by token substitution and then parsed as
+    if it were in brackets, so the result keeps its own type */
 void ExpressionParseMacroCall(ParseState *Parser,
     ExpressionStack **StackTop, const char *MacroName,
-    struct MacroDef *MDef)
+    struct MacroDef *MDef, int HasArgs, int RunIt)
 {
-    int ArgCount;
-    enum LexToken Token;
-    Value *ReturnValue = NULL;
-    Value *Param = 0;
-    Value **ParamArray = NULL;
-
-    if (Parser->Mode == RunModeRun) {
-        /* create a stack frame for this macro */
-        ExpressionStackPushValueByType(Parser, StackTop, &Parser->pc->FPType);
-        ReturnValue = (*StackTop)->Val;
-        HeapPushStackFrame(Parser->pc);
-        ParamArray = HeapAllocStack(Parser->pc,
-            sizeof(Value*) * MDef->NumParams);
-        if (ParamArray == NULL)
-            ProgramFail(Parser, "(ExpressionParseMacroCall) out of memory");
-    } else {
-        ExpressionPushInt(Parser, StackTop, 0);
-    }
-
-    /* parse arguments */
-    ArgCount = 0;
-    do {
-        if (ExpressionParse(Parser, &Param)) {
-            if (Parser->Mode == RunModeRun) {
-                if (ArgCount < MDef->NumParams)
-                    ParamArray[ArgCount] = Param;
-                else
-                    ProgramFail(Parser, "too many arguments to %s()", MacroName);
-            }
+    struct MacroExpansion *Expansion = ParseMacroExpand(Parser, MacroName,
+        MDef, HasArgs);
 
-            ArgCount++;
-            Token = LexGetToken(Parser, NULL, true);
-            if (Token != TokenComma && Token != TokenCloseParen)
-                ProgramFail(Parser, "comma expected");
-        } else {
-            /* end of argument list? */
-            Token = LexGetToken(Parser, NULL, true);
-            if (Token != TokenCloseParen)
-                ProgramFail(Parser, "bad argument");
-        }
-    } while (Token != TokenCloseParen);
-
-    if (Parser->Mode == RunModeRun) {
-        /* evaluate the macro */
+    if (RunIt) {
         ParseState MacroParser;
-        int Count;
         Value *EvalValue;
 
-        if (ArgCount < MDef->NumParams)
-            ProgramFail(Parser, "not enough arguments to '%s'", MacroName);
+#ifndef NO_STATS
+        Parser->pc->Stats.MacroExpansions++;
+#endif
+        ParserCopy(&MacroParser, Parser);
+        MacroParser.Pos = Expansion->Tokens;
+        if (!ExpressionParse(&MacroParser, &EvalValue))
+            ProgramFail(Parser, "'%s' doesn't expand to a value", MacroName);
 
-        if (MDef->Body.Pos == NULL)
-            ProgramFail(Parser,
-                "ExpressionParseMacroCall MacroName: '%s' is undefined",
+        if (LexGetToken(&MacroParser, NULL, false) != TokenEndOfFunction)
+            ProgramFail(&MacroParser, "'%s' doesn't expand to a single expression",
                 MacroName);
 
-        ParserCopy(&MacroParser, &MDef->Body);
-        MacroParser.Mode = Parser->Mode;
-        VariableStackFrameAdd(Parser, MacroName, 0);
-        Parser->pc->TopStackFrame->NumParams = ArgCount;
-        Parser->pc->TopStackFrame->ReturnValue = ReturnValue;
-        
-        for (Count = 0; Count < MDef->NumParams; Count++) {
-            VariableDefine(Parser->pc, Parser, MDef->ParamName[Count],
-                ParamArray[Count], NULL, true);
-        }
+        /* the result is already on top of the stack, just take it over */
+        ExpressionStackPushValueNode(Parser, StackTop, EvalValue);
+    } else
+        ExpressionPushInt(Parser, StackTop, 0);
 
-        ExpressionParse(&MacroParser, &EvalValue);
-        ExpressionAssign(Parser, ReturnValue, EvalValue, true, MacroName, 0, false);
-        VariableStackFramePop(Parser);
-        HeapPopStackFrame(Parser->pc);
-    }
+    Parser->Pos = Expansion->Resume;
 }
 
 #if 0
@@ -222,9 +180,7 @@ void ExpressionParseFunctionCall(ParseState *Parser,
                     FuncName);
                     
             ParserCopy(&FuncParser, &FuncValue->Val->FuncDef.Body);
-            VariableStackFrameAdd(Parser, FuncName,
-                FuncValue->Val->FuncDef.Intrinsic ? FuncValue->Val->FuncDef.NumParams : 0);
-            Parser->pc->TopStackFrame->NumParams = ArgCount;
+            VariableStackFrameAdd(Parser, FuncName);
             Parser->pc->TopStackFrame->ReturnValue = ReturnValue;
             
             if (Parser->pc->StructType) {
@@ -270,8 +226,8 @@ void ExpressionParseFunctionCall(ParseState *Parser,
 #else
 
 static void PrepareFunctionExecution(ParseState *Parser,
-    ExpressionStack **StackTop, const char *FuncName,
-    Value **FuncValue, Value **ReturnValue, Value ***ParamArray);
+    ExpressionStack **StackTop, Value *FuncValue, Value **ReturnValue,
+    Value ***ParamArray);
 static void ParseAndExecuteFunction(ParseState *Parser,
     ExpressionStack **StackTop, const char *FuncName, int RunIt,
     enum LexToken InitialToken, Value *FuncValue,
@@ -280,6 +236,24 @@ static void ExecuteUserDefinedFunction(ParseState *Parser,
     const char *FuncName, Value *FuncValue, Value **ParamArray,
     int ArgCount, Value *ReturnValue);
 
+/* step over the arguments of a call which isn't being run, up to and
+    including the close bracket. function or macro, nothing needs looking up */
+static void ExpressionSkipCallArgs(ParseState *Parser)
+{
+    int Depth = 0;
+    enum LexToken Token;
+
+    while ((Token = LexGetToken(Parser, NULL, true)) != TokenCloseParen ||
+            Depth > 0) {
+        if (Token == TokenOpenParen)
+            Depth++;
+        else if (Token == TokenCloseParen)
+            Depth--;
+        else if (Token == TokenEOF || Token == TokenEndOfFunction)
+            ProgramFail(Parser, "close bracket expected");
+    }
+}
+
 /* do a function call */
 void ExpressionParseFunctionCall(ParseState *Parser,
     ExpressionStack **StackTop, const char *FuncName, int RunIt)
@@ -289,65 +263,53 @@ void ExpressionParseFunctionCall(ParseState *Parser,
     Value **ParamArray = NULL;
     Value *ReturnValue = NULL;
     Value *StructVar = NULL;
-    if (RunIt) {
-        if(IsMemberFunction(FuncName))
-        {   if (*StackTop == NULL || (*StackTop)->Val == NULL)
-                ProgramFail(Parser, "internal error: expected struct on stack for member call");
-            StructVar = (*StackTop)->Val;
-            if (StructVar->Typ->Base != TypeStruct)
-                ProgramFail(Parser, "member functions can only be called on structs");
-#if 0
-        // pop expression stack:
-            if (*StackTop && (*StackTop)->Val == StructVar) {
-                ExpressionStack *node = *StackTop;
-                *StackTop = node->Next;
-                /* Free the stack node */
-                HeapPopStack(Parser->pc, node, 
-                    sizeof(ExpressionStack) + sizeof(Value) + 
-                    TypeStackSizeValue(StructVar));
-            }
-#endif
-        }
-        PrepareFunctionExecution(Parser, StackTop, FuncName, &FuncValue, 
-            &ReturnValue, &ParamArray);
-        if (!FuncValue) return; /* Macro was handled */
-    } else {
+    if (!RunIt) {
+        ExpressionSkipCallArgs(Parser);
         ExpressionPushInt(Parser, StackTop, 0);
-        Parser->Mode = RunModeSkip;
+        return;
+    }
+
+    if(IsMemberFunction(FuncName))
+    {   if (*StackTop == NULL || (*StackTop)->Val == NULL)
+            ProgramFail(Parser, "internal error: expected struct on stack for member call");
+        StructVar = (*StackTop)->Val;
+        if (StructVar->Typ->Base != TypeStruct)
+            ProgramFail(Parser, "member functions can only be called on structs");
     }
-    ParseAndExecuteFunction(Parser, StackTop, FuncName, RunIt, Token,
-        FuncValue, ParamArray, ReturnValue,StructVar);
-    Parser->Mode = OldMode;
-}
 
-static void PrepareFunctionExecution(ParseState *Parser,
-    ExpressionStack **StackTop, const char *FuncName,
-    Value **FuncValue, Value **ReturnValue, Value ***ParamArray)
-{   Value *FuncValueLocal = NULL;
     /* Lookup function in global table */
     ShowX(">TableGet", "GlobalTable", FuncName, 0);
-    if (!TableGet(&Parser->pc->GlobalTable, FuncName, &FuncValueLocal, NULL, NULL, NULL))
+    if (!TableGet(&Parser->pc->GlobalTable, FuncName, &FuncValue, NULL, NULL, NULL))
         ProgramFail(Parser, "identifier '%s' is undefined", FuncName);
-    if (FuncValueLocal->Typ->Base == TypeMacro) {
+    if (StructVar == NULL && FuncValue->Typ->Base == TypeMacro) {
         /* this is actually a macro, not a function */
         ExpressionParseMacroCall(Parser, StackTop, FuncName,
-            &FuncValueLocal->Val->MacroDef);
-        *FuncValue = NULL;
+            &FuncValue->Val->MacroDef, true, RunIt);
         return;
     }
-    if (FuncValueLocal->Typ->Base != TypeFunction)
+
+    PrepareFunctionExecution(Parser, StackTop, FuncValue, &ReturnValue,
+        &ParamArray);
+    ParseAndExecuteFunction(Parser, StackTop, FuncName, RunIt, Token,
+        FuncValue, ParamArray, ReturnValue,StructVar);
+    Parser->Mode = OldMode;
+}
+
+static void PrepareFunctionExecution(ParseState *Parser,
+    ExpressionStack **StackTop, Value *FuncValue, Value **ReturnValue,
+    Value ***ParamArray)
+{   if (FuncValue->Typ->Base != TypeFunction)
         ProgramFail(Parser, "%t is not a function - can't call",
-            FuncValueLocal->Typ);
+            FuncValue->Typ);
     /* Prepare function execution stack */
     ExpressionStackPushValueByType(Parser, StackTop,
-        FuncValueLocal->Val->FuncDef.ReturnType);
+        FuncValue->Val->FuncDef.ReturnType);
     *ReturnValue = (*StackTop)->Val;
     HeapPushStackFrame(Parser->pc);
     *ParamArray = HeapAllocStack(Parser->pc,
-        sizeof(Value*) * FuncValueLocal->Val->FuncDef.NumParams);
+        sizeof(Value*) * FuncValue->Val->FuncDef.NumParams);
     if (*ParamArray == NULL)
         ProgramFail(Parser, "(ExpressionParseFunctionCall) out of memory");
-    *FuncValue = FuncValueLocal;
 }
 
 static void ParseAndExecuteFunction(ParseState *Parser,
@@ -398,6 +360,14 @@ static void ParseAndExecuteFunction(ParseState *Parser,
         }
         if (ArgCount < FuncValue->Val->FuncDef.NumParams)
             ProgramFail(Parser, "not enough arguments to '%s'", FuncName);
+#ifndef NO_STATS
+        Parser->pc->Stats.FunctionCalls++;
+#endif
+        if (Parser->pc->Profile != NULL)
+            ProfileEnter(Parser->pc, FuncValue, FuncName);
+        if (Parser->pc->Trace != NULL)
+            TraceBegin(Parser->pc, "call", FuncName);
+        PROBE_FUNCTION_ENTRY(FuncName, Parser->FileName, Parser->Line);
         if (FuncValue->Val->FuncDef.Intrinsic == NULL) {
             ExecuteUserDefinedFunction(Parser, FuncName, FuncValue, 
                  ParamArray, ArgCount, ReturnValue);
@@ -405,6 +375,11 @@ static void ParseAndExecuteFunction(ParseState *Parser,
             /* Intrinsic function call */
             FuncValue->Val->FuncDef.Intrinsic(Parser, ReturnValue, ParamArray, ArgCount);
         }
+        PROBE_FUNCTION_RETURN(FuncName, Parser->FileName, Parser->Line);
+        if (Parser->pc->Trace != NULL)
+            TraceEnd(Parser->pc);
+        if (Parser->pc->Profile != NULL)
+            ProfileLeave(Parser->pc);
         HeapPopStackFrame(Parser->pc);
     }
 }
@@ -419,9 +394,7 @@ static void ExecuteUserDefinedFunction(ParseState *Parser,
             "ExpressionParseFunctionCall FuncName: '%s' is undefined",
             FuncName);
     ParserCopy(&FuncParser, &FuncValue->Val->FuncDef.Body);
-    VariableStackFrameAdd(Parser, FuncName,
-        FuncValue->Val->FuncDef.Intrinsic ? FuncValue->Val->FuncDef.NumParams : 0);
-    Parser->pc->TopStackFrame->NumParams = ArgCount;
+    VariableStackFrameAdd(Parser, FuncName);
     Parser->pc->TopStackFrame->ReturnValue = ReturnValue;
     if (Parser->pc->StructType) {
         /* Function parameters should not go out of scope */
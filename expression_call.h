@@ -9,6 +9,6 @@ void ExpressionParseFunctionCall(ParseState *Parser,
     ExpressionStack **StackTop, const char *FuncName, int RunIt);
 void ExpressionParseMacroCall(ParseState *Parser,
     ExpressionStack **StackTop, const char *MacroName,
-    struct MacroDef *MDef);
+    struct MacroDef *MDef, int HasArgs, int RunIt);
 
 #endif /* EXPRESSION_CALL_H */
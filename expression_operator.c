@@ -755,20 +755,15 @@ const char* GetTypeName(ParseState *Parser, ExpressionStack **StackTop,
 // Check for pattern .method(
 const char* GetMethodName(ParseState *Parser)
 {
-    ParseState PeekState;
     Value *MemberIdent = NULL;
     
-    ParserCopy(&PeekState, Parser);
-    enum LexToken token = LexGetToken(&PeekState, NULL, true);
-    if (token != TokenDot)
+    if (LexPeekToken(Parser, 0, NULL) != TokenDot)
         return NULL;
     
-    token = LexGetToken(&PeekState, &MemberIdent, true);
-    if (token != TokenIdentifier)
+    if (LexPeekToken(Parser, 1, &MemberIdent) != TokenIdentifier)
         return NULL;
     
-    token = LexGetToken(&PeekState, NULL, false);
-    if (token != TokenOpenParen)
+    if (LexPeekToken(Parser, 2, NULL) != TokenOpenParen)
         return NULL;
     
     return MemberIdent->Val->Identifier;
@@ -857,7 +852,10 @@ void ParseTokenIdentifier(ParseState *Parser, ExpressionStack **StackTop,
             VariableGet(Parser->pc, Parser, TokenName, &VariableValue);
             
             if (VariableValue->Typ->Base == TypeMacro) {
-                /* ... handle macro ... */
+                /* an object-like macro - substitute its body */
+                ExpressionParseMacroCall(Parser, StackTop, TokenName,
+                    &VariableValue->Val->MacroDef, false,
+                    localPrecedence < localIgnorePrecedence);
             } else if (VariableValue->Typ == &Parser->pc->VoidType)
                 ProgramFail(Parser, "a void value isn't much use here");
             else
@@ -110,7 +110,7 @@ void ExpressionStackPushValueNode(ParseState *Parser,
     ExpressionStack **StackTop, Value *ValueLoc)
 {
     ExpressionStack *StackNode = VariableAlloc(Parser->pc, Parser,
-                                        sizeof(*StackNode), false);
+                                        sizeof(*StackNode), false, MemValues);
     StackNode->Next = *StackTop;
     StackNode->Val = ValueLoc;
     *StackTop = StackNode;
@@ -209,7 +209,7 @@ void ExpressionStackPushOperator(ParseState *Parser,
     enum LexToken Token, int Precedence)
 {
     ExpressionStack *StackNode = VariableAlloc(Parser->pc, Parser,
-        sizeof(*StackNode), false);
+        sizeof(*StackNode), false, MemValues);
     StackNode->Next = *StackTop;
     StackNode->Order = Order;
     StackNode->Op = Token;
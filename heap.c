@@ -3,18 +3,130 @@
 /* stack grows up from the bottom and heap grows down from
     the top of heap space */
 #include "interpreter.h"
+#include "heap.h"
+#include "probes.h"
 
-#ifdef DEBUG_HEAP
-void ShowBigList(Engine *pc)
+#ifdef USE_MMAP_STACK
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#endif
+
+/* every HeapAllocMem() block starts with a header holding its size and
+    category. NextFree is only used once it's freed */
+#define ALLOC_HEADER_SIZE MEM_ALIGN(offsetof(struct AllocNode, NextFree))
+
+/* big blocks have a list link in front of the header */
+#define BIG_HEADER_SIZE MEM_ALIGN(sizeof(struct HeapBigBlock))
+
+/* the biggest allocation which is carved from a slab */
+#define SLAB_ALLOC_MAX (HEAP_SIZE_CLASS * FREELIST_BUCKETS)
+
+/* names of the memory categories, for limits and reports */
+static const char *MemCategoryName[MemCategories] = {
+    "tokens", "strings", "tables", "types", "functions", "macros",
+    "values", "other", "malloc"
+};
+
+#ifdef USE_MMAP_STACK
+/* the engine whose stack guard a SIGSEGV is checked against. a fault is
+    delivered to the thread which caused it, so each thread keeps its own */
+static _Thread_local Engine *HeapGuardEngine = NULL;
+static struct sigaction HeapOldSegvAction;
+static pthread_once_t HeapGuardOnce = PTHREAD_ONCE_INIT;
+
+/* a fault in the guard area means the interpreted program ran out of
+    stack. nothing here is safe to report it with, so jump back to the
+    HeapGuardBegin() it's running under. anything else is a real crash,
+    which goes to the handler from before us. if there wasn't one the
+    default action is put back and the faulting instruction re-run, so
+    the process dies of SIGSEGV as it would have without us */
+static void HeapGuardFault(int Sig, siginfo_t *Info, void *Context)
+{
+    Engine *pc = HeapGuardEngine;
+    unsigned char *Addr = (unsigned char*)Info->si_addr;
+
+    if (pc != NULL && pc->StackGuard != NULL &&
+            Addr >= (unsigned char*)pc->HeapBottom &&
+            Addr < pc->HeapMemory + pc->HeapMemorySize)
+        siglongjmp(pc->StackGuard->Jump, 1);
+
+    if (HeapOldSegvAction.sa_flags & SA_SIGINFO)
+        HeapOldSegvAction.sa_sigaction(Sig, Info, Context);
+    else if (HeapOldSegvAction.sa_handler != SIG_DFL &&
+            HeapOldSegvAction.sa_handler != SIG_IGN)
+        HeapOldSegvAction.sa_handler(Sig);
+    else {
+        signal(Sig, SIG_DFL);
+        if (Info->si_code <= 0)
+            raise(Sig);     /* sent by kill(), so returning won't repeat it */
+    }
+}
+
+/* the handler is shared by every engine in the process */
+static void HeapGuardInstall(void)
+{
+    struct sigaction Action;
+
+    memset(&Action, '\0', sizeof(Action));
+    Action.sa_sigaction = HeapGuardFault;
+    Action.sa_flags = SA_SIGINFO | SA_NODEFER;
+    sigemptyset(&Action.sa_mask);
+    sigaction(SIGSEGV, &Action, &HeapOldSegvAction);
+}
+
+/* reserve the stack as address space only. pages are committed by the
+    kernel as the stack first touches them, so the reservation can be
+    large without costing anything. a guard area above it faults instead
+    of the stack overrunning. if the address space isn't there (ulimit -v,
+    strict overcommit, a 32 bit host) smaller stacks are tried */
+static void HeapInitStack(Engine *pc, int StackSize)
 {
-    struct AllocNode *LPos;
+    size_t PageSize = (size_t)sysconf(_SC_PAGESIZE);
+    size_t Reserve = ((size_t)StackSize + PageSize - 1) & ~(PageSize - 1);
+
+    while (true) {
+        pc->HeapMemorySize = Reserve + HEAP_GUARD_SIZE;
+        pc->HeapMemory = mmap(NULL, pc->HeapMemorySize, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (pc->HeapMemory != MAP_FAILED)
+            break;
+
+        if (Reserve <= HEAP_STACK_MIN) {
+            pc->HeapMemory = NULL;
+            pc->HeapMemorySize = 0;
+            return;
+        }
 
-    printf("Heap: bottom=0x%lx 0x%lx-0x%lx, big freelist=", (long)pc->HeapBottom,
-        (long)&(pc->HeapMemory)[0], (long)&(pc->HeapMemory)[HEAP_SIZE]);
-    for (LPos = pc->FreeListBig; LPos != NULL; LPos = LPos->NextFree)
-        printf("0x%lx:%d ", (long)LPos, LPos->Size);
+        Reserve = ((Reserve / 2) + PageSize - 1) & ~(PageSize - 1);
+    }
 
-    printf("\n");
+    mprotect(pc->HeapMemory + Reserve, HEAP_GUARD_SIZE, PROT_NONE);
+    pthread_once(&HeapGuardOnce, HeapGuardInstall);
+}
+
+/* the engine's running on this thread now, under Guard */
+void HeapGuardEnter(Engine *pc, struct StackGuard *Guard)
+{
+    Guard->Previous = pc->StackGuard;
+    Guard->PreviousEngine = HeapGuardEngine;
+    pc->StackGuard = Guard;
+    HeapGuardEngine = pc;
+}
+
+/* leave the HeapGuardBegin() which set Guard up */
+void HeapGuardEnd(Engine *pc, struct StackGuard *Guard)
+{
+    pc->StackGuard = Guard->Previous;
+    HeapGuardEngine = Guard->PreviousEngine;
+}
+#else
+void HeapGuardEnter(Engine *pc, struct StackGuard *Guard)
+{
+}
+
+void HeapGuardEnd(Engine *pc, struct StackGuard *Guard)
+{
 }
 #endif
 
@@ -24,7 +136,34 @@ void HeapInit(Engine *pc, int StackOrHeapSize)
     int Count;
     int AlignOffset = 0;
 
-    pc->HeapMemory = malloc(StackOrHeapSize);
+#ifdef USE_MMAP_STACK
+    HeapInitStack(pc, StackOrHeapSize);
+    if (pc->HeapMemory != NULL)
+        StackOrHeapSize = (int)(pc->HeapMemorySize - HEAP_GUARD_SIZE);
+    else
+#endif
+    {
+        /* a malloc()ed stack costs all of its size, so halve it until
+            there's room */
+        pc->HeapMemorySize = 0;
+        while ((pc->HeapMemory = malloc(StackOrHeapSize)) == NULL &&
+                StackOrHeapSize > HEAP_STACK_MIN)
+            StackOrHeapSize = StackOrHeapSize / 2 > HEAP_STACK_MIN ?
+                StackOrHeapSize / 2 : HEAP_STACK_MIN;
+    }
+
+    if (pc->HeapMemory == NULL) {
+        /* there's no exit point to fail to yet, and nothing can run */
+        fprintf(stderr, "can't allocate a stack of even %d bytes\n",
+            HEAP_STACK_MIN);
+        exit(1);
+    }
+
+    if (StackOrHeapSize < pc->StackSize) {
+        fprintf(stderr, "stack is %d bytes, as %d couldn't be had\n",
+            StackOrHeapSize, pc->StackSize);
+        pc->StackSize = StackOrHeapSize;
+    }
     pc->HeapBottom = NULL;  /* the bottom of the (downward-growing) heap */
     pc->StackFrame = NULL;  /* the current stack frame */
     pc->HeapStackTop = NULL;  /* the top of the stack */
@@ -37,18 +176,53 @@ void HeapInit(Engine *pc, int StackOrHeapSize)
     *(void**)(pc->StackFrame) = NULL;
     pc->HeapBottom =
         &(pc->HeapMemory)[StackOrHeapSize-sizeof(ALIGN_TYPE)+AlignOffset];
-    pc->FreeListBig = NULL;
     for (Count = 0; Count < FREELIST_BUCKETS; Count++)
         pc->FreeListBucket[Count] = NULL;
+
+    pc->SlabList = NULL;
+    pc->SlabPos = NULL;
+    pc->SlabEnd = NULL;
+    pc->BigList = NULL;
+    memset(&pc->HeapStats, '\0', sizeof(pc->HeapStats));
+    memset(&pc->MemStats, '\0', sizeof(pc->MemStats));
 }
 
 void HeapCleanup(Engine *pc)
 {
+#ifdef DEBUG_HEAP
+    HeapPrintStats(pc, pc->CStdOut);
+#endif
+    /* release everything still allocated in one sweep of the slabs and
+        big blocks - nothing needs to be freed individually first */
+    while (pc->BigList != NULL) {
+        struct HeapBigBlock *Next = pc->BigList->Next;
+
+        free(pc->BigList);
+        pc->BigList = Next;
+    }
+
+    while (pc->SlabList != NULL) {
+        struct HeapSlab *Next = pc->SlabList->Next;
+
+        free(pc->SlabList);
+        pc->SlabList = Next;
+    }
+
+#ifdef USE_MMAP_STACK
+    if (pc->HeapMemorySize != 0) {
+        if (HeapGuardEngine == pc)
+            HeapGuardEngine = NULL;
+        munmap(pc->HeapMemory, pc->HeapMemorySize);
+        return;
+    }
+#endif
     free(pc->HeapMemory);
 }
 
 /* allocate some space on the stack, in the current stack frame
- * clears memory. can return NULL if out of stack space */
+ * clears memory. can return NULL if out of stack space. on a mmap()ed
+ * stack only allocations big enough to step over the guard are checked -
+ * the rest fault in the guard when they're cleared */
 void *HeapAllocStack(Engine *pc, int Size)
 {
     char *NewMem = pc->HeapStackTop;
@@ -57,10 +231,21 @@ void *HeapAllocStack(Engine *pc, int Size)
     printf("HeapAllocStack(%ld) at 0x%lx\n", (unsigned long)MEM_ALIGN(Size),
         (unsigned long)pc->HeapStackTop);
 #endif
+#ifdef USE_MMAP_STACK
+    if ((pc->HeapMemorySize == 0 || Size >= HEAP_GUARD_SIZE) &&
+            NewTop > (char*)pc->HeapBottom)
+        return NULL;
+#else
     if (NewTop > (char*)pc->HeapBottom)
         return NULL;
+#endif
 
     pc->HeapStackTop = (void*)NewTop;
+    pc->HeapStats.StackAllocs++;
+    pc->HeapStats.StackBytes += MEM_ALIGN(Size);
+    if ((unsigned long)(NewTop - (char*)pc->HeapMemory) >
+            pc->HeapStats.PeakStackBytes)
+        pc->HeapStats.PeakStackBytes = NewTop - (char*)pc->HeapMemory;
     memset((void*)NewMem, '\0', Size);
     return NewMem;
 }
@@ -120,16 +305,273 @@ int HeapPopStackFrame(Engine *pc)
         return false;
 }
 
+/* get a new block of a small size class, either from its freelist or
+    carved from the current slab. can return NULL if out of memory */
+static struct AllocNode *HeapAllocSlabBlock(Engine *pc, int Bucket)
+{
+    int BlockSize = ALLOC_HEADER_SIZE + (Bucket+1) * HEAP_SIZE_CLASS;
+    struct AllocNode *NewMem = pc->FreeListBucket[Bucket];
+
+    if (NewMem != NULL) {
+        /* reuse a freed block */
+        pc->FreeListBucket[Bucket] = NewMem->NextFree;
+        return NewMem;
+    }
+
+    if (pc->SlabPos == NULL || pc->SlabPos + BlockSize > pc->SlabEnd) {
+        /* start a new slab. the end of the old one is wasted, but it's
+            less than one block */
+        struct HeapSlab *NewSlab = malloc(HEAP_SLAB_SIZE);
+        if (NewSlab == NULL)
+            return NULL;
+
+        NewSlab->Next = pc->SlabList;
+        pc->SlabList = NewSlab;
+        pc->SlabPos = (unsigned char*)NewSlab + MEM_ALIGN(sizeof(struct HeapSlab));
+        pc->SlabEnd = (unsigned char*)NewSlab + HEAP_SLAB_SIZE;
+        pc->HeapStats.SlabBytes += HEAP_SLAB_SIZE;
+    }
+
+    NewMem = (struct AllocNode*)pc->SlabPos;
+    pc->SlabPos += BlockSize;
+    return NewMem;
+}
+
+/* can Bytes more be used for a category without going over its limit,
+    or the engine's */
+int HeapMemAvailable(Engine *pc, enum MemCategory Category, unsigned long Bytes)
+{
+    struct MemStats *Mem = &pc->MemStats;
+
+    if (Mem->Limit[Category] != 0 && Mem->InUse[Category] + Bytes > Mem->Limit[Category])
+        return false;
+
+    return Mem->TotalLimit == 0 || Mem->TotalInUse + Bytes <= Mem->TotalLimit;
+}
+
+/* count Bytes more in use for a category, or fewer if it's negative */
+void HeapAccount(Engine *pc, enum MemCategory Category, long Bytes)
+{
+    struct MemStats *Mem = &pc->MemStats;
+
+    /* the program can free() memory it didn't malloc() */
+    if (Bytes < 0 && (unsigned long)-Bytes > Mem->InUse[Category])
+        Bytes = -(long)Mem->InUse[Category];
+
+    Mem->InUse[Category] += Bytes;
+    Mem->TotalInUse += Bytes;
+    if (Mem->InUse[Category] > Mem->Peak[Category])
+        Mem->Peak[Category] = Mem->InUse[Category];
+    if (Mem->TotalInUse > Mem->TotalPeak)
+        Mem->TotalPeak = Mem->TotalInUse;
+}
+
+/* allocate some dynamically allocated memory without clearing it, for
+    callers which are going to overwrite all of it anyway, and count it
+    against a category. small sizes come from per-engine slabs, bigger
+    ones straight from malloc(). can return NULL if out of memory or over
+    the category's limit */
+void *HeapAllocMemIn(Engine *pc, int Size, enum MemCategory Category)
+{
+    struct AllocNode *NewMem;
+    unsigned int BlockSize;
+    int Bucket;
+
+    if (Size <= SLAB_ALLOC_MAX) {
+        Bucket = Size > 0 ? (Size - 1) / HEAP_SIZE_CLASS : 0;
+        BlockSize = (Bucket+1) * HEAP_SIZE_CLASS;
+    } else {
+        Bucket = FREELIST_BUCKETS;
+        BlockSize = Size;
+    }
+
+    if (!HeapMemAvailable(pc, Category, ALLOC_HEADER_SIZE + BlockSize))
+        return NULL;
+
+    if (Bucket < FREELIST_BUCKETS)
+        NewMem = HeapAllocSlabBlock(pc, Bucket);
+    else {
+        struct HeapBigBlock *Big = malloc(BIG_HEADER_SIZE + ALLOC_HEADER_SIZE + Size);
+
+        NewMem = NULL;
+        if (Big != NULL) {
+            Big->Prev = NULL;
+            Big->Next = pc->BigList;
+            if (pc->BigList != NULL)
+                pc->BigList->Prev = Big;
+            pc->BigList = Big;
+            NewMem = (struct AllocNode*)((char*)Big + BIG_HEADER_SIZE);
+        }
+    }
+
+    if (NewMem == NULL)
+        return NULL;
+
+    NewMem->Size = BlockSize;
+    NewMem->Category = Category;
+    HeapAccount(pc, Category, ALLOC_HEADER_SIZE + BlockSize);
+    pc->HeapStats.Allocs[Bucket]++;
+    pc->HeapStats.AllocBytes += Size;
+    pc->HeapStats.BytesInUse += ALLOC_HEADER_SIZE + BlockSize;
+    if (pc->HeapStats.BytesInUse > pc->HeapStats.PeakBytesInUse)
+        pc->HeapStats.PeakBytesInUse = pc->HeapStats.BytesInUse;
+
+#ifdef DEBUG_HEAP
+    printf("HeapAllocMem(%d) = 0x%lx\n", Size,
+        (unsigned long)((char*)NewMem + ALLOC_HEADER_SIZE));
+#endif
+    PROBE_ALLOC((char*)NewMem + ALLOC_HEADER_SIZE, Size);
+    return (char*)NewMem + ALLOC_HEADER_SIZE;
+}
+
+/* allocate some dynamically allocated memory without clearing it.
+    can return NULL if out of memory */
+void *HeapAllocMemNoClear(Engine *pc, int Size)
+{
+    return HeapAllocMemIn(pc, Size, MemOther);
+}
+
 /* allocate some dynamically allocated memory. memory is cleared.
     can return NULL if out of memory */
 void *HeapAllocMem(Engine *pc, int Size)
 {
-    return calloc(Size, 1);
+    void *NewMem = HeapAllocMemNoClear(pc, Size);
+
+    if (NewMem != NULL)
+        memset(NewMem, '\0', Size);
+
+    return NewMem;
 }
 
 /* free some dynamically allocated memory */
 void HeapFreeMem(Engine *pc, void *Mem)
 {
-    free(Mem);
+    struct AllocNode *FreeNode;
+    int Bucket;
+
+    if (Mem == NULL)
+        return;
+
+    FreeNode = (struct AllocNode*)((char*)Mem - ALLOC_HEADER_SIZE);
+#ifdef DEBUG_HEAP
+    printf("HeapFreeMem(0x%lx) size %d\n", (unsigned long)Mem, FreeNode->Size);
+#endif
+    PROBE_FREE(Mem, FreeNode->Size);
+    HeapAccount(pc, FreeNode->Category, -(long)(ALLOC_HEADER_SIZE + FreeNode->Size));
+    pc->HeapStats.BytesInUse -= ALLOC_HEADER_SIZE + FreeNode->Size;
+    if (FreeNode->Size > SLAB_ALLOC_MAX) {
+        struct HeapBigBlock *Big = (struct HeapBigBlock*)((char*)FreeNode -
+            BIG_HEADER_SIZE);
+
+        if (Big->Prev != NULL)
+            Big->Prev->Next = Big->Next;
+        else
+            pc->BigList = Big->Next;
+        if (Big->Next != NULL)
+            Big->Next->Prev = Big->Prev;
+
+        pc->HeapStats.Frees[FREELIST_BUCKETS]++;
+        free(Big);
+        return;
+    }
+
+    /* put it on the freelist for its size class */
+    Bucket = FreeNode->Size / HEAP_SIZE_CLASS - 1;
+    pc->HeapStats.Frees[Bucket]++;
+    FreeNode->NextFree = pc->FreeListBucket[Bucket];
+    pc->FreeListBucket[Bucket] = FreeNode;
 }
 
+/* show how HeapAllocMem() has been used */
+void HeapPrintStats(Engine *pc, IOFILE *Stream)
+{
+    int Count;
+    struct HeapStats *Stats = &pc->HeapStats;
+
+    PlatformPrintf(Stream, "heap: %d bytes in use, %d peak, %d in slabs\n",
+        (int)Stats->BytesInUse, (int)Stats->PeakBytesInUse,
+        (int)Stats->SlabBytes);
+    for (Count = 0; Count <= FREELIST_BUCKETS; Count++) {
+        if (Stats->Allocs[Count] == 0)
+            continue;
+
+        if (Count < FREELIST_BUCKETS)
+            PlatformPrintf(Stream, "heap: %d byte blocks: %d allocs, %d frees\n",
+                (Count+1) * HEAP_SIZE_CLASS, (int)Stats->Allocs[Count],
+                (int)Stats->Frees[Count]);
+        else
+            PlatformPrintf(Stream, "heap: large blocks: %d allocs, %d frees\n",
+                (int)Stats->Allocs[Count], (int)Stats->Frees[Count]);
+    }
+}
+
+/* the category called Name, MemCategories for "total" or NULL, or -1 if
+    there isn't one */
+int HeapCategoryByName(const char *Name)
+{
+    int Count;
+
+    if (Name == NULL || strcmp(Name, "total") == 0)
+        return MemCategories;
+
+    for (Count = 0; Count < MemCategories; Count++) {
+        if (strcmp(Name, MemCategoryName[Count]) == 0)
+            return Count;
+    }
+
+    return -1;
+}
+
+/* limit how much memory a category, or with a Category of NULL or "total"
+    the whole engine, can use. 0 takes the limit away. an allocation which
+    would go over it fails as if the memory had run out. returns false if
+    there's no such category */
+int EngineSetMemoryLimit(Engine *pc, const char *Category, unsigned long Bytes)
+{
+    int Found = HeapCategoryByName(Category);
+
+    if (Found < 0)
+        return false;
+
+    if (Found == MemCategories)
+        pc->MemStats.TotalLimit = Bytes;
+    else
+        pc->MemStats.Limit[Found] = Bytes;
+
+    return true;
+}
+
+/* give an engine the same memory limits as another */
+void HeapCopyLimits(Engine *pc, Engine *From)
+{
+    memcpy(pc->MemStats.Limit, From->MemStats.Limit,
+        sizeof(pc->MemStats.Limit));
+    pc->MemStats.TotalLimit = From->MemStats.TotalLimit;
+}
+
+/* show what memory is being used for, and the most each thing has used */
+void EnginePrintMemory(Engine *pc, IOFILE *Stream)
+{
+    struct MemStats *Mem = &pc->MemStats;
+    int Count;
+
+    fflush(pc->StdoutValue);
+    fprintf(Stream, "memory: %-10s %12s %12s %12s\n", "", "in use", "peak", "limit");
+    for (Count = 0; Count < MemCategories; Count++) {
+        fprintf(Stream, "memory: %-10s %12lu %12lu", MemCategoryName[Count],
+            Mem->InUse[Count], Mem->Peak[Count]);
+        if (Mem->Limit[Count] != 0)
+            fprintf(Stream, " %12lu", Mem->Limit[Count]);
+        fprintf(Stream, "\n");
+    }
+
+    fprintf(Stream, "memory: %-10s %12lu %12lu", "total", Mem->TotalInUse,
+        Mem->TotalPeak);
+    if (Mem->TotalLimit != 0)
+        fprintf(Stream, " %12lu", Mem->TotalLimit);
+    fprintf(Stream, "\n");
+    fprintf(Stream, "memory: %-10s %12lu %12lu %12d\n", "stack",
+        (unsigned long)((char*)pc->HeapStackTop - (char*)pc->HeapMemory),
+        pc->HeapStats.PeakStackBytes, pc->StackSize);
+    fflush(Stream);
+}
@@ -1,8 +1,5 @@
 
 /* heap.h */
-#ifdef DEBUG_HEAP
-void ShowBigList(Engine *pc);
-#endif
 void HeapInit(Engine *pc, int StackSize);
 void HeapCleanup(Engine *pc);
 void *HeapAllocStack(Engine *pc, int Size);
@@ -11,4 +8,28 @@ void HeapUnpopStack(Engine *pc, int Size);
 void HeapPushStackFrame(Engine *pc);
 int HeapPopStackFrame(Engine *pc);
 void *HeapAllocMem(Engine *pc, int Size);
+void *HeapAllocMemNoClear(Engine *pc, int Size);
+void *HeapAllocMemIn(Engine *pc, int Size, enum MemCategory Category);
+int HeapMemAvailable(Engine *pc, enum MemCategory Category, unsigned long Bytes);
+void HeapAccount(Engine *pc, enum MemCategory Category, long Bytes);
+void HeapCopyLimits(Engine *pc, Engine *From);
+int HeapCategoryByName(const char *Name);
 void HeapFreeMem(Engine *pc, void *Mem);
+void HeapPrintStats(Engine *pc, IOFILE *Stream);
+void HeapGuardEnter(Engine *pc, struct StackGuard *Guard);
+void HeapGuardEnd(Engine *pc, struct StackGuard *Guard);
+
+/* run the code after this with the stack guard reported as "out of stack
+    space". the SIGSEGV handler jumps back here and the error is raised
+    outside it. Guard has to stay in scope until HeapGuardEnd() */
+#ifdef USE_MMAP_STACK
+#define HeapGuardBegin(pc, Guard) do { \
+        if (sigsetjmp((Guard)->Jump, 0)) { \
+            HeapGuardEnd(pc, Guard); \
+            ProgramFailNoParser(pc, "out of stack space"); \
+        } \
+        HeapGuardEnter(pc, Guard); \
+    } while (0)
+#else
+#define HeapGuardBegin(pc, Guard) do { } while (0)
+#endif
@@ -5,6 +5,8 @@
 #include "include.h"
 #include "table.h"
 #include "heap.h"
+#include "tracer.h"
+#include "profile.h"
 
 /* initialize the built-in include libraries */
 void IncludeInit(Engine *pc)
@@ -13,12 +15,20 @@ void IncludeInit(Engine *pc)
     IncludeRegister(pc, "errno.h", &StdErrnoSetupFunc, NULL, NULL);
 # ifndef NO_FP
     IncludeRegister(pc, "math.h", &MathSetupFunc, &MathFunctions[0], NULL);
+# endif
+    IncludeRegister(pc, "meminfo.h", NULL, &MemInfoFunctions[0], NULL);
+# if defined(UNIX_HOST) || defined(WIN32)
+    IncludeRegister(pc, "parallel.h", NULL, &ParallelFunctions[0], NULL);
 # endif
     IncludeRegister(pc, "stdbool.h", &StdboolSetupFunc, NULL, StdboolDefs);
     IncludeRegister(pc, "stdio.h", &StdioSetupFunc, &StdioFunctions[0], StdioDefs);
     IncludeRegister(pc, "stdlib.h", &StdlibSetupFunc, &StdlibFunctions[0], NULL);
     IncludeRegister(pc, "string.h", &StringSetupFunc, &StringFunctions[0], NULL);
+# if defined(UNIX_HOST) || defined(WIN32)
+    IncludeRegister(pc, "thread.h", NULL, &ThreadFunctions[0], ThreadDefs);
+# endif
     IncludeRegister(pc, "time.h", &StdTimeSetupFunc, &StdTimeFunctions[0], StdTimeDefs);
+    IncludeRegister(pc, "trace.h", NULL, &TraceFunctions[0], NULL);
 # ifndef WIN32
     IncludeRegister(pc, "unistd.h", &UnistdSetupFunc, &UnistdFunctions[0], UnistdDefs);
 # endif
@@ -62,10 +72,32 @@ void EngineIncludeAllSystemHeaders(Engine *pc)
         IncludeFile(pc, ThisInclude->IncludeName);
 }
 
+/* is this the name of one of the predefined libraries */
+int IncludeIsLibrary(Engine *pc, const char *FileName)
+{
+    struct IncludeLibrary *LInclude;
+
+    for (LInclude = pc->IncludeLibList; LInclude != NULL;
+            LInclude = LInclude->NextLib) {
+        if (strcmp(LInclude->IncludeName, FileName) == 0)
+            return true;
+    }
+
+    return false;
+}
+
 /* include one of a number of predefined libraries, or perhaps an actual file */
 void IncludeFile(Engine *pc, char *FileName)
 {
     struct IncludeLibrary *LInclude;
+    int Startup = -1;
+
+    if (pc->Trace != NULL)
+        TraceBegin(pc, "include", TableStrRegister(pc, FileName,
+            strlen(FileName)));
+    if (pc->StartupTimer != NULL)
+        Startup = StartupBegin(pc, "include", TableStrRegister(pc, FileName,
+            strlen(FileName)));
 
     /* scan for the include file name to see if it's in our list
         of predefined includes */
@@ -90,11 +122,19 @@ void IncludeFile(Engine *pc, char *FileName)
                     LibraryAdd(pc, LInclude->FuncList);
             }
 
+            if (pc->StartupTimer != NULL)
+                StartupEnd(pc, Startup);
+            if (pc->Trace != NULL)
+                TraceEnd(pc);
             return;
         }
     }
 
     /* not a predefined file, read a real file */
     EnginePlatformScanFile(pc, FileName);
+    if (pc->StartupTimer != NULL)
+        StartupEnd(pc, Startup);
+    if (pc->Trace != NULL)
+        TraceEnd(pc);
 }
 
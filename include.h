@@ -7,6 +7,7 @@ void IncludeCleanup(Engine *pc);
 void IncludeRegister(Engine *pc, const char *IncludeName,
     void (*SetupFunction)(Engine *pc), struct LibraryFunction *FuncList,
     const char *SetupCSource);
+int IncludeIsLibrary(Engine *pc, const char *FileName);
 void IncludeFile(Engine *pc, char *Filename);
 /* the following is defined in engine.h:
  * void EngineIncludeAllSystemHeaders(); */
@@ -21,6 +22,9 @@ int DebugClearBreakpoint(struct ParseState *Parser);
 void DebugStep(void)
 #endif
 
+/* parallel.c */
+struct LibraryFunction ParallelFunctions[];
+
 /* stdio.c */
 const char StdioDefs[];
 struct LibraryFunction StdioFunctions[];
@@ -38,6 +42,10 @@ void StringSetupFunc(Engine *pc);
 struct LibraryFunction StdlibFunctions[];
 void StdlibSetupFunc(Engine *pc);
 
+/* thread.c */
+const char ThreadDefs[];
+struct LibraryFunction ThreadFunctions[];
+
 /* time.c */
 const char StdTimeDefs[];
 struct LibraryFunction StdTimeFunctions[];
@@ -45,14 +53,21 @@ void StdTimeSetupFunc(Engine *pc);
 
 /* errno.c */
 void StdErrnoSetupFunc(Engine *pc);
+void StdErrnoThreadSetup(Engine *pc);
 
 /* ctype.c */
 struct LibraryFunction StdCtypeFunctions[];
 
+/* meminfo.c */
+struct LibraryFunction MemInfoFunctions[];
+
 /* stdbool.c */
 const char StdboolDefs[];
 void StdboolSetupFunc(Engine *pc);
 
+/* trace.c */
+struct LibraryFunction TraceFunctions[];
+
 /* unistd.c */
 const char UnistdDefs[];
 struct LibraryFunction UnistdFunctions[];
@@ -6,7 +6,6 @@
 
 #include "platform.h"
 #include "parse.h"
-#include "lex.h"
 
 #ifndef NULL
 #define NULL 0
@@ -43,9 +42,88 @@ struct Table;
 /* used in dynamic memory allocation */
 struct AllocNode {
     unsigned int Size;
+    unsigned char Category;     /* the enum MemCategory it's counted in */
     struct AllocNode *NextFree;
 };
 
+/* a block of memory which small allocations are carved from */
+struct HeapSlab {
+    struct HeapSlab *Next;
+};
+
+/* allocations too big for a slab are kept on a list so they can all be
+    released with the slabs */
+struct HeapBigBlock {
+    struct HeapBigBlock *Next;
+    struct HeapBigBlock *Prev;
+};
+
+/* where running into the stack guard is reported from, outside the
+    SIGSEGV handler. see HeapGuardBegin() */
+struct StackGuard {
+#ifdef USE_MMAP_STACK
+    sigjmp_buf Jump;
+    struct StackGuard *Previous;
+    Engine *PreviousEngine;
+#else
+    int Unused;
+#endif
+};
+
+/* allocation statistics for HeapAllocMem. there's a count for each size
+    class, plus a last one for allocations too big for a slab */
+struct HeapStats {
+    unsigned long Allocs[FREELIST_BUCKETS+1];
+    unsigned long Frees[FREELIST_BUCKETS+1];
+    unsigned long BytesInUse;       /* including the allocation headers */
+    unsigned long PeakBytesInUse;
+    unsigned long SlabBytes;        /* total obtained from the system for slabs */
+    unsigned long AllocBytes;       /* total asked for */
+    unsigned long StackAllocs;      /* HeapAllocStack() calls */
+    unsigned long StackBytes;
+    unsigned long PeakStackBytes;   /* the highest the stack has reached */
+};
+
+/* what the interpreter's memory is used for. the program's own malloc()s
+    are counted as well as HeapAllocMem() blocks */
+enum MemCategory {
+    MemTokens,          /* lexed token buffers */
+    MemStrings,         /* the shared string table */
+    MemTables,          /* table entries and local hash tables */
+    MemTypes,           /* ValueTypes and struct member tables */
+    MemFunctions,       /* function bodies */
+    MemMacros,          /* macro bodies and expansions */
+    MemValues,          /* global and static values */
+    MemOther,
+    MemMalloc,          /* malloc(), calloc() and realloc() by the program */
+    MemCategories
+};
+
+#include "lex.h"    /* which allocates in a MemCategory */
+
+/* bytes in use for each category, for EnginePrintMemory(). a limit of 0
+    means there isn't one */
+struct MemStats {
+    unsigned long InUse[MemCategories];
+    unsigned long Peak[MemCategories];
+    unsigned long Limit[MemCategories];
+    unsigned long TotalInUse;
+    unsigned long TotalPeak;
+    unsigned long TotalLimit;
+};
+
+/* counts of what the interpreter has done, for EnginePrintStats() */
+struct EngineStats {
+    unsigned long Tokens;           /* LexGetRawToken() calls */
+    unsigned long TokenPeeks;       /* which didn't move on */
+    unsigned long LocalSearches;    /* on stack frames which are gone */
+    unsigned long LocalProbes;
+    unsigned long FunctionCalls;
+    unsigned long MacroExpansions;
+    unsigned long StatementsRun;
+    unsigned long StatementsSkipped;
+};
+
 /* whether we're running or skipping code */
 enum RunMode {
     RunModeRun,                 /* we're running code as we parse it */
@@ -56,6 +134,21 @@ enum RunMode {
     RunModeContinue,            /* as above but repeat the loop */
     RunModeGoto                 /* searching for a goto label */
 };
+
+/* the parts of EngineInitialize(), which are each timed */
+enum InitPhase {
+    InitPlatform,
+    InitBasicIO,
+    InitHeap,
+    InitTable,
+    InitVariable,
+    InitLex,
+    InitType,
+    InitInclude,
+    InitLibrary,
+    InitPlatformLibrary,
+    InitPhases
+};
 /* values */
 enum BaseType {
     TypeVoid,                   /* no type */
@@ -156,8 +249,8 @@ struct Value {
 struct TableEntry {
     struct TableEntry *Next;        /* next item in this hash chain */
     const char *DeclFileName;       /* where the variable was declared */
-    unsigned short DeclLine;
-    unsigned short DeclColumn;
+    int DeclLine;
+    int DeclColumn;
 
     union TableEntryPayload {
         struct ValueEntry {
@@ -170,8 +263,8 @@ struct TableEntry {
         /* defines a breakpoint */
         struct BreakpointEntry {
             const char *FileName;
-            short int Line;
-            short int CharacterPos;
+            int Line;
+            int CharacterPos;
         } b;
 
     } p;
@@ -181,17 +274,18 @@ struct Table {
     short Size;
     short OnHeap;
     struct TableEntry **HashTable;
+    unsigned long Searches;         /* TableSearch() calls */
+    unsigned long Probes;           /* entries they looked at */
 };
 
 /* stack frame for function calls */
 struct StackFrame {
-    struct ParseState ReturnParser;         /* how we got here */
+    const struct LexTokenRecord *ReturnPos; /* the token we carry on from */
     const char *FuncName;                   /* the name of the function we're in */
     struct Value *ReturnValue;              /* copy the return value here */
-    struct Value **Parameter;               /* array of parameter values */
-    int NumParams;                          /* the number of parameters */
     struct Table LocalTable;                /* the local variables and parameters */
-    struct TableEntry *LocalHashTable[LOCAL_TABLE_SIZE];
+    struct TableEntry *LocalChain;          /* LocalTable until it's hashed */
+    int NumLocals;                          /* entries added to LocalChain */
     struct StackFrame *PreviousStackFrame;  /* the next lower stack frame */
 //    struct Value ThisValue;                 /* 'this' pointer Value for member functions */
 //    union AnyValue ThisData;                /* data storage for 'this' pointer */
@@ -215,7 +309,11 @@ struct LexState {
     int CharacterPos;
     const char *SourceText;
     enum LexMode Mode;
-    int EmitExtraNewlines;
+    int InDirective;        /* scanning a pre-processor line */
+    int TokenLine;          /* where the last scanned token started */
+    int TokenCharacterPos;
+    int HashIfLevel;        /* nested #if level */
+    int HashIfEvaluateToLevel;  /* last evaluated #if level */
 };
 
 /* library function definition */
@@ -248,14 +346,25 @@ enum ParseResult { ParseResultEOF, ParseResultError, ParseResultOk };
 struct CleanupTokenNode {
     void *Tokens;
     const char *SourceText;
+    char *FileName;
+    int Included;               /* parsed because of an #include */
     struct CleanupTokenNode *Next;
 };
 
+/* a macro use which has been expanded, cached by its call site */
+struct MacroExpansion {
+    const struct LexTokenRecord *CallSite;  /* the token after the macro name */
+    const struct LexTokenRecord *Resume;    /* the token after the whole use */
+    struct LexTokenRecord *Tokens;          /* the body with arguments substituted */
+    int NumTokens;                          /* not counting the end marker */
+    struct MacroExpansion *Next;
+};
+
 /* linked list of lexical tokens used in interactive mode */
 struct TokenLine {
     struct TokenLine *Next;
-    unsigned char *Tokens;
-    int NumBytes;
+    struct LexTokenRecord *Tokens;
+    int NumTokens;
 };
 
 
@@ -268,8 +377,6 @@ struct IncludeLibrary {
     struct IncludeLibrary *NextLib;
 };
 
-#define FREELIST_BUCKETS (8)        /* freelists for 4, 8, 12 ... 32 byte allocs */
-#define SPLIT_MEM_THRESHOLD (16)    /* don't split memory which is close in size */
 #define BREAKPOINT_TABLE_SIZE (21)
 
 struct TypeNameEntry 
@@ -289,17 +396,23 @@ struct Engine {
     /* parser global data */
     struct Table GlobalTable;
     struct CleanupTokenNode *CleanupTokenList;
+    int ParseDepth;             /* EngineParseTokens() calls in progress */
+    int DefineOnly;             /* skip top level statements which aren't
+                                    declarations */
     struct TableEntry *GlobalHashTable[GLOBAL_TABLE_SIZE];
 
     /* lexer global data */
     struct TokenLine *InteractiveHead;
     struct TokenLine *InteractiveTail;
     struct TokenLine *InteractiveCurrentLine;
+    int InteractiveHashIfLevel;     /* #ifs still open at the last line */
+    int InteractiveHashIfEvaluateToLevel;
     int LexUseStatementPrompt;
     union AnyValue LexAnyValue;
     struct Value LexValue;
     struct Table ReservedWordTable;
     struct TableEntry *ReservedWordHashTable[RESERVED_WORD_TABLE_SIZE];
+    struct MacroExpansion *MacroExpansionHashTable[MACRO_EXPANSION_TABLE_SIZE];
 
     /* the table of string literal values */
     struct Table StringLiteralTable;
@@ -316,12 +429,22 @@ struct Engine {
 
     /* heap memory */
     unsigned char *HeapMemory;  /* stack memory since our heap is malloc()ed */
+    size_t HeapMemorySize;      /* including any guard area */
+    struct StackGuard *StackGuard;  /* the innermost HeapGuardBegin() */
     void *HeapBottom;           /* the bottom of the (downward-growing) heap */
     void *StackFrame;           /* the current stack frame */
     void *HeapStackTop;         /* the top of the stack */
 
-    struct AllocNode *FreeListBucket[FREELIST_BUCKETS]; /* we keep a pool of freelist buckets to reduce fragmentation */
-    struct AllocNode *FreeListBig;    /* free memory which doesn't fit in a bucket */
+    struct AllocNode *FreeListBucket[FREELIST_BUCKETS]; /* freed blocks of each size class */
+    struct HeapSlab *SlabList;  /* slabs small allocations are carved from */
+    unsigned char *SlabPos;     /* the unused part of the newest slab */
+    unsigned char *SlabEnd;
+    struct HeapBigBlock *BigList;   /* allocations too big for a slab */
+    struct HeapStats HeapStats;
+    struct MemStats MemStats;
+    struct EngineStats Stats;
+    int ArenaTeardown;          /* EngineCleanup() just releases the heap */
+    int StackSize;              /* as given to EngineInitialize() */
 
     /* types */
     struct ValueType UberType;
@@ -344,16 +467,34 @@ struct Engine {
     struct ValueType *CharPtrPtrType;
     struct ValueType *CharArrayType;
     struct ValueType *VoidPtrType;
+    char StructTempName[7];     /* last name made up for an anonymous struct */
+    char EnumTempName[7];       /* and for an anonymous enum */
 
     /* debugger */
+    int EnableDebugger;
     struct Table BreakpointTable;
     struct TableEntry *BreakpointHashTable[BREAKPOINT_TABLE_SIZE];
     int BreakpointCount;
     int DebugManualBreak;
 
+    /* profilers */
+    struct Profile *Profile;    /* NULL unless we're profiling */
+    struct LineProfile *LineProfile;
+    struct Sampler *Sampler;
+    int ProfileStatements;      /* call ProfileStatement() for each one */
+    volatile int SampleLine;    /* the line the sampler sees we're on */
+    struct Trace *Trace;        /* NULL unless we're tracing */
+    struct StartupTimer *StartupTimer; /* NULL unless we're timing start up */
+    long long InitTime[InitPhases]; /* nanoseconds each part of
+                                    EngineInitialize() took */
+    long long InitStart;        /* when EngineInitialize() began */
+
     /* C library */
     int BigEndian;
     int LittleEndian;
+    IOFILE *StdinValue;         /* what stdin, stdout and stderr refer to */
+    IOFILE *StdoutValue;
+    IOFILE *StderrValue;
 
     IOFILE *CStdOut;
     IOFILE CStdOutBase;
@@ -367,6 +508,18 @@ struct Engine {
 #endif
     struct Table StringTable;
     struct TableEntry *StringHashTable[STRING_TABLE_SIZE];
+    Engine *StringOwner;            /* an engine whose strings are used in
+                                        preference to our own */
+    struct Table OwnerStrings;      /* the strings it had when we started */
+    struct TableEntry *OwnerStringHashTable[STRING_TABLE_SIZE];
+    struct Program *Program;        /* the compiled program we're running */
+    Engine *WorkerParent;           /* a worker shares this engine's globals */
+    struct WorkerPool *WorkerPool;  /* our parallel_for() workers, once
+                                        there's been one */
+#if defined(UNIX_HOST) || defined(WIN32)
+    atomic_int ThreadsRunning;      /* threads we started which haven't
+                                        finished */
+#endif
     char *StrEmpty;
     struct ValueType *StructType;
 #if 0
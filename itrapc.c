@@ -15,24 +15,141 @@
 #if defined(UNIX_HOST) || defined(WIN32)
 #include "LICENSE.h"
 
-/* Override via STACKSIZE environment variable */
+/* Override via STACKSIZE environment variable. a mmap()ed stack only
+    reserves address space, so it can default to something generous */
+#ifdef USE_MMAP_STACK
+#define PICOC_STACK_SIZE (1024*1024*1024)
+#else
 #define PICOC_STACK_SIZE (128000*4)
+#endif
+
+/* the --mem-limit=[category=]bytes options. bytes can end in k, m or g */
+static int SetMemoryLimits(Engine *pc, int NumOptions, char **Options)
+{
+    int Count;
+
+    for (Count = 0; Count < NumOptions; Count++) {
+        const char *Arg = Options[Count];
+        const char *Equals;
+        char Category[32] = "total";
+        char *End;
+        unsigned long Bytes;
+
+        if (strncmp(Arg, "--mem-limit=", 12) != 0)
+            continue;
+
+        Arg += 12;
+        if ((Equals = strchr(Arg, '=')) != NULL &&
+                Equals - Arg < (int)sizeof(Category)) {
+            memcpy(Category, Arg, Equals - Arg);
+            Category[Equals - Arg] = '\0';
+            Arg = Equals + 1;
+        }
+
+        Bytes = strtoul(Arg, &End, 10);
+        switch (*End) {
+        case 'g': case 'G': Bytes *= 1024;  /* fall through */
+        case 'm': case 'M': Bytes *= 1024;  /* fall through */
+        case 'k': case 'K': Bytes *= 1024; End++; break;
+        }
+
+        if (End == Arg || *End != '\0' || !EngineSetMemoryLimit(pc, Category, Bytes)) {
+            printf("bad memory limit %s, try -h\n", Options[Count]);
+            return false;
+        }
+    }
+
+    return true;
+}
 
 int main(int argc, char **argv)
 {
     int ParamCount = 1;
     int DontRunMain = false;
+    int FastExit = false;
+    int Batch = false;
+    int Jobs = 0;
+    const char *ServePath = NULL;
+    const char *ProfilePath = NULL;
+    int ProfileLines = false;
+    const char *SamplePath = NULL;
+    int Stats = false;
+    int MemReport = false;
+    const char *TracePath = NULL;
+    int TimeStartup = false;
+    int BenchRuns = 0;
     int StackSize = getenv("STACKSIZE") ? atoi(getenv("STACKSIZE")) : PICOC_STACK_SIZE;
     Engine pc;
 
-    if (argc < 2 || strcmp(argv[ParamCount], "-h") == 0) {
+    /* long options come first */
+    for (; ParamCount < argc && strncmp(argv[ParamCount], "--", 2) == 0; ParamCount++) {
+        if (strcmp(argv[ParamCount], "--fast-exit") == 0)
+            FastExit = true;
+        else if (strcmp(argv[ParamCount], "--stats") == 0)
+            Stats = true;
+        else if (strcmp(argv[ParamCount], "--mem-report") == 0)
+            MemReport = true;
+        else if (strncmp(argv[ParamCount], "--mem-limit=", 12) == 0)
+            ;   /* set once the engine's initialized */
+        else if (strcmp(argv[ParamCount], "--batch") == 0)
+            Batch = true;
+        else if (strcmp(argv[ParamCount], "--jobs") == 0 && ParamCount+1 < argc)
+            Jobs = atoi(argv[++ParamCount]);
+        else if (strncmp(argv[ParamCount], "--profile=", 10) == 0)
+            ProfilePath = &argv[ParamCount][10];
+        else if (strncmp(argv[ParamCount], "--trace=", 8) == 0)
+            TracePath = &argv[ParamCount][8];
+        else if (strncmp(argv[ParamCount], "--bench=", 8) == 0)
+            BenchRuns = atoi(&argv[ParamCount][8]);
+        else if (strcmp(argv[ParamCount], "--time-startup") == 0)
+            TimeStartup = true;
+        else if (strcmp(argv[ParamCount], "--profile-lines") == 0)
+            ProfileLines = true;
+#ifdef UNIX_HOST
+        else if (strcmp(argv[ParamCount], "--serve") == 0 && ParamCount+1 < argc)
+            ServePath = argv[++ParamCount];
+        else if (strncmp(argv[ParamCount], "--sample=", 9) == 0)
+            SamplePath = &argv[ParamCount][9];
+#endif
+        else {
+            printf("unknown option %s, try -h\n", argv[ParamCount]);
+            return 1;
+        }
+    }
+
+    if (ServePath != NULL) {
+        /* every request is run in a fork()ed copy of this engine */
+        EngineInitialize(&pc, StackSize);
+        if (!SetMemoryLimits(&pc, ParamCount-1, &argv[1]))
+            return 1;
+        EngineIncludeAllSystemHeaders(&pc);
+        return EngineServe(&pc, ServePath);
+    }
+
+    if (ParamCount >= argc || strcmp(argv[ParamCount], "-h") == 0) {
         printf(PROGRAM_VERSION "  \n"
                "Format:\n\n"
                "> itrapc <file1.c>... [- <arg1>...]    : run a program, calls main() as the entry point\n"
                "> itrapc -s <file1.c>... [- <arg1>...] : run a script, runs the program without calling main()\n"
                "> itrapc -i                            : interactive mode, Ctrl+d to exit\n"
                "> itrapc -c                            : copyright info\n"
-               "> itrapc -h                            : this help message\n");
+               "> itrapc -h                            : this help message\n"
+               "\nOptions, before any of the above:\n\n"
+               "  --fast-exit                          : exit without freeing the engine's memory\n"
+               "  --stats                              : show counts of what the interpreter did\n"
+               "  --mem-report                         : show what memory was used for, and the peaks\n"
+               "  --mem-limit=[category=]<bytes>[k|m|g]: fail allocations over the limit, for\n"
+               "                                         tokens, strings, tables, types, functions,\n"
+               "                                         macros, values, other, malloc or total\n"
+               "  --time-startup                       : show how long each part of starting up took\n"
+               "  --bench=N                            : parse once, then time N calls of main()\n"
+               "  --batch <file1.c|@list>...           : run each program in its own engine, in parallel\n"
+               "  --jobs N                             : worker threads for --batch, default one per CPU\n"
+               "  --serve <socket>                     : run programs requested on a unix socket\n"
+               "  --profile=<out.folded>               : time each function, writing folded stacks\n"
+               "  --profile-lines                      : count and time each line, then show them\n"
+               "  --trace=<out.json>                   : write a timeline of calls, parsing and trace_begin()\n"
+               "  --sample=<out.folded>                : sample the stack each ms, writing folded stacks\n");
         return 0;
     }
 
@@ -42,6 +159,29 @@ int main(int argc, char **argv)
     }
 
     EngineInitialize(&pc, StackSize);
+    if (!SetMemoryLimits(&pc, ParamCount-1, &argv[1]))
+        return 1;
+    if (Batch) {
+        /* each program gets an engine of its own, with pc's limits */
+        int Result = EngineRunBatch(argc - ParamCount, &argv[ParamCount], Jobs,
+            StackSize, &pc);
+
+        pc.ArenaTeardown = true;
+        EngineCleanup(&pc);
+        return Result;
+    }
+    if (TimeStartup)
+        EngineSetTimeStartup(&pc);
+    if (ProfilePath != NULL)
+        EngineSetProfile(&pc, ProfilePath);
+    if (ProfileLines)
+        EngineSetLineProfile(&pc);
+    if (TracePath != NULL)
+        EngineSetTrace(&pc, TracePath);
+#ifdef UNIX_HOST
+    if (SamplePath != NULL)
+        EngineStartSampling(&pc, SamplePath);
+#endif
 
     if (strcmp(argv[ParamCount], "-s") == 0) {
         DontRunMain = true;
@@ -54,17 +194,39 @@ int main(int argc, char **argv)
         EngineParseInteractive(&pc);
     } else {
         if (EnginePlatformSetExitPoint(&pc)) {
-            EngineCleanup(&pc);
+            if (Stats)
+                EnginePrintStats(&pc, stderr);
+            if (MemReport)
+                EnginePrintMemory(&pc, stderr);
+            if (!FastExit)
+                EngineCleanup(&pc);
+            else
+                EngineWriteProfile(&pc);
             return pc.EngineExitValue;
         }
 
         for (; ParamCount < argc && strcmp(argv[ParamCount], "-") != 0; ParamCount++)
             EnginePlatformScanFile(&pc, argv[ParamCount]);
 
-        if (!DontRunMain)
+        if (TimeStartup)
+            EnginePrintStartup(&pc, stderr);
+        if (!DontRunMain && BenchRuns > 0)
+            EngineBench(&pc, BenchRuns, argc - ParamCount, &argv[ParamCount]);
+        else if (!DontRunMain)
             EngineCallMain(&pc, argc - ParamCount, &argv[ParamCount]);
     }
-    EngineCleanup(&pc);
+
+    if (Stats)
+        EnginePrintStats(&pc, stderr);
+    if (MemReport)
+        EnginePrintMemory(&pc, stderr);
+
+    /* with --fast-exit the operating system gets the memory back all at
+        once when the process ends */
+    if (!FastExit)
+        EngineCleanup(&pc);
+    else
+        EngineWriteProfile(&pc);
     return pc.EngineExitValue;
 }
 #endif
@@ -8,6 +8,7 @@
 #define PROGRAM_VERSION "v1.0.0"
 #define PROGRAM_NAME "itrapc"
 typedef struct Engine Engine;
+typedef struct Program Program;
 
 #include "interpreter.h"
 
@@ -23,8 +24,44 @@ extern void EngineParseInteractive(Engine *pc);
 /* platform.c */
 extern void EngineCallMain(Engine *pc, int argc, char **argv);
 extern void EngineInitialize(Engine *pc, int StackSize);
-extern void EngineCleanup(Engine *pc);
+extern void EngineCleanup(Engine *pc);   /* set pc->ArenaTeardown to skip
+                                            freeing things one by one */
 extern void EnginePlatformScanFile(Engine *pc, const char *FileName);
+extern void EngineSetOutput(Engine *pc, FILE *Out, FILE *Err);
+extern void EnginePrintStats(Engine *pc, FILE *Stream);
+
+/* program.c */
+extern Program *ProgramCompile(const char *FileName, int StackSize,
+    FILE *Out, FILE *Err);
+extern void ProgramRetain(Program *Prog);
+extern void ProgramRelease(Program *Prog);
+extern void EngineInitializeProgram(Engine *pc, int StackSize, Program *Prog);
+extern void EngineParseProgram(Engine *pc);
+
+/* batch.c */
+extern int EngineRunBatch(int NumFiles, char **FileNames, int Jobs, int StackSize,
+    Engine *Limits);
+
+/* heap.c */
+extern int EngineSetMemoryLimit(Engine *pc, const char *Category, unsigned long Bytes);
+extern void EnginePrintMemory(Engine *pc, FILE *Stream);
+
+/* benchmark.c */
+extern int EngineBench(Engine *pc, int Runs, int argc, char **argv);
+
+/* server.c */
+extern int EngineServe(Engine *pc, const char *SocketPath);
+
+/* profile.c */
+extern void EngineSetProfile(Engine *pc, const char *FileName);
+extern void EngineSetLineProfile(Engine *pc);
+extern void EngineStartSampling(Engine *pc, const char *FileName);
+extern void EngineWriteProfile(Engine *pc);
+extern void EngineSetTimeStartup(Engine *pc);
+extern void EnginePrintStartup(Engine *pc, FILE *Stream);
+
+/* tracer.c */
+extern void EngineSetTrace(Engine *pc, const char *FileName);
 
 /* include.c */
 extern void EngineIncludeAllSystemHeaders(Engine *pc);
@@ -6,6 +6,8 @@
 #include "heap.h"
 #include "lex.h"
 #include "platform.h"
+#include "parse_macro.h"
+#include "include.h"
 
 #define isCidstart(c) (isalpha(c) || (c)=='_' || (c)=='#')
 #define isCident(c) (isalnum(c) || (c)=='_')
@@ -22,7 +24,6 @@
 
 #define LEXER_INC(l) ( (l)->Pos++, (l)->CharacterPos++ )
 #define LEXER_INCN(l, n) ( (l)->Pos+=(n), (l)->CharacterPos+=(n) )
-#define TOKEN_DATA_OFFSET (2)
 
 /* maximum value which can be represented by a "char" data type */
 #define MAX_CHAR_VALUE (255)
@@ -40,16 +41,23 @@ static enum LexToken LexGetCharacterConstant(Engine *pc, struct LexState *Lexer,
 static void LexSkipComment(struct LexState *Lexer, char NextChar);
 static void LexSkipLineCont(struct LexState *Lexer, char NextChar);
 static enum LexToken LexScanGetToken(Engine *pc, struct LexState *Lexer,
-    struct Value **Value);
-static int LexTokenSize(enum LexToken Token);
-static void *LexTokenize(Engine *pc, struct LexState *Lexer, int *TokenLen);
+    struct Value *Value);
+static int LexTokenHasValue(enum LexToken Token);
+static void *LexTokenize(Engine *pc, struct LexState *Lexer, int *NumTokens);
 static enum LexToken LexGetRawToken(struct ParseState *Parser, struct Value **Value,
     int IncPos);
-static void LexHashIncPos(struct ParseState *Parser, int IncPos);
-static void LexHashIfdef(struct ParseState *Parser, int IfNot);
-static void LexHashIf(struct ParseState *Parser);
-static void LexHashElse(struct ParseState *Parser);
-static void LexHashEndif(struct ParseState *Parser);
+static void LexHashFail(Engine *pc, struct LexState *Lexer,
+    const struct LexTokenRecord *Record, const char *Message);
+static const struct LexTokenRecord *LexHashFindDefine(Engine *pc,
+    struct LexState *Lexer, const struct LexTokenRecord *Tokens, int NumTokens,
+    const struct LexTokenRecord *Ident);
+static int LexHashIfValue(Engine *pc, struct LexState *Lexer,
+    const struct LexTokenRecord *Tokens, int NumTokens,
+    const struct LexTokenRecord *Arg);
+static int LexHashResolve(Engine *pc, struct LexState *Lexer,
+    struct LexTokenRecord *Tokens, int NumTokens);
+static struct LexTokenRecord *LexAllocTokens(struct ParseState *Parser,
+    int NumTokens, enum MemCategory Category);
 
 
 struct ReservedWord {
@@ -254,6 +262,9 @@ enum LexToken LexGetWord(Engine *pc, struct LexState *Lexer, struct Value *Value
     Value->Val->Identifier = TableStrRegister(pc, StartPos,len);
 
     Token = LexCheckReservedWord(pc, Value->Val->Identifier);
+    if (Token >= TokenHashDefine && Token <= TokenHashEndif)
+        Lexer->InDirective = true;
+
     switch (Token) {
     case TokenHashInclude:
         Lexer->Mode = LexModeHashInclude;
@@ -368,7 +379,6 @@ enum LexToken LexGetStringConstant(Engine *pc, struct LexState *Lexer,
                 Lexer->Line++;
                 Lexer->Pos++;
                 Lexer->CharacterPos = 0;
-                Lexer->EmitExtraNewlines++;
             }
 
             Escape = false;
@@ -427,9 +437,12 @@ void LexSkipComment(struct LexState *Lexer, char NextChar)
         /* conventional C comment */
         while (Lexer->Pos != Lexer->End &&
                 (*(Lexer->Pos-1) != '*' || *Lexer->Pos != '/')) {
-            if (*Lexer->Pos == '\n')
-                Lexer->EmitExtraNewlines++;
-            LEXER_INC(Lexer);
+            if (*Lexer->Pos == '\n') {
+                Lexer->Line++;
+                Lexer->Pos++;
+                Lexer->CharacterPos = 0;
+            } else
+                LEXER_INC(Lexer);
         }
 
         if (Lexer->Pos != Lexer->End)
@@ -443,39 +456,44 @@ void LexSkipComment(struct LexState *Lexer, char NextChar)
     }
 }
 
-/* skip a line continuation - used while scanning */
+/* skip a line continuation, including its newline - used while scanning */
 void LexSkipLineCont(struct LexState *Lexer, char NextChar)
 {
     while (Lexer->Pos != Lexer->End && *Lexer->Pos != '\n') {
         LEXER_INC(Lexer);
     }
+
+    if (Lexer->Pos != Lexer->End) {
+        Lexer->Line++;
+        Lexer->Pos++;
+        Lexer->CharacterPos = 0;
+    }
 }
 
 /* get a single token from the source - used while scanning */
 enum LexToken LexScanGetToken(Engine *pc, struct LexState *Lexer,
-    struct Value **Value)
+    struct Value *Value)
 {
     char ThisChar;
     char NextChar;
     enum LexToken GotToken = TokenNone;
 
-    /* handle cases line multi-line comments or string constants
-        which mess up the line count */
-    if (Lexer->EmitExtraNewlines > 0) {
-        Lexer->EmitExtraNewlines--;
-        return TokenEndOfLine;
-    }
-
     /* scan for a token */
     do {
-        *Value = &pc->LexValue;
         while (Lexer->Pos != Lexer->End && isspace((int)*Lexer->Pos)) {
             if (*Lexer->Pos == '\n') {
+                Lexer->TokenLine = Lexer->Line;
+                Lexer->TokenCharacterPos = Lexer->CharacterPos;
                 Lexer->Line++;
                 Lexer->Pos++;
                 Lexer->Mode = LexModeNormal;
                 Lexer->CharacterPos = 0;
-                return TokenEndOfLine;
+                if (Lexer->InDirective) {
+                    /* only the end of a pre-processor line is a token */
+                    Lexer->InDirective = false;
+                    return TokenEndOfLine;
+                }
+                continue;
             } else if (Lexer->Mode == LexModeHashDefine ||
                                     Lexer->Mode == LexModeHashDefineSpace)
                 Lexer->Mode = LexModeHashDefineSpace;
@@ -485,24 +503,26 @@ enum LexToken LexScanGetToken(Engine *pc, struct LexState *Lexer,
             LEXER_INC(Lexer);
         }
 
+        Lexer->TokenLine = Lexer->Line;
+        Lexer->TokenCharacterPos = Lexer->CharacterPos;
         if (Lexer->Pos == Lexer->End || *Lexer->Pos == '\0')
             return TokenEOF;
 
         ThisChar = *Lexer->Pos;
         if (isCidstart((int)ThisChar))
-            return LexGetWord(pc, Lexer, *Value);
+            return LexGetWord(pc, Lexer, Value);
 
         if (isdigit((int)ThisChar))
-            return LexGetNumber(pc, Lexer, *Value);
+            return LexGetNumber(pc, Lexer, Value);
 
         NextChar = (Lexer->Pos+1 != Lexer->End) ? *(Lexer->Pos+1) : 0;
         LEXER_INC(Lexer);
         switch (ThisChar) {
         case '"':
-            GotToken = LexGetStringConstant(pc, Lexer, *Value, '"');
+            GotToken = LexGetStringConstant(pc, Lexer, Value, '"');
             break;
         case '\'':
-            GotToken = LexGetCharacterConstant(pc, Lexer, *Value);
+            GotToken = LexGetCharacterConstant(pc, Lexer, Value);
             break;
         case '(':
             if (Lexer->Mode == LexModeHashDefineSpaceIdent)
@@ -537,7 +557,7 @@ enum LexToken LexScanGetToken(Engine *pc, struct LexState *Lexer,
             NEXTIS('=', TokenModulusAssign, TokenModulus); break;
         case '<':
             if (Lexer->Mode == LexModeHashInclude)
-                GotToken = LexGetStringConstant(pc, Lexer, *Value, '>');
+                GotToken = LexGetStringConstant(pc, Lexer, Value, '>');
             else {
                 NEXTIS3PLUS('=', TokenLessEqual, '<', TokenShiftLeft, '=',
                     TokenShiftLeftAssign, TokenLessThan);
@@ -620,8 +640,7 @@ enum LexToken LexScanGetToken(Engine *pc, struct LexState *Lexer,
 #endif
 // XXX: line continuation feature
         case '\\':
-            if (NextChar == ' ' || NextChar == '\n') {
-                LEXER_INC(Lexer);
+            if (NextChar == ' ' || NextChar == '\r' || NextChar == '\n') {
                 LexSkipLineCont(Lexer, NextChar);
             } else
                 LexFail(pc, Lexer, "illegal character '%c'", ThisChar);
@@ -635,87 +654,297 @@ enum LexToken LexScanGetToken(Engine *pc, struct LexState *Lexer,
     return GotToken;
 }
 
-/* what size value goes with each token */
-int LexTokenSize(enum LexToken Token)
+/* whether a token carries a value in its record */
+int LexTokenHasValue(enum LexToken Token)
 {
     switch (Token) {
-    case TokenIdentifier: case TokenStringConstant: return sizeof(char*);
-    case TokenIntegerConstant: return sizeof(long);
-    case TokenCharacterConstant: return sizeof(unsigned char);
-    case TokenFPConstant: return sizeof(double);
-    default: return 0;
+    case TokenIdentifier: case TokenStringConstant:
+    case TokenIntegerConstant: case TokenCharacterConstant:
+    case TokenFPConstant:
+        return true;
+    default:
+        return false;
     }
 }
 
+/* report a pre-processor error at the directive's position */
+void LexHashFail(Engine *pc, struct LexState *Lexer,
+    const struct LexTokenRecord *Record, const char *Message)
+{
+    Lexer->Line = Record->Line;
+    Lexer->CharacterPos = Record->CharacterPos;
+    LexFail(pc, Lexer, Message, Record->Token == TokenIdentifier ?
+        Record->Value.Identifier : "");
+}
+
+/* find the body of a macro for the pre-processor. #defines which have
+    already been kept in this source are searched first, then the global
+    table for macros from earlier sources. returns NULL if undefined */
+const struct LexTokenRecord *LexHashFindDefine(Engine *pc,
+    struct LexState *Lexer, const struct LexTokenRecord *Tokens, int NumTokens,
+    const struct LexTokenRecord *Ident)
+{
+    int Count;
+    struct Value *SavedValue;
+
+    for (Count = NumTokens - 2; Count >= 0; Count--) {
+        if (Tokens[Count].Token == TokenHashDefine &&
+                Tokens[Count+1].Token == TokenIdentifier &&
+                Tokens[Count+1].Value.Identifier == Ident->Value.Identifier)
+            return &Tokens[Count+2];
+    }
+
+    ShowX(">TableGet","GlobalTable",Ident->Value.Identifier,0);
+    if (!TableGet(&pc->GlobalTable, Ident->Value.Identifier, &SavedValue,
+            NULL, NULL, NULL))
+        return NULL;
+
+    if (SavedValue->Typ->Base != TypeMacro)
+        return Ident;   /* defined, but not as something #if can use */
+
+    return SavedValue->Val->MacroDef.Body.Pos;
+}
+
+/* evaluate the argument of a #if directive */
+int LexHashIfValue(Engine *pc, struct LexState *Lexer,
+    const struct LexTokenRecord *Tokens, int NumTokens,
+    const struct LexTokenRecord *Arg)
+{
+    const struct LexTokenRecord *ValueRecord = Arg;
+
+    if (Arg->Token == TokenIdentifier) {
+        /* look up a value from a macro definition */
+        ValueRecord = LexHashFindDefine(pc, Lexer, Tokens, NumTokens, Arg);
+        if (ValueRecord == NULL)
+            LexHashFail(pc, Lexer, Arg, "'%s' is undefined");
+    }
+
+    if (ValueRecord->Token == TokenIntegerConstant)
+        return ValueRecord->Value.LongInteger != 0;
+    else if (ValueRecord->Token == TokenCharacterConstant)
+        return ValueRecord->Value.Character != 0;
+
+    LexHashFail(pc, Lexer, Arg, "value expected");
+    return false;
+}
+
+/* resolve #if, #ifdef, #ifndef, #else and #endif in a freshly scanned token
+    buffer. the directives and the sections they exclude are removed in place
+    so the parser never sees them. a built-in header which is #included is
+    included now, so a #ifdef after it can see what it defines. a header
+    from a file can't be read until the parser reaches it, which might
+    follow #defines in this buffer, so the rest of the buffer is left as it
+    is and LexHashResume() does it then. returns the new number of tokens */
+int LexHashResolve(Engine *pc, struct LexState *Lexer,
+    struct LexTokenRecord *Tokens, int NumTokens)
+{
+    int In;
+    int Out = 0;
+    struct LexTokenRecord *Directive;
+
+    for (In = 0; In < NumTokens; In++) {
+        Directive = &Tokens[In];
+        switch (Directive->Token) {
+        case TokenHashIfdef:
+        case TokenHashIfndef:
+            if (Lexer->HashIfEvaluateToLevel == Lexer->HashIfLevel) {
+                int IsDefined;
+
+                if (Directive[1].Token != TokenIdentifier)
+                    LexHashFail(pc, Lexer, &Directive[1], "identifier expected");
+
+                IsDefined = LexHashFindDefine(pc, Lexer, Tokens, Out,
+                    &Directive[1]) != NULL;
+                if (IsDefined == (Directive->Token == TokenHashIfdef))
+                    Lexer->HashIfEvaluateToLevel++;  /* #if is active, evaluate
+                                                        to this new level */
+            }
+            Lexer->HashIfLevel++;
+            break;
+        case TokenHashIf:
+            if (Lexer->HashIfEvaluateToLevel == Lexer->HashIfLevel &&
+                    LexHashIfValue(pc, Lexer, Tokens, Out, &Directive[1]))
+                Lexer->HashIfEvaluateToLevel++;
+            Lexer->HashIfLevel++;
+            break;
+        case TokenHashElse:
+            if (Lexer->HashIfLevel == 0)
+                LexHashFail(pc, Lexer, Directive, "#else without #if");
+
+            if (Lexer->HashIfEvaluateToLevel == Lexer->HashIfLevel - 1)
+                Lexer->HashIfEvaluateToLevel++;  /* #if was not active, make
+                                                    this next section active */
+            else if (Lexer->HashIfEvaluateToLevel == Lexer->HashIfLevel)
+                Lexer->HashIfEvaluateToLevel--;  /* #if was active, now go
+                                                    inactive */
+            break;
+        case TokenHashEndif:
+            if (Lexer->HashIfLevel == 0)
+                LexHashFail(pc, Lexer, Directive, "#endif without #if");
+
+            Lexer->HashIfLevel--;
+            if (Lexer->HashIfEvaluateToLevel > Lexer->HashIfLevel)
+                Lexer->HashIfEvaluateToLevel = Lexer->HashIfLevel;
+            break;
+        case TokenHashInclude:
+            if (Lexer->HashIfEvaluateToLevel == Lexer->HashIfLevel &&
+                    Directive[1].Token == TokenStringConstant) {
+                char *FileName = (char *)Directive[1].Value.Pointer;
+
+                Directive->Value.LongInteger = 0;
+                if (IncludeIsLibrary(pc, FileName))
+                    IncludeFile(pc, FileName);
+                else if (Lexer->FileName != pc->StrEmpty) {
+                    /* keep the rest as it is until the file's been read */
+                    Directive->Value.LongInteger = Lexer->HashIfLevel + 1;
+                    memmove(&Tokens[Out], Directive,
+                        sizeof(struct LexTokenRecord) * (NumTokens - In));
+                    return Out + NumTokens - In;
+                }
+            }
+            /* fall through */
+        default:
+            /* keep the token only if it's in an active section */
+            if (Lexer->HashIfEvaluateToLevel == Lexer->HashIfLevel ||
+                    Directive->Token == TokenEOF)
+                Tokens[Out++] = *Directive;
+            continue;
+        }
+
+        /* drop the rest of the directive's line */
+        while (Tokens[In+1].Token != TokenEndOfLine &&
+                Tokens[In+1].Token != TokenEOF)
+            In++;
+        if (Tokens[In+1].Token == TokenEndOfLine)
+            In++;
+    }
+
+    return Out;
+}
+
+/* how many tokens, up to the end of the buffer, follow an #include which
+    LexHashResolve() left for when its header had been read. 0 if it
+    didn't, or they've been resolved since */
+int LexHashDeferred(const struct LexTokenRecord *Include)
+{
+    int NumTokens;
+
+    if (Include->Value.LongInteger == 0)
+        return 0;
+
+    for (NumTokens = 1; Include[NumTokens+1].Token != TokenEOF; NumTokens++) {}
+
+    return NumTokens;
+}
+
+/* resolve the #ifs in the tokens after an #include once its header has
+    been read. Tokens are the LexHashDeferred() tokens after Include, or a
+    copy of them. returns how many are left */
+int LexHashResolveDeferred(struct ParseState *Parser,
+    const struct LexTokenRecord *Include, struct LexTokenRecord *Tokens,
+    int NumTokens)
+{
+    struct LexState Lexer;
+
+    memset(&Lexer, '\0', sizeof(Lexer));
+    Lexer.FileName = Parser->FileName;
+    Lexer.SourceText = Parser->SourceText;
+    Lexer.HashIfLevel = Include->Value.LongInteger - 1;
+    Lexer.HashIfEvaluateToLevel = Lexer.HashIfLevel;
+    return LexHashResolve(Parser->pc, &Lexer, Tokens, NumTokens);
+}
+
+/* resolve the #ifs after an #include, if they were left until now. this is
+    done once for each #include, by the first parser to go past it */
+void LexHashResume(struct ParseState *Parser,
+    const struct LexTokenRecord *Include)
+{
+    int NumTokens = LexHashDeferred(Include);
+
+    if (NumTokens == 0)
+        return;
+
+    LexHashResolveDeferred(Parser, Include,
+        (struct LexTokenRecord *)&Include[2], NumTokens);
+    ((struct LexTokenRecord *)Include)->Value.LongInteger = 0;
+}
+
 /* produce tokens from the lexer and return a heap buffer with
     the result - used for scanning */
-void *LexTokenize(Engine *pc, struct LexState *Lexer, int *TokenLen)
+void *LexTokenize(Engine *pc, struct LexState *Lexer, int *NumTokens)
 {
-    int MemUsed = 0;
-    int ValueSize;
-    int LastCharacterPos = 0;
-    int ReserveSpace = (Lexer->End - Lexer->Pos) * 4 + 16;
-    void *HeapMem;
-    void *TokenSpace = HeapAllocStack(pc, ReserveSpace);
+    int Count = 0;
+    int Reserved = (Lexer->End - Lexer->Pos) / 4 + 16;
+    struct LexTokenRecord *Tokens;
+    struct LexTokenRecord *Record;
+    union LexTokenValue ScanData;
+    struct Value ScanValue;
     enum LexToken Token;
-    struct Value *GotValue;
-    char *TokenPos = (char*)TokenSpace;
 
-    if (TokenSpace == NULL)
-        LexFail(pc, Lexer, "(LexTokenize TokenSpace == NULL) out of memory");
+    Tokens = HeapAllocMemIn(pc, sizeof(struct LexTokenRecord) * Reserved, MemTokens);
+    if (Tokens == NULL)
+        LexFail(pc, Lexer, "(LexTokenize Tokens == NULL) out of memory");
+
+    memset(&ScanValue, '\0', sizeof(ScanValue));
+    ScanValue.Val = (union AnyValue*)&ScanData;
 
     do {
-        /* store the token at the end of the stack area */
-        Token = LexScanGetToken(pc, Lexer, &GotValue);
+        if (Count == Reserved) {
+            /* out of records - double the buffer */
+            struct LexTokenRecord *Grown = HeapAllocMemIn(pc,
+                sizeof(struct LexTokenRecord) * Reserved * 2, MemTokens);
+            if (Grown == NULL)
+                LexFail(pc, Lexer, "(LexTokenize Grown == NULL) out of memory");
+
+            memcpy(Grown, Tokens, sizeof(struct LexTokenRecord) * Count);
+            HeapFreeMem(pc, Tokens);
+            Tokens = Grown;
+            Reserved *= 2;
+        }
+
+        /* narrow constants only set part of the value, so clear it first */
+        memset(&ScanData, '\0', sizeof(ScanData));
+        Token = LexScanGetToken(pc, Lexer, &ScanValue);
 
 #ifdef DEBUG_LEXER
         printf("Token: %02x\n", Token);
 #endif
-        *(unsigned char*)TokenPos = Token;
-        TokenPos++;
-        MemUsed++;
-
-        *(unsigned char*)TokenPos = (unsigned char)LastCharacterPos;
-        TokenPos++;
-        MemUsed++;
-
-        ValueSize = LexTokenSize(Token);
-        if (ValueSize > 0) {
-            /* store a value as well */
-            memcpy((void*)TokenPos, (void*)GotValue->Val, ValueSize);
-            TokenPos += ValueSize;
-            MemUsed += ValueSize;
-        }
-
-        LastCharacterPos = Lexer->CharacterPos;
-
+        Record = &Tokens[Count++];
+        Record->Token = Token;
+        Record->CharacterPos = Lexer->TokenCharacterPos;
+        Record->Line = Lexer->TokenLine;
+        if (LexTokenHasValue(Token))
+            Record->Value = ScanData;
     } while (Token != TokenEOF);
 
-    HeapMem = HeapAllocMem(pc, MemUsed);
-    if (HeapMem == NULL)
-        LexFail(pc, Lexer, "(LexTokenize HeapMem == NULL) out of memory");
+    if (Lexer->FileName == pc->StrEmpty) {
+        /* a #if typed interactively can go on over several lines */
+        Lexer->HashIfLevel = pc->InteractiveHashIfLevel;
+        Lexer->HashIfEvaluateToLevel = pc->InteractiveHashIfEvaluateToLevel;
+        Count = LexHashResolve(pc, Lexer, Tokens, Count);
+        pc->InteractiveHashIfLevel = Lexer->HashIfLevel;
+        pc->InteractiveHashIfEvaluateToLevel = Lexer->HashIfEvaluateToLevel;
+    } else
+        Count = LexHashResolve(pc, Lexer, Tokens, Count);
 
-    assert(ReserveSpace >= MemUsed);
-    memcpy(HeapMem, TokenSpace, MemUsed);
-    HeapPopStack(pc, TokenSpace, ReserveSpace);
 #ifdef DEBUG_LEXER
     {
-        int Count;
+        int Index;
         printf("Tokens: ");
-        for (Count = 0; Count < MemUsed; Count++)
-            printf("%02x ", *((unsigned char*)HeapMem+Count));
+        for (Index = 0; Index < Count; Index++)
+            printf("%02x ", Tokens[Index].Token);
         printf("\n");
     }
 #endif
-    if (TokenLen)
-        *TokenLen = MemUsed;
+    if (NumTokens)
+        *NumTokens = Count;
 
-    return HeapMem;
+    return Tokens;
 }
 
 /* lexically analyse some source text */
 void *LexAnalyse(Engine *pc, const char *FileName, const char *Source,
-    int SourceLen, int *TokenLen)
+    int SourceLen, int *NumTokens)
 {
     struct LexState Lexer;
 
@@ -724,11 +953,15 @@ void *LexAnalyse(Engine *pc, const char *FileName, const char *Source,
     Lexer.Line = 1;
     Lexer.FileName = FileName;
     Lexer.Mode = LexModeNormal;
-    Lexer.EmitExtraNewlines = 0;
-    Lexer.CharacterPos = 1;
+    Lexer.InDirective = false;
+    Lexer.CharacterPos = 0;
+    Lexer.TokenLine = 1;
+    Lexer.TokenCharacterPos = 0;
     Lexer.SourceText = Source;
+    Lexer.HashIfLevel = 0;
+    Lexer.HashIfEvaluateToLevel = 0;
 
-    return LexTokenize(pc, &Lexer, TokenLen);
+    return LexTokenize(pc, &Lexer, NumTokens);
 }
 
 /* prepare to parse a pre-tokenised buffer */
@@ -741,8 +974,6 @@ void LexInitParser(struct ParseState *Parser, Engine *pc, const char *SourceText
     Parser->FileName = FileName;
     Parser->Mode = RunIt ? RunModeRun : RunModeSkip;
     Parser->SearchLabel = 0;
-    Parser->HashIfLevel = 0;
-    Parser->HashIfEvaluateToLevel = 0;
     Parser->CharacterPos = 0;
     Parser->SourceText = SourceText;
     Parser->DebugMode = EnableDebugger;
@@ -752,22 +983,23 @@ void LexInitParser(struct ParseState *Parser, Engine *pc, const char *SourceText
 enum LexToken LexGetRawToken(struct ParseState *Parser, struct Value **Value,
     int IncPos)
 {
-    int ValueSize;
     char *Prompt = NULL;
     enum LexToken Token = TokenNone;
     Engine *pc = Parser->pc;
 
+#ifndef NO_STATS
+    pc->Stats.Tokens++;
+    pc->Stats.TokenPeeks += !IncPos;
+#endif
     do {
         /* get the next token */
         if (Parser->Pos == NULL && pc->InteractiveHead != NULL)
             Parser->Pos = pc->InteractiveHead->Tokens;
 
         if (Parser->FileName != pc->StrEmpty || pc->InteractiveHead != NULL) {
-            /* skip leading newlines */
-            while ((Token = (enum LexToken)*(unsigned char*)Parser->Pos) == TokenEndOfLine) {
-                Parser->Line++;
-                Parser->Pos += TOKEN_DATA_OFFSET;
-            }
+            /* skip the ends of pre-processor lines */
+            while ((Token = (enum LexToken)Parser->Pos->Token) == TokenEndOfLine)
+                Parser->Pos++;
         }
 
         if (Parser->FileName == pc->StrEmpty &&
@@ -775,12 +1007,12 @@ enum LexToken LexGetRawToken(struct ParseState *Parser, struct Value **Value,
             /* we're at the end of an interactive input token list */
             char LineBuffer[LINEBUFFER_MAX];
             void *LineTokens;
-            int LineBytes;
+            int LineNumTokens;
             struct TokenLine *LineNode;
 
             if (pc->InteractiveHead == NULL ||
-                    (unsigned char*)Parser->Pos ==
-                    &pc->InteractiveTail->Tokens[pc->InteractiveTail->NumBytes-TOKEN_DATA_OFFSET]) {
+                    Parser->Pos ==
+                    &pc->InteractiveTail->Tokens[pc->InteractiveTail->NumTokens-1]) {
                 /* get interactive input */
                 if (pc->LexUseStatementPrompt) {
                     Prompt = PROGRAM_NAME INTERACTIVE_PROMPT_STATEMENT;
@@ -793,28 +1025,30 @@ enum LexToken LexGetRawToken(struct ParseState *Parser, struct Value **Value,
 
                 /* put the new line at the end of the linked list of interactive lines */
                 LineTokens = LexAnalyse(pc, pc->StrEmpty, &LineBuffer[0],
-                    strlen(LineBuffer), &LineBytes);
+                    strlen(LineBuffer), &LineNumTokens);
                 LineNode = VariableAlloc(pc, Parser,
-                    sizeof(struct TokenLine), true);
+                    sizeof(struct TokenLine), true, MemTokens);
                 LineNode->Tokens = LineTokens;
-                LineNode->NumBytes = LineBytes;
+                LineNode->NumTokens = LineNumTokens;
                 if (pc->InteractiveHead == NULL) {
                     /* start a new list */
                     pc->InteractiveHead = LineNode;
                     Parser->Line = 1;
                     Parser->CharacterPos = 0;
-                } else
+                } else {
                     pc->InteractiveTail->Next = LineNode;
+                    Parser->Line++;
+                }
 
                 pc->InteractiveTail = LineNode;
                 pc->InteractiveCurrentLine = LineNode;
                 Parser->Pos = LineTokens;
             } else {
                 /* go to the next token line */
-                if (Parser->Pos != &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumBytes-TOKEN_DATA_OFFSET]) {
+                if (Parser->Pos != &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumTokens-1]) {
                     /* scan for the line */
                     for (pc->InteractiveCurrentLine = pc->InteractiveHead;
-                            Parser->Pos != &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumBytes-TOKEN_DATA_OFFSET];
+                            Parser->Pos != &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumTokens-1];
                             pc->InteractiveCurrentLine = pc->InteractiveCurrentLine->Next) {
                         assert(pc->InteractiveCurrentLine->Next != NULL);
                     }
@@ -824,54 +1058,46 @@ enum LexToken LexGetRawToken(struct ParseState *Parser, struct Value **Value,
                 pc->InteractiveCurrentLine = pc->InteractiveCurrentLine->Next;
                 assert(pc->InteractiveCurrentLine != NULL);
                 Parser->Pos = pc->InteractiveCurrentLine->Tokens;
+                Parser->Line++;
             }
 
-            Token = (enum LexToken)*(unsigned char*)Parser->Pos;
+            Token = (enum LexToken)Parser->Pos->Token;
         }
     } while ((Parser->FileName == pc->StrEmpty && Token == TokenEOF) ||
         Token == TokenEndOfLine);
 
-    Parser->CharacterPos = *((unsigned char*)Parser->Pos + 1);
-    ValueSize = LexTokenSize(Token);
-    if (ValueSize > 0) {
-        /* this token requires a value - unpack it */
-        if (Value != NULL) {
-            switch (Token) {
-            case TokenStringConstant:
-                pc->LexValue.Typ = pc->CharPtrType;
-                break;
-            case TokenIdentifier:
-                pc->LexValue.Typ = NULL;
-                break;
-            case TokenIntegerConstant:
-                pc->LexValue.Typ = &pc->LongType;
-                break;
-            case TokenCharacterConstant:
-                pc->LexValue.Typ = &pc->CharType;
-                break;
-            case TokenFPConstant:
-                pc->LexValue.Typ = &pc->FPType;
-                break;
-            default:
-                break;
-            }
-
-            memcpy((void*)pc->LexValue.Val,
-                (void*)((char*)Parser->Pos+TOKEN_DATA_OFFSET), ValueSize);
-            pc->LexValue.ValOnHeap = false;
-            pc->LexValue.ValOnStack = false;
-            pc->LexValue.IsLValue = false;
-            pc->LexValue.LValueFrom = NULL;
-            *Value = &pc->LexValue;
+    if (Parser->FileName != pc->StrEmpty)
+        Parser->Line = Parser->Pos->Line;
+    Parser->CharacterPos = Parser->Pos->CharacterPos;
+    if (Value != NULL && LexTokenHasValue(Token)) {
+        /* the value is read in place from the token record */
+        switch (Token) {
+        case TokenStringConstant:
+            pc->LexValue.Typ = pc->CharPtrType;
+            break;
+        case TokenIdentifier:
+            pc->LexValue.Typ = NULL;
+            break;
+        case TokenIntegerConstant:
+            pc->LexValue.Typ = &pc->LongType;
+            break;
+        case TokenCharacterConstant:
+            pc->LexValue.Typ = &pc->CharType;
+            break;
+        case TokenFPConstant:
+            pc->LexValue.Typ = &pc->FPType;
+            break;
+        default:
+            break;
         }
 
-        if (IncPos)
-            Parser->Pos += ValueSize + TOKEN_DATA_OFFSET;
-    } else {
-        if (IncPos && Token != TokenEOF)
-            Parser->Pos += TOKEN_DATA_OFFSET;
+        pc->LexValue.Val = (union AnyValue*)&Parser->Pos->Value;
+        *Value = &pc->LexValue;
     }
 
+    if (IncPos && Token != TokenEOF)
+        Parser->Pos++;
+
 #ifdef DEBUG_LEXER
     printf("Got token=%02x inc=%d pos=%d\n", Token, IncPos, Parser->CharacterPos);
 #endif
@@ -879,233 +1105,133 @@ enum LexToken LexGetRawToken(struct ParseState *Parser, struct Value **Value,
     return Token;
 }
 
-/* correct the token position depending if we already incremented the position */
-void LexHashIncPos(struct ParseState *Parser, int IncPos)
-{
-    if (!IncPos)
-        LexGetRawToken(Parser, NULL, true);
-}
-
-/* handle a #ifdef directive */
-void LexHashIfdef(struct ParseState *Parser, int IfNot)
-{
-    /* get symbol to check */
-    int IsDefined;
-    struct Value *IdentValue;
-    struct Value *SavedValue;
-    enum LexToken Token = LexGetRawToken(Parser, &IdentValue, true);
-
-    if (Token != TokenIdentifier)
-        ProgramFail(Parser, "identifier expected");
-
-    /* is the identifier defined? */
-    ShowX(">TableGet","GlobalTable",IdentValue->Val->Identifier,0);
-    IsDefined = TableGet(&Parser->pc->GlobalTable, IdentValue->Val->Identifier,
-        &SavedValue, NULL, NULL, NULL);
-    if (Parser->HashIfEvaluateToLevel == Parser->HashIfLevel &&
-            ((IsDefined && !IfNot) || (!IsDefined && IfNot))) {
-        /* #if is active, evaluate to this new level */
-        Parser->HashIfEvaluateToLevel++;
-    }
-
-    Parser->HashIfLevel++;
-}
-
-/* handle a #if directive */
-void LexHashIf(struct ParseState *Parser)
-{
-    /* get symbol to check */
-    struct Value *IdentValue;
-    struct Value *SavedValue = NULL;
-    struct ParseState MacroParser;
-    enum LexToken Token = LexGetRawToken(Parser, &IdentValue, true);
-
-    if (Token == TokenIdentifier) {
-        /* look up a value from a macro definition */
-        ShowX(">TableGet","GlobalTable",IdentValue->Val->Identifier,0);
-        if (!TableGet(&Parser->pc->GlobalTable, IdentValue->Val->Identifier,
-                &SavedValue, NULL, NULL, NULL))
-            ProgramFail(Parser, "'%s' is undefined", IdentValue->Val->Identifier);
-
-        if (SavedValue->Typ->Base != TypeMacro)
-            ProgramFail(Parser, "value expected");
-
-        ParserCopy(&MacroParser, &SavedValue->Val->MacroDef.Body);
-        Token = LexGetRawToken(&MacroParser, &IdentValue, true);
-    }
-
-    if (Token != TokenCharacterConstant && Token != TokenIntegerConstant)
-        ProgramFail(Parser, "value expected");
-
-    /* is the identifier defined? */
-    if (Parser->HashIfEvaluateToLevel == Parser->HashIfLevel &&
-            IdentValue->Val->Character) {
-        /* #if is active, evaluate to this new level */
-        Parser->HashIfEvaluateToLevel++;
-    }
-
-    Parser->HashIfLevel++;
-}
-
-/* handle a #else directive */
-void LexHashElse(struct ParseState *Parser)
+/* get the next token given a parser state. conditional compilation was
+    resolved when the source was tokenized, so this is a plain fetch */
+enum LexToken LexGetToken(struct ParseState *Parser, struct Value **Value,
+    int IncPos)
 {
-    if (Parser->HashIfEvaluateToLevel == Parser->HashIfLevel - 1)
-        Parser->HashIfEvaluateToLevel++;  /* #if was not active, make
-                                            this next section active */
-    else if (Parser->HashIfEvaluateToLevel == Parser->HashIfLevel) {
-        /* #if was active, now go inactive */
-        if (Parser->HashIfLevel == 0)
-            ProgramFail(Parser, "#else without #if");
-
-        Parser->HashIfEvaluateToLevel--;
-    }
+    return LexGetRawToken(Parser, Value, IncPos);
 }
 
-/* handle a #endif directive */
-void LexHashEndif(struct ParseState *Parser)
+/* take a quick peek at the next token, skipping any pre-processing */
+enum LexToken LexRawPeekToken(struct ParseState *Parser)
 {
-    if (Parser->HashIfLevel == 0)
-        ProgramFail(Parser, "#endif without #if");
-
-    Parser->HashIfLevel--;
-    if (Parser->HashIfEvaluateToLevel > Parser->HashIfLevel)
-        Parser->HashIfEvaluateToLevel = Parser->HashIfLevel;
+    return (enum LexToken)Parser->Pos->Token;
 }
 
-
-/* get the next token given a parser state, pre-processing as we go */
-enum LexToken LexGetToken(struct ParseState *Parser, struct Value **Value,
-    int IncPos)
+/* look at the token Ahead tokens past the next one without moving the
+    parser. LexGetToken(Parser, Value, false) is the same as Ahead == 0 */
+enum LexToken LexPeekToken(struct ParseState *Parser, int Ahead,
+    struct Value **Value)
 {
-    int TryNextToken;
+    ParseCheckpoint Save;
     enum LexToken Token;
 
-    /* implements the pre-processor #if commands */
-    do {
-        int WasPreProcToken = true;
-
-        Token = LexGetRawToken(Parser, Value, IncPos);
-        switch (Token) {
-        case TokenHashIfdef:
-            LexHashIncPos(Parser, IncPos); LexHashIfdef(Parser, false);
-            break;
-        case TokenHashIfndef:
-            LexHashIncPos(Parser, IncPos); LexHashIfdef(Parser, true);
-            break;
-        case TokenHashIf:
-            LexHashIncPos(Parser, IncPos); LexHashIf(Parser);
-            break;
-        case TokenHashElse:
-            LexHashIncPos(Parser, IncPos); LexHashElse(Parser);
-            break;
-        case TokenHashEndif:
-            LexHashIncPos(Parser, IncPos); LexHashEndif(Parser);
-            break;
-        default:
-            WasPreProcToken = false;
-            break;
-        }
-
-        /* if we're going to reject this token, increment the token
-            pointer to the next one */
-        TryNextToken = (Parser->HashIfEvaluateToLevel < Parser->HashIfLevel &&
-                Token != TokenEOF) || WasPreProcToken;
-        if (!IncPos && TryNextToken)
-            LexGetRawToken(Parser, NULL, true);
-
-    } while (TryNextToken);
+    ParserCheckpoint(Parser, &Save);
+    for (; Ahead > 0; Ahead--)
+        LexGetToken(Parser, NULL, true);
 
+    Token = LexGetToken(Parser, Value, false);
+    ParserRewind(Parser, &Save);
     return Token;
 }
 
-/* take a quick peek at the next token, skipping any pre-processing */
-enum LexToken LexRawPeekToken(struct ParseState *Parser)
-{
-    return (enum LexToken)*(unsigned char*)Parser->Pos;
-}
-
 /* find the end of the line */
 void LexToEndOfMacro(struct ParseState *Parser)
 {
-// XXX: line continuation feature
-    bool isContinued = false;
+    /* line continuations are consumed by the scanner, so the first
+        end of line really is the end */
     while (true) {
-        enum LexToken Token = (enum LexToken)*(unsigned char*)Parser->Pos;
-        if (Token == TokenEOF)
+        enum LexToken Token = (enum LexToken)Parser->Pos->Token;
+        if (Token == TokenEOF || Token == TokenEndOfLine)
             return;
-        else if (Token == TokenEndOfLine) {
-            if (!isContinued)
-                return;
-            isContinued = false;
-        }
-        if (Token == TokenBackSlash)
-            isContinued = true;
         LexGetRawToken(Parser, NULL, true);
     }
 }
 
+/* room for a copy of NumTokens tokens and the TokenEndOfFunction after
+    them, counted against Category */
+static struct LexTokenRecord *LexAllocTokens(struct ParseState *Parser,
+    int NumTokens, enum MemCategory Category)
+{
+    struct LexTokenRecord *NewTokens = HeapAllocMemIn(Parser->pc,
+        sizeof(struct LexTokenRecord) * (NumTokens + 1), Category);
+
+    if (NewTokens == NULL)
+        ProgramFail(Parser, "(LexCopyTokens) out of memory");
+
+    memset(&NewTokens[NumTokens], '\0', sizeof(struct LexTokenRecord));
+    return NewTokens;
+}
+
 /* copy the tokens from StartParser to EndParser into new memory, removing
     TokenEOFs and terminate with a TokenEndOfFunction */
-void *LexCopyTokens(struct ParseState *StartParser, struct ParseState *EndParser)
+void *LexCopyTokens(struct ParseState *StartParser, struct ParseState *EndParser,
+    enum MemCategory Category)
 {
-    int MemSize = 0;
-    int CopySize;
-    unsigned char *Pos = (unsigned char*)StartParser->Pos;
-    unsigned char *NewTokens;
-    unsigned char *NewTokenPos;
+    int NumTokens = 0;
+    int CopyTokens;
+    const struct LexTokenRecord *Pos = StartParser->Pos;
+    struct LexTokenRecord *NewTokens;
+    struct LexTokenRecord *NewTokenPos;
     struct TokenLine *ILine;
     Engine *pc = StartParser->pc;
 
     if (pc->InteractiveHead == NULL) {
         /* non-interactive mode - copy the tokens */
-        MemSize = EndParser->Pos - StartParser->Pos;
-        NewTokens = VariableAlloc(pc, StartParser, MemSize + TOKEN_DATA_OFFSET, true);
-        memcpy(NewTokens, (void*)StartParser->Pos, MemSize);
+        NumTokens = EndParser->Pos - StartParser->Pos;
+        NewTokens = LexAllocTokens(StartParser, NumTokens, Category);
+        memcpy(NewTokens, StartParser->Pos,
+            sizeof(struct LexTokenRecord) * NumTokens);
     } else {
         /* we're in interactive mode - add up line by line */
         for (pc->InteractiveCurrentLine = pc->InteractiveHead;
                 pc->InteractiveCurrentLine != NULL &&
                 (Pos < &pc->InteractiveCurrentLine->Tokens[0] ||
-                    Pos >= &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumBytes]);
+                    Pos >= &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumTokens]);
                 pc->InteractiveCurrentLine = pc->InteractiveCurrentLine->Next) {
         } /* find the line we just counted */
 
         if (EndParser->Pos >= StartParser->Pos &&
-                EndParser->Pos < &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumBytes]) {
+                EndParser->Pos < &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumTokens]) {
             /* all on a single line */
-            MemSize = EndParser->Pos - StartParser->Pos;
-            NewTokens = VariableAlloc(pc, StartParser, MemSize + TOKEN_DATA_OFFSET, true);
-            memcpy(NewTokens, (void*)StartParser->Pos, MemSize);
+            NumTokens = EndParser->Pos - StartParser->Pos;
+            NewTokens = LexAllocTokens(StartParser, NumTokens, Category);
+            memcpy(NewTokens, StartParser->Pos,
+                sizeof(struct LexTokenRecord) * NumTokens);
         } else {
-            /* it's spread across multiple lines */
-            MemSize = &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumBytes-TOKEN_DATA_OFFSET] - Pos;
+            /* it's spread across multiple lines, leave out each line's TokenEOF */
+            NumTokens = &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumTokens-1] - Pos;
 
             for (ILine = pc->InteractiveCurrentLine->Next;
                     ILine != NULL &&
-                    (EndParser->Pos < &ILine->Tokens[0] || EndParser->Pos >= &ILine->Tokens[ILine->NumBytes]);
+                    (EndParser->Pos < &ILine->Tokens[0] || EndParser->Pos >= &ILine->Tokens[ILine->NumTokens]);
                     ILine = ILine->Next)
-                MemSize += ILine->NumBytes - TOKEN_DATA_OFFSET;
+                NumTokens += ILine->NumTokens - 1;
 
             assert(ILine != NULL);
-            MemSize += EndParser->Pos - &ILine->Tokens[0];
-            NewTokens = VariableAlloc(pc, StartParser, MemSize + TOKEN_DATA_OFFSET, true);
+            NumTokens += EndParser->Pos - &ILine->Tokens[0];
+            NewTokens = LexAllocTokens(StartParser, NumTokens, Category);
 
-            CopySize = &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumBytes-TOKEN_DATA_OFFSET] - Pos;
-            memcpy(NewTokens, Pos, CopySize);
-            NewTokenPos = NewTokens + CopySize;
+            CopyTokens = &pc->InteractiveCurrentLine->Tokens[pc->InteractiveCurrentLine->NumTokens-1] - Pos;
+            memcpy(NewTokens, Pos, sizeof(struct LexTokenRecord) * CopyTokens);
+            NewTokenPos = NewTokens + CopyTokens;
             for (ILine = pc->InteractiveCurrentLine->Next; ILine != NULL &&
-                    (EndParser->Pos < &ILine->Tokens[0] || EndParser->Pos >= &ILine->Tokens[ILine->NumBytes]);
+                    (EndParser->Pos < &ILine->Tokens[0] || EndParser->Pos >= &ILine->Tokens[ILine->NumTokens]);
                     ILine = ILine->Next) {
-                memcpy(NewTokenPos, &ILine->Tokens[0], ILine->NumBytes - TOKEN_DATA_OFFSET);
-                NewTokenPos += ILine->NumBytes-TOKEN_DATA_OFFSET;
+                memcpy(NewTokenPos, &ILine->Tokens[0],
+                    sizeof(struct LexTokenRecord) * (ILine->NumTokens - 1));
+                NewTokenPos += ILine->NumTokens - 1;
             }
             assert(ILine != NULL);
-            memcpy(NewTokenPos, &ILine->Tokens[0], EndParser->Pos - &ILine->Tokens[0]);
+            memcpy(NewTokenPos, &ILine->Tokens[0],
+                sizeof(struct LexTokenRecord) * (EndParser->Pos - &ILine->Tokens[0]));
         }
     }
 
-    NewTokens[MemSize] = (unsigned char)TokenEndOfFunction;
+    NewTokens[NumTokens].Token = TokenEndOfFunction;
+    NewTokens[NumTokens].CharacterPos = EndParser->CharacterPos;
+    NewTokens[NumTokens].Line = EndParser->Line;
 
     return NewTokens;
 }
@@ -1117,6 +1243,8 @@ void LexInteractiveClear(Engine *pc, struct ParseState *Parser)
     while (pc->InteractiveHead != NULL) {
         struct TokenLine *NextLine = pc->InteractiveHead->Next;
 
+        ParseMacroCacheFree(pc, pc->InteractiveHead->Tokens,
+            pc->InteractiveHead->NumTokens);
         HeapFreeMem(pc, pc->InteractiveHead->Tokens);
         HeapFreeMem(pc, pc->InteractiveHead);
         pc->InteractiveHead = NextLine;
@@ -1126,6 +1254,8 @@ void LexInteractiveClear(Engine *pc, struct ParseState *Parser)
         Parser->Pos = NULL;
 
     pc->InteractiveTail = NULL;
+    pc->InteractiveHashIfLevel = 0;
+    pc->InteractiveHashIfEvaluateToLevel = 0;
 }
 
 /* indicate that we've completed up to this point in the interactive
@@ -1134,10 +1264,12 @@ void LexInteractiveCompleted(Engine *pc, struct ParseState *Parser)
 {
     while (pc->InteractiveHead != NULL &&
             !(Parser->Pos >= &pc->InteractiveHead->Tokens[0] &&
-                Parser->Pos < &pc->InteractiveHead->Tokens[pc->InteractiveHead->NumBytes])) {
+                Parser->Pos < &pc->InteractiveHead->Tokens[pc->InteractiveHead->NumTokens])) {
         /* this token line is no longer needed - free it */
         struct TokenLine *NextLine = pc->InteractiveHead->Next;
 
+        ParseMacroCacheFree(pc, pc->InteractiveHead->Tokens,
+            pc->InteractiveHead->NumTokens);
         HeapFreeMem(pc, pc->InteractiveHead->Tokens);
         HeapFreeMem(pc, pc->InteractiveHead);
         pc->InteractiveHead = NextLine;
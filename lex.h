@@ -108,20 +108,47 @@ enum LexToken {
     TokenEndOfFunction,
     TokenBackSlash
 };
+
+/* the value carried by identifier, string and constant tokens */
+union LexTokenValue {
+    char *Identifier;
+    void *Pointer;
+    long LongInteger;
+    double FP;
+    char Character;
+};
+
+/* a decoded token. every record has the same size so that fetching the
+    next token is just an array index */
+struct LexTokenRecord {
+    unsigned int Token : 8;             /* enum LexToken */
+    unsigned int CharacterPos : 24;     /* column the token starts at */
+    int Line;                           /* line the token starts on */
+    union LexTokenValue Value;          /* only used by tokens with a value */
+};
 void LexInit(Engine *pc);
 void LexCleanup(Engine *pc);
 void *LexAnalyse(Engine *pc, const char *FileName, const char *Source,
-    int SourceLen, int *TokenLen);
+    int SourceLen, int *NumTokens);
 void LexInitParser(struct ParseState *Parser, Engine *pc,
     const char *SourceText, void *TokenSource, char *FileName, int RunIt, int SetDebugMode);
 enum LexToken LexGetToken(struct ParseState *Parser, struct Value **Value,
     int IncPos);
+int LexHashDeferred(const struct LexTokenRecord *Include);
+int LexHashResolveDeferred(struct ParseState *Parser,
+    const struct LexTokenRecord *Include, struct LexTokenRecord *Tokens,
+    int NumTokens);
+void LexHashResume(struct ParseState *Parser,
+    const struct LexTokenRecord *Include);
 void LexToEndOfMacro(struct ParseState *Parser);
-void *LexCopyTokens(struct ParseState *StartParser, struct ParseState *EndParser);
+void *LexCopyTokens(struct ParseState *StartParser, struct ParseState *EndParser,
+    enum MemCategory Category);
 void LexInteractiveClear(Engine *pc, struct ParseState *Parser);
 void LexInteractiveCompleted(Engine *pc, struct ParseState *Parser);
 void LexInteractiveStatementPrompt(Engine *pc);
 void PrintLexToken(enum LexToken token);
 enum LexToken LexRawPeekToken(struct ParseState *Parser);
+enum LexToken LexPeekToken(struct ParseState *Parser, int Ahead,
+    struct Value **Value);
 
 #endif
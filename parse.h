@@ -11,21 +11,32 @@ typedef struct ValueType ValueType;
 /* Parser state */
 struct ParseState {
     Engine *pc;                         /* the itrapc instance */
-    const unsigned char *Pos;           /* character position in source */
+    const struct LexTokenRecord *Pos;   /* current token */
     char *FileName;                     /* file being executed */
-    short int Line;                     /* line number */
-    short int CharacterPos;             /* character/column in line */
+    int Line;                           /* line number */
+    int CharacterPos;                   /* character/column in line */
     enum RunMode Mode;                  /* whether to skip or run code */
     int SearchLabel;                    /* case label searching for */
     const char *SearchGotoLabel;        /* goto label searching for */
     const char *SourceText;             /* entire source text */
-    short int HashIfLevel;              /* nested #if level */
-    short int HashIfEvaluateToLevel;    /* last evaluated #if level */
     char DebugMode;                     /* debugging mode */
     int ScopeID;                        /* local variable scope tracking */
     int is_global;
 };
 
+/* just enough of a ParseState to back up over tokens read from it */
+typedef struct ParseCheckpoint {
+    const struct LexTokenRecord *Pos;   /* token to go back to */
+    int Line;
+    int CharacterPos;
+} ParseCheckpoint;
+
+/* these are macros since they're done for every token of an expression */
+#define ParserCheckpoint(Parser, Save) ((Save)->Pos = (Parser)->Pos, \
+    (Save)->Line = (Parser)->Line, (Save)->CharacterPos = (Parser)->CharacterPos)
+#define ParserRewind(Parser, Save) ((Parser)->Pos = (Save)->Pos, \
+    (Parser)->Line = (Save)->Line, (Parser)->CharacterPos = (Save)->CharacterPos)
+
 /* Result codes */
 enum ParseResult {
     ParseResultOk,
@@ -37,6 +48,8 @@ enum ParseResult {
 void EngineParse(Engine *pc, const char *FileName, const char *Source,
     int SourceLen, int RunIt, int CleanupNow, int CleanupSource,
     int EnableDebugger);
+void EngineParseTokens(Engine *pc, char *FileName, const char *Source,
+    const void *Tokens, int RunIt, int EnableDebugger);
 void EngineParseInteractive(Engine *pc);
 void EngineParseInteractiveNoStartPrompt(Engine *pc, int EnableDebugger);
 void ParseCleanup(Engine *pc);
@@ -56,6 +69,5 @@ int ParseCountParams(ParseState *Parser);
 
 /* Utility functions */
 void ParserCopy(ParseState *To, ParseState *From);
-void ParserCopyPos(ParseState *To, ParseState *From);
 
 #endif /* PARSE_H */
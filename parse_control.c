@@ -44,10 +44,10 @@ enum RunMode ParseBlock(ParseState *Parser, int AbsorbOpenBrace, int Condition)
 void ParseFor(ParseState *Parser)
 {
     int Condition;
-    ParseState PreConditional;
-    ParseState PreIncrement;
-    ParseState PreStatement;
-    ParseState After;
+    ParseCheckpoint PreConditional;
+    ParseCheckpoint PreIncrement;
+    ParseCheckpoint PreStatement;
+    ParseCheckpoint After;
     enum RunMode OldMode = Parser->Mode;
     int PrevScopeID = 0;
     int ScopeID = VariableScopeBegin(Parser, &PrevScopeID);
@@ -58,7 +58,7 @@ void ParseFor(ParseState *Parser)
     if (ParseStatement(Parser, true) != ParseResultOk)
         ProgramFail(Parser, "statement expected");
 
-    ParserCopyPos(&PreConditional, Parser);
+    ParserCheckpoint(Parser, &PreConditional);
     if (LexGetToken(Parser, NULL, false) == TokenSemicolon)
         Condition = true;
     else
@@ -67,33 +67,33 @@ void ParseFor(ParseState *Parser)
     if (LexGetToken(Parser, NULL, true) != TokenSemicolon)
         ProgramFail(Parser, "';' expected");
 
-    ParserCopyPos(&PreIncrement, Parser);
+    ParserCheckpoint(Parser, &PreIncrement);
     ParseStatementMaybeRun(Parser, false, false);
 
     if (LexGetToken(Parser, NULL, true) != TokenCloseParen)
         ProgramFail(Parser, "')' expected");
 
-    ParserCopyPos(&PreStatement, Parser);
+    ParserCheckpoint(Parser, &PreStatement);
     if (ParseStatementMaybeRun(Parser, Condition, true) != ParseResultOk)
         ProgramFail(Parser, "statement expected");
 
     if (Parser->Mode == RunModeContinue && OldMode == RunModeRun)
         Parser->Mode = RunModeRun;
 
-    ParserCopyPos(&After, Parser);
+    ParserCheckpoint(Parser, &After);
 
     while (Condition && Parser->Mode == RunModeRun) {
-        ParserCopyPos(Parser, &PreIncrement);
+        ParserRewind(Parser, &PreIncrement);
         ParseStatement(Parser, false);
 
-        ParserCopyPos(Parser, &PreConditional);
+        ParserRewind(Parser, &PreConditional);
         if (LexGetToken(Parser, NULL, false) == TokenSemicolon)
             Condition = true;
         else
             Condition = ExpressionParseInt(Parser);
 
         if (Condition) {
-            ParserCopyPos(Parser, &PreStatement);
+            ParserRewind(Parser, &PreStatement);
             ParseStatement(Parser, true);
 
             if (Parser->Mode == RunModeContinue)
@@ -105,7 +105,7 @@ void ParseFor(ParseState *Parser)
         Parser->Mode = RunModeRun;
 
     VariableScopeEnd(Parser, ScopeID, PrevScopeID);
-    ParserCopyPos(Parser, &After);
+    ParserRewind(Parser, &After);
 }
 
 /* parse an "if" statement */
@@ -134,16 +134,16 @@ void ParseIfStatement(ParseState *Parser)
 /* parse a "while" statement */
 void ParseWhileStatement(ParseState *Parser)
 {
-    struct ParseState PreConditional;
+    ParseCheckpoint PreConditional;
     enum RunMode PreMode = Parser->Mode;
     
     if (LexGetToken(Parser, NULL, true) != TokenOpenParen)
         ProgramFail(Parser, "'(' expected");
         
-    ParserCopyPos(&PreConditional, Parser);
+    ParserCheckpoint(Parser, &PreConditional);
     int Condition = 0;
     do {
-        ParserCopyPos(Parser, &PreConditional);
+        ParserRewind(Parser, &PreConditional);
         Condition = ExpressionParseInt(Parser);
         
         if (LexGetToken(Parser, NULL, true) != TokenCloseParen)
@@ -164,14 +164,14 @@ void ParseWhileStatement(ParseState *Parser)
 /* parse a "do-while" statement */
 void ParseDoWhileStatement(ParseState *Parser)
 {
-    struct ParseState PreStatement;
+    ParseCheckpoint PreStatement;
     enum RunMode PreMode = Parser->Mode;
     int Condition;
     
-    ParserCopyPos(&PreStatement, Parser);
+    ParserCheckpoint(Parser, &PreStatement);
     
     do {
-        ParserCopyPos(Parser, &PreStatement);
+        ParserRewind(Parser, &PreStatement);
         if (ParseStatement(Parser, true) != ParseResultOk)
             ProgramFail(Parser, "statement expected");
             
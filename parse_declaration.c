@@ -7,6 +7,50 @@
 #include "type.h"
 #include "parse_function.h"
 
+/* give an array declared without a size the size its initializer implies */
+static void ParseDeclarationSizeArray(ParseState *Parser, Value *NewVariable)
+{
+    ParseState CountParser;
+    Value *LexValue;
+    int NumElements;
+
+    ParserCopy(&CountParser, Parser);
+    CountParser.Mode = RunModeSkip;
+    switch (LexGetToken(&CountParser, &LexValue, true)) {
+    case TokenLeftBrace:
+        NumElements = ParseArrayInitializer(&CountParser, NewVariable, false);
+        break;
+    case TokenStringConstant:
+        NumElements = strlen((char*)LexValue->Val->Pointer) + 1;
+        break;
+    default:
+        return;
+    }
+
+    NewVariable->Typ = TypeGetMatching(Parser->pc, Parser,
+        NewVariable->Typ->FromType, NewVariable->Typ->Base, NumElements,
+        NewVariable->Typ->Identifier, true);
+    VariableRealloc(Parser, NewVariable, TypeSizeValue(NewVariable, false));
+}
+
+/* step over a global's initializer without running it. an engine which is
+    only defining the program, to share its parent's globals, just needs
+    each variable's size - the value is the parent's, and running the
+    initializer again would repeat anything it does */
+static void ParseDeclarationSkipAssignment(ParseState *Parser,
+    Value *NewVariable)
+{
+    enum RunMode OldMode = Parser->Mode;
+
+    if (NewVariable != NULL && NewVariable->Typ->Base == TypeArray &&
+            NewVariable->Typ->ArraySize == 0)
+        ParseDeclarationSizeArray(Parser, NewVariable);
+
+    Parser->Mode = RunModeSkip;
+    ParseDeclarationAssignment(Parser, NewVariable, false);
+    Parser->Mode = OldMode;
+}
+
 /* declare a variable or function */
 int ParseDeclaration(ParseState *Parser, enum LexToken Token)
 {
@@ -51,8 +95,11 @@ int ParseDeclaration(ParseState *Parser, enum LexToken Token)
                 if (LexGetToken(Parser, NULL, false) == TokenAssign) {
                     /* we're assigning an initial value */
                     LexGetToken(Parser, NULL, true);
-                    ParseDeclarationAssignment(Parser, NewVariable,
-                        !IsStatic || FirstVisit);
+                    if (pc->DefineOnly && pc->TopStackFrame == NULL)
+                        ParseDeclarationSkipAssignment(Parser, NewVariable);
+                    else
+                        ParseDeclarationAssignment(Parser, NewVariable,
+                            !IsStatic || FirstVisit);
                 }
             }
         }
@@ -5,6 +5,74 @@
 #include "heap.h"
 #include "platform.h"
 #include "table.h"
+#include "variable.h"
+#include "parse_macro.h"
+#include "tracer.h"
+#include "profile.h"
+
+/* does the next statement declare or define something */
+static int ParseIsDefinition(ParseState *Parser)
+{
+    Value *LexerValue;
+    Value *VarValue;
+
+    switch (LexGetToken(Parser, &LexerValue, false)) {
+    case TokenIntType:
+    case TokenShortType:
+    case TokenCharType:
+    case TokenLongType:
+    case TokenFloatType:
+    case TokenDoubleType:
+    case TokenVoidType:
+    case TokenStructType:
+    case TokenUnionType:
+    case TokenEnumType:
+    case TokenSignedType:
+    case TokenUnsignedType:
+    case TokenStaticType:
+    case TokenAutoType:
+    case TokenRegisterType:
+    case TokenExternType:
+    case TokenTypedef:
+    case TokenHashDefine:
+    case TokenHashInclude:
+    case TokenEOF:
+        return true;
+    case TokenIdentifier:
+        return VariableGetDefined(Parser->pc, Parser,
+            LexerValue->Val->Identifier, &VarValue) &&
+            VarValue->Typ->Base == Type_Type;
+    default:
+        return false;
+    }
+}
+
+/* run the top level of some tokens which have already been lexed.
+    they're only read, so they can be shared with other engines */
+void EngineParseTokens(Engine *pc, char *FileName, const char *Source,
+    const void *Tokens, int RunIt, int EnableDebugger)
+{
+    enum ParseResult Ok;
+    ParseState Parser;
+    struct StackGuard Guard;
+
+    LexInitParser(&Parser, pc, Source, (void *)Tokens, FileName, RunIt,
+        EnableDebugger);
+
+    HeapGuardBegin(pc, &Guard);
+    pc->ParseDepth++;
+    do {
+        if (pc->DefineOnly && !ParseIsDefinition(&Parser))
+            Ok = ParseStatementMaybeRun(&Parser, false, true);
+        else
+            Ok = ParseStatement(&Parser, true);
+    } while (Ok == ParseResultOk);
+    pc->ParseDepth--;
+    HeapGuardEnd(pc, &Guard);
+
+    if (Ok == ParseResultError)
+        ProgramFail(&Parser, "parse error");
+}
 
 /* quick scan a source file for definitions */
 void EngineParse(Engine *pc, const char *FileName, const char *Source,
@@ -12,19 +80,32 @@ void EngineParse(Engine *pc, const char *FileName, const char *Source,
     int EnableDebugger)
 {
     char *RegFileName = TableStrRegister(pc, FileName, strlen(FileName));
-    enum ParseResult Ok;
-    ParseState Parser;
     struct CleanupTokenNode *NewCleanupNode = 0;
 
-    void *Tokens = LexAnalyse(pc, RegFileName, Source, SourceLen, NULL);
+    void *Tokens;
+    int NumTokens;
+    int Startup = -1;
+
+    if (pc->Trace != NULL)
+        TraceBegin(pc, "lex", RegFileName);
+    if (pc->StartupTimer != NULL)
+        Startup = StartupBegin(pc, "lex", RegFileName);
+    Tokens = LexAnalyse(pc, RegFileName, Source, SourceLen, &NumTokens);
+    if (pc->StartupTimer != NULL)
+        StartupEnd(pc, Startup);
+    if (pc->Trace != NULL)
+        TraceEnd(pc);
 
     /* allocate a cleanup node so we can clean up the tokens later */
     if (!CleanupNow) {
-        NewCleanupNode = HeapAllocMem(pc, sizeof(struct CleanupTokenNode));
+        NewCleanupNode = HeapAllocMemIn(pc, sizeof(struct CleanupTokenNode),
+            MemTokens);
         if (NewCleanupNode == NULL)
             ProgramFailNoParser(pc, "(EngineParse) out of memory");
 
         NewCleanupNode->Tokens = Tokens;
+        NewCleanupNode->FileName = RegFileName;
+        NewCleanupNode->Included = pc->ParseDepth > 0;
         if (CleanupSource)
             NewCleanupNode->SourceText = Source;
         else
@@ -35,19 +116,21 @@ void EngineParse(Engine *pc, const char *FileName, const char *Source,
     }
 
     /* do the parsing */
-    LexInitParser(&Parser, pc, Source, Tokens, RegFileName, RunIt,
-        EnableDebugger);
-
-    do {
-        Ok = ParseStatement(&Parser, true);
-    } while (Ok == ParseResultOk);
-
-    if (Ok == ParseResultError)
-        ProgramFail(&Parser, "parse error");
+    if (pc->Trace != NULL)
+        TraceBegin(pc, "parse", RegFileName);
+    if (pc->StartupTimer != NULL)
+        Startup = StartupBegin(pc, "parse", RegFileName);
+    EngineParseTokens(pc, RegFileName, Source, Tokens, RunIt, EnableDebugger);
+    if (pc->StartupTimer != NULL)
+        StartupEnd(pc, Startup);
+    if (pc->Trace != NULL)
+        TraceEnd(pc);
 
     /* clean up */
-    if (CleanupNow)
+    if (CleanupNow) {
+        ParseMacroCacheFree(pc, Tokens, NumTokens);
         HeapFreeMem(pc, Tokens);
+    }
 }
 
 /* parse interactively */
@@ -55,9 +138,11 @@ void EngineParseInteractiveNoStartPrompt(Engine *pc, int EnableDebugger)
 {
     enum ParseResult Ok;
     ParseState Parser;
+    struct StackGuard Guard;
 
     LexInitParser(&Parser, pc, NULL, NULL, pc->StrEmpty, true, EnableDebugger);
     EnginePlatformSetExitPoint(pc);
+    HeapGuardBegin(pc, &Guard);     /* again after each error */
     LexInteractiveClear(pc, &Parser);
 
     do {
@@ -65,6 +150,7 @@ void EngineParseInteractiveNoStartPrompt(Engine *pc, int EnableDebugger)
         Ok = ParseStatement(&Parser, true);
         LexInteractiveCompleted(pc, &Parser);
     } while (Ok == ParseResultOk);
+    HeapGuardEnd(pc, &Guard);
 
     if (Ok == ParseResultError)
         ProgramFail(&Parser, "parse error");
@@ -76,12 +162,13 @@ void EngineParseInteractiveNoStartPrompt(Engine *pc, int EnableDebugger)
 void EngineParseInteractive(Engine *pc)
 {
     PlatformPrintf(pc->CStdOut, INTERACTIVE_PROMPT_START);
-    EngineParseInteractiveNoStartPrompt(pc, gEnableDebugger);
+    EngineParseInteractiveNoStartPrompt(pc, pc->EnableDebugger);
 }
 
 /* deallocate any memory */
 void ParseCleanup(Engine *pc)
 {
+    ParseMacroCacheClear(pc);
     while (pc->CleanupTokenList != NULL) {
         struct CleanupTokenNode *Next = pc->CleanupTokenList->Next;
 
@@ -99,13 +186,3 @@ void ParserCopy(ParseState *To, ParseState *From)
 {
     memcpy((void*)To, (void*)From, sizeof(*To));
 }
-
-/* copy where we're at in the parsing */
-void ParserCopyPos(ParseState *To, ParseState *From)
-{
-    To->Pos = From->Pos;
-    To->Line = From->Line;
-    To->HashIfLevel = From->HashIfLevel;
-    To->HashIfEvaluateToLevel = From->HashIfEvaluateToLevel;
-    To->CharacterPos = From->CharacterPos;
-}
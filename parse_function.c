@@ -5,6 +5,7 @@
 #include "table.h"
 #include "lex.h"
 #include "type.h"
+#include "heap.h"
 
 /* count the number of parameters to a function or macro */
 int ParseCountParams(ParseState *Parser)
@@ -139,7 +140,11 @@ Value *ParseFunctionDefinition(ParseState *Parser,
             ProgramFail(Parser, "function definition expected");
 
         FuncValue->Val->FuncDef.Body = FuncBody;
-        FuncValue->Val->FuncDef.Body.Pos = LexCopyTokens(&FuncBody, Parser);
+        if (!ProgramOwnsTokens(pc, FuncBody.Pos)) {
+            /* a source file's tokens can be freed once it's parsed */
+            FuncValue->Val->FuncDef.Body.Pos = LexCopyTokens(&FuncBody, Parser,
+                MemFunctions);
+        }
 
         /* check if function already in global table */
         ShowX(">Search: TableGet", "GlobalTable", Identifier, 0);
@@ -4,6 +4,8 @@
 #include "variable.h"
 #include "table.h"
 #include "lex.h"
+#include "heap.h"
+#include "include.h"
 
 /* parse a #define macro definition and store it for later */
 void ParseMacroDefinition(ParseState *Parser)
@@ -63,7 +65,7 @@ void ParseMacroDefinition(ParseState *Parser)
     MacroValue->Typ = &Parser->pc->MacroType;
     LexToEndOfMacro(Parser);
     MacroValue->Val->MacroDef.Body.Pos =
-        LexCopyTokens(&MacroValue->Val->MacroDef.Body, Parser);
+        LexCopyTokens(&MacroValue->Val->MacroDef.Body, Parser, MemMacros);
 
     if (!TableSet(Parser->pc, &Parser->pc->GlobalTable, MacroNameStr, MacroValue,
                 (char *)Parser->FileName, Parser->Line, Parser->CharacterPos))
@@ -73,8 +75,214 @@ void ParseMacroDefinition(ParseState *Parser)
 /* parse an #include statement */
 void ParseIncludeStatement(ParseState *Parser, Value **LexerValue)
 {
+    const struct LexTokenRecord *Include = Parser->Pos - 1;
+
     if (LexGetToken(Parser, LexerValue, true) != TokenStringConstant)
         ProgramFail(Parser, "\"filename.h\" expected");
     
     IncludeFile(Parser->pc, (char *)(*LexerValue)->Val->Pointer);
+
+    /* now the header's been read the #ifs after it can be resolved */
+    if (ProgramOwnsTokens(Parser->pc, Include))
+        ProgramHashResume(Parser, Include);
+    else
+        LexHashResume(Parser, Include);
+}
+
+/* find the end of a macro argument - a comma or close bracket which
+    isn't nested inside other brackets */
+static const struct LexTokenRecord *ParseMacroArgEnd(ParseState *Parser,
+    const struct LexTokenRecord *Pos)
+{
+    int Depth = 0;
+
+    for (;; Pos++) {
+        switch (Pos->Token) {
+        case TokenOpenParen:
+        case TokenLeftSquareBracket:
+        case TokenLeftBrace:
+            Depth++;
+            break;
+        case TokenCloseParen:
+            if (Depth == 0)
+                return Pos;
+            Depth--;
+            break;
+        case TokenRightSquareBracket:
+        case TokenRightBrace:
+            Depth--;
+            break;
+        case TokenComma:
+            if (Depth == 0)
+                return Pos;
+            break;
+        case TokenEOF:
+        case TokenEndOfFunction:
+            ProgramFail(Parser, "close bracket expected");
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+/* which parameter of a macro is this token? -1 if it isn't one */
+static int ParseMacroParamIndex(struct MacroDef *MDef,
+    const struct LexTokenRecord *Token)
+{
+    int Count;
+
+    if (Token->Token != TokenIdentifier)
+        return -1;
+
+    for (Count = 0; Count < MDef->NumParams; Count++) {
+        if (MDef->ParamName[Count] == Token->Value.Identifier)
+            return Count;
+    }
+
+    return -1;
+}
+
+/* expand a use of a macro by substituting the tokens of each argument for
+    its parameter in the body. the parser is positioned just after the macro
+    name, or after the open bracket if HasArgs. expansions are cached by call
+    site so a use inside a loop or function is only expanded once */
+struct MacroExpansion *ParseMacroExpand(ParseState *Parser,
+    const char *MacroName, struct MacroDef *MDef, int HasArgs)
+{
+    int ArgCount = 0;
+    int NumTokens = 0;
+    int Param;
+    Engine *pc = Parser->pc;
+    const struct LexTokenRecord *CallSite = Parser->Pos;
+    const struct LexTokenRecord *Pos = CallSite;
+    const struct LexTokenRecord *Body;
+    const struct LexTokenRecord **ArgStart = NULL;
+    const struct LexTokenRecord **ArgEnd = NULL;
+    struct LexTokenRecord *NewToken;
+    struct MacroExpansion *Expansion;
+    unsigned int Hash = (unsigned int)(((uintptr_t)CallSite /
+        sizeof(struct LexTokenRecord)) % MACRO_EXPANSION_TABLE_SIZE);
+
+    for (Expansion = pc->MacroExpansionHashTable[Hash]; Expansion != NULL;
+            Expansion = Expansion->Next) {
+        if (Expansion->CallSite == CallSite)
+            return Expansion;
+    }
+
+    if (MDef->Body.Pos == NULL)
+        ProgramFail(Parser, "'%s' is undefined", MacroName);
+
+    if (MDef->NumParams > 0) {
+        ArgStart = HeapAllocStack(pc,
+            sizeof(struct LexTokenRecord*) * MDef->NumParams * 2);
+        if (ArgStart == NULL)
+            ProgramFail(Parser, "(ParseMacroExpand) out of memory");
+        ArgEnd = &ArgStart[MDef->NumParams];
+    }
+
+    if (HasArgs) {
+        /* find the tokens of each argument */
+        if (Pos->Token == TokenCloseParen)
+            Pos++;
+        else {
+            const struct LexTokenRecord *End;
+
+            do {
+                End = ParseMacroArgEnd(Parser, Pos);
+                if (ArgCount >= MDef->NumParams)
+                    ProgramFail(Parser, "too many arguments to %s()", MacroName);
+
+                ArgStart[ArgCount] = Pos;
+                ArgEnd[ArgCount] = End;
+                ArgCount++;
+                Pos = End + 1;
+            } while (End->Token != TokenCloseParen);
+        }
+    }
+
+    if (ArgCount < MDef->NumParams)
+        ProgramFail(Parser, "not enough arguments to '%s'", MacroName);
+
+    /* substitute the arguments into a copy of the body */
+    for (Body = MDef->Body.Pos; Body->Token != TokenEndOfFunction; Body++) {
+        Param = ParseMacroParamIndex(MDef, Body);
+        NumTokens += Param >= 0 ? ArgEnd[Param] - ArgStart[Param] : 1;
+    }
+
+    Expansion = HeapAllocMemIn(pc, sizeof(struct MacroExpansion) +
+        sizeof(struct LexTokenRecord) * (NumTokens + 1), MemMacros);
+    if (Expansion == NULL)
+        ProgramFail(Parser, "(ParseMacroExpand) out of memory");
+
+    Expansion->CallSite = CallSite;
+    Expansion->Resume = Pos;
+    Expansion->Tokens = (struct LexTokenRecord*)(Expansion + 1);
+    Expansion->NumTokens = NumTokens;
+    NewToken = Expansion->Tokens;
+    for (Body = MDef->Body.Pos; Body->Token != TokenEndOfFunction; Body++) {
+        Param = ParseMacroParamIndex(MDef, Body);
+        if (Param >= 0) {
+            memcpy(NewToken, ArgStart[Param],
+                sizeof(struct LexTokenRecord) * (ArgEnd[Param] - ArgStart[Param]));
+            NewToken += ArgEnd[Param] - ArgStart[Param];
+        } else
+            *NewToken++ = *Body;
+    }
+    *NewToken = *Body;  /* the TokenEndOfFunction */
+
+    if (ArgStart != NULL)
+        HeapPopStack(pc, ArgStart,
+            sizeof(struct LexTokenRecord*) * MDef->NumParams * 2);
+
+    Expansion->Next = pc->MacroExpansionHashTable[Hash];
+    pc->MacroExpansionHashTable[Hash] = Expansion;
+
+    return Expansion;
+}
+
+/* forget the cached expansions of the macros used in some tokens which are
+    about to be freed, since the call sites they were keyed on may be reused.
+    macros used inside those expansions are forgotten too. expansions from
+    anywhere else may still be being parsed, so they're kept */
+void ParseMacroCacheFree(Engine *pc, const struct LexTokenRecord *Tokens,
+    int NumTokens)
+{
+    int Count;
+
+    for (Count = 0; Count < MACRO_EXPANSION_TABLE_SIZE; Count++) {
+        struct MacroExpansion **Link = &pc->MacroExpansionHashTable[Count];
+
+        while (*Link != NULL) {
+            struct MacroExpansion *Expansion = *Link;
+
+            if (Expansion->CallSite < Tokens ||
+                    Expansion->CallSite >= Tokens + NumTokens) {
+                Link = &Expansion->Next;
+                continue;
+            }
+
+            *Link = Expansion->Next;
+            ParseMacroCacheFree(pc, Expansion->Tokens, Expansion->NumTokens + 1);
+            HeapFreeMem(pc, Expansion);
+
+            /* that may have taken others out of this chain */
+            Link = &pc->MacroExpansionHashTable[Count];
+        }
+    }
+}
+
+/* forget all cached macro expansions, when all the tokens are freed */
+void ParseMacroCacheClear(Engine *pc)
+{
+    int Count;
+
+    for (Count = 0; Count < MACRO_EXPANSION_TABLE_SIZE; Count++) {
+        while (pc->MacroExpansionHashTable[Count] != NULL) {
+            struct MacroExpansion *Next = pc->MacroExpansionHashTable[Count]->Next;
+
+            HeapFreeMem(pc, pc->MacroExpansionHashTable[Count]);
+            pc->MacroExpansionHashTable[Count] = Next;
+        }
+    }
 }
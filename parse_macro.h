@@ -4,8 +4,16 @@
 
 #include "parse.h"
 
+struct MacroDef;
+struct MacroExpansion;
+
 /* Macro parsing */
 void ParseMacroDefinition(ParseState *Parser);
 void ParseIncludeStatement(ParseState *Parser, Value **LexerValue);
+struct MacroExpansion *ParseMacroExpand(ParseState *Parser,
+    const char *MacroName, struct MacroDef *MDef, int HasArgs);
+void ParseMacroCacheFree(Engine *pc, const struct LexTokenRecord *Tokens,
+    int NumTokens);
+void ParseMacroCacheClear(Engine *pc);
 
 #endif /* PARSE_MACRO_H */
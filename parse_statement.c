@@ -10,6 +10,8 @@
 #include "parse_declaration.h"
 #include "parse_control.h"
 #include "parse_macro.h"
+#include "profile.h"
+#include "probes.h"
 
 #ifdef DEBUGGER
 #include "debugger.h"
@@ -23,7 +25,7 @@ enum ParseResult ParseStatement(ParseState *Parser, int CheckTrailingSemicolon)
     Value *CValue = 0;
     Value *LexerValue = 0;
     Value *VarValue = 0;
-    ParseState PreState;
+    ParseCheckpoint PreState;
 
 #ifdef DEBUGGER
     /* if we're debugging, check for a breakpoint */
@@ -32,8 +34,23 @@ enum ParseResult ParseStatement(ParseState *Parser, int CheckTrailingSemicolon)
 #endif
 
     /* take note of where we are and then grab a token */
-    ParserCopy(&PreState, Parser);
+    ParserCheckpoint(Parser, &PreState);
     Token = LexGetToken(Parser, &LexerValue, true);
+#ifndef NO_STATS
+    if (Parser->Mode == RunModeRun)
+        Parser->pc->Stats.StatementsRun++;
+    else
+        Parser->pc->Stats.StatementsSkipped++;
+#endif
+
+#ifndef NO_LINE_PROFILE
+    /* if we're profiling, note this statement */
+    if (Parser->pc->ProfileStatements && Parser->Mode == RunModeRun &&
+            Token != TokenEOF)
+        ProfileStatement(Parser);
+#endif
+    if (Parser->Mode == RunModeRun)
+        PROBE_STATEMENT(Parser->FileName, Parser->Line);
 
     switch (Token) {
     case TokenEOF:
@@ -41,15 +58,15 @@ enum ParseResult ParseStatement(ParseState *Parser, int CheckTrailingSemicolon)
     case TokenDotDot:    
     case TokenScoper:    
         Parser->is_global = true;
+        ParserCheckpoint(Parser, &PreState);// eat scoper
         Token = LexGetToken(Parser, &LexerValue, true);
         if(Token != TokenIdentifier)
               ProgramFail(Parser, "Global variable '%s' not defined", LexerValue->Val->Identifier);
-        LexGetToken(&PreState, &LexerValue, true);// eat scoper
         // FALL THROUGH 
     case TokenIdentifier:
     {   if(VariableGetDefined(Parser->pc, Parser, LexerValue->Val->Identifier, &VarValue)){
             if (VarValue->Typ->Base == Type_Type) {
-                *Parser = PreState;
+                ParserRewind(Parser, &PreState);
                 ParseDeclaration(Parser, Token);
                 CheckTrailingSemicolon = false;
                 break;
@@ -73,7 +90,7 @@ enum ParseResult ParseStatement(ParseState *Parser, int CheckTrailingSemicolon)
     case TokenIncrement:
     case TokenDecrement:
     case TokenOpenParen:
-        *Parser = PreState;
+        ParserRewind(Parser, &PreState);
         ExpressionParse(Parser, &CValue);
         if (Parser->Mode == RunModeRun)
             VariableStackPop(Parser, CValue);
@@ -116,7 +133,7 @@ enum ParseResult ParseStatement(ParseState *Parser, int CheckTrailingSemicolon)
     case TokenAutoType:
     case TokenRegisterType:
     case TokenExternType:
-        *Parser = PreState;
+        ParserRewind(Parser, &PreState);
         CheckTrailingSemicolon = ParseDeclaration(Parser, Token);
         break;
     case TokenHashDefine:
@@ -160,7 +177,7 @@ enum ParseResult ParseStatement(ParseState *Parser, int CheckTrailingSemicolon)
         ParseDeleteStatement(Parser, &LexerValue, &CValue);
         break;
     default:
-        *Parser = PreState;
+        ParserRewind(Parser, &PreState);
         return ParseResultError;
     }
     if (CheckTrailingSemicolon) {
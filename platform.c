@@ -4,31 +4,52 @@
 #include "interpreter.h"
 #include "platform.h"
 #include "table.h"
+#include "profile.h"
+#include "include.h"
+#include "worker.h"
 
 static void PrintSourceTextErrorLine(IOFILE *Stream, const char *FileName,
         const char *SourceText, int Line, int CharacterPos);
 
-#ifdef DEBUGGER
-gEnableDebugger = true;
-#else
-gEnableDebugger = false;
-#endif
+/* run part of EngineInitialize(), noting how long it took for
+    --time-startup */
+#define INIT_PHASE(Phase, Call) do { \
+        long long PhaseStart = ProfileNow(); \
+        Call; \
+        pc->InitTime[Phase] = ProfileNow() - PhaseStart; \
+    } while (0)
 
 
-/* initialize everything */
+/* initialize everything. all of an engine's state is in *pc, so separate
+    engines can run on separate threads */
 void EngineInitialize(Engine *pc, int StackSize)
+{
+    EngineInitializeShared(pc, StackSize, NULL);
+}
+
+/* as EngineInitialize(), but any string StringOwner (or the engine it
+    shares strings with) already has is used instead of a copy of our own,
+    so we can run tokens StringOwner lexed. StringOwner mustn't run until
+    this returns, but it can after */
+void EngineInitializeShared(Engine *pc, int StackSize, Engine *StringOwner)
 {
     memset(pc, '\0', sizeof(*pc));
-    PlatformInit(pc);
-    BasicIOInit(pc);
-    HeapInit(pc, StackSize);
-    TableInit(pc);
-    VariableInit(pc);
-    LexInit(pc);
-    TypeInit(pc); /* initialize the type system */
-    IncludeInit(pc);
-    LibraryInit(pc);
-    PlatformLibraryInit(pc);
+    pc->StringOwner = StringOwner;
+    pc->StackSize = StackSize;
+    pc->InitStart = ProfileNow();
+#ifdef DEBUGGER
+    pc->EnableDebugger = true;
+#endif
+    INIT_PHASE(InitPlatform, PlatformInit(pc));
+    INIT_PHASE(InitBasicIO, BasicIOInit(pc));
+    INIT_PHASE(InitHeap, HeapInit(pc, StackSize));
+    INIT_PHASE(InitTable, TableInit(pc));
+    INIT_PHASE(InitVariable, VariableInit(pc));
+    INIT_PHASE(InitLex, LexInit(pc));
+    INIT_PHASE(InitType, TypeInit(pc)); /* initialize the type system */
+    INIT_PHASE(InitInclude, IncludeInit(pc));
+    INIT_PHASE(InitLibrary, LibraryInit(pc));
+    INIT_PHASE(InitPlatformLibrary, PlatformLibraryInit(pc));
 #ifdef DEBUGGER
     DebugInit(pc);
 #endif
@@ -37,18 +58,89 @@ void EngineInitialize(Engine *pc, int StackSize)
 /* free memory */
 void EngineCleanup(Engine *pc)
 {
+    WorkerPoolFree(pc);
+
+#if defined(UNIX_HOST) || defined(WIN32)
+    /* threads the program started which are still running use our memory,
+        so it's left for the process exit to free */
+    if (atomic_load(&pc->ThreadsRunning) > 0)
+        return;
+#endif
+
+    EngineWriteProfile(pc);
+    if (!pc->ArenaTeardown) {
+        /* free everything piece by piece. this isn't needed since
+            HeapCleanup() releases the whole heap, but it keeps the
+            allocation statistics honest */
 #ifdef DEBUGGER
-    DebugCleanup(pc);
+        DebugCleanup(pc);
 #endif
-    IncludeCleanup(pc);
-    ParseCleanup(pc);
-    LexCleanup(pc);
-    VariableCleanup(pc);
-    VarTypeMapCleanup(pc);
-    TypeCleanup(pc);
-    TableStrFree(pc);
+        IncludeCleanup(pc);
+        ParseCleanup(pc);
+        LexCleanup(pc);
+        VariableCleanup(pc);
+        VarTypeMapCleanup(pc);
+        TypeCleanup(pc);
+        TableStrFree(pc);
+    }
     HeapCleanup(pc);
     PlatformCleanup(pc);
+    if (pc->Program != NULL)
+        ProgramRelease(pc->Program);
+}
+
+/* send a program's output and error messages somewhere other than
+    stdout and stderr */
+void EngineSetOutput(Engine *pc, IOFILE *Out, IOFILE *Err)
+{
+    pc->CStdOut = Out;
+    pc->StdoutValue = Out;
+    pc->StderrValue = Err;
+}
+
+/* show how often a table was searched and how far along its chains */
+static void PrintTableStats(IOFILE *Stream, const char *Name,
+    unsigned long Searches, unsigned long Probes)
+{
+    fprintf(Stream, "tables: %-16s %12lu searches, %6.2f entries each\n", Name,
+        Searches, Searches > 0 ? (double)Probes / Searches : 0.0);
+}
+
+/* show what the interpreter has done so far */
+void EnginePrintStats(Engine *pc, IOFILE *Stream)
+{
+    struct EngineStats *Stats = &pc->Stats;
+    unsigned long LocalSearches = Stats->LocalSearches;
+    unsigned long LocalProbes = Stats->LocalProbes;
+    struct StackFrame *Frame;
+
+    for (Frame = pc->TopStackFrame; Frame != NULL;
+            Frame = Frame->PreviousStackFrame) {
+        LocalSearches += Frame->LocalTable.Searches;
+        LocalProbes += Frame->LocalTable.Probes;
+    }
+
+    fflush(pc->StdoutValue);
+#ifndef NO_STATS
+    fprintf(Stream, "tokens: %lu fetched, %lu of them peeks\n",
+        Stats->Tokens, Stats->TokenPeeks);
+    fprintf(Stream, "statements: %lu run, %lu skipped\n",
+        Stats->StatementsRun, Stats->StatementsSkipped);
+    fprintf(Stream, "calls: %lu functions, %lu macro expansions\n",
+        Stats->FunctionCalls, Stats->MacroExpansions);
+    PrintTableStats(Stream, "globals", pc->GlobalTable.Searches,
+        pc->GlobalTable.Probes);
+    PrintTableStats(Stream, "locals", LocalSearches, LocalProbes);
+    PrintTableStats(Stream, "reserved words", pc->ReservedWordTable.Searches,
+        pc->ReservedWordTable.Probes);
+    PrintTableStats(Stream, "string literals", pc->StringLiteralTable.Searches,
+        pc->StringLiteralTable.Probes);
+#endif
+    fprintf(Stream, "stack: %lu allocs, %lu bytes, %lu bytes peak\n",
+        pc->HeapStats.StackAllocs, pc->HeapStats.StackBytes,
+        pc->HeapStats.PeakStackBytes);
+    fprintf(Stream, "heap: %lu bytes asked for\n", pc->HeapStats.AllocBytes);
+    HeapPrintStats(pc, Stream);
 }
 
 /* platform-dependent code for running programs */
@@ -59,6 +151,21 @@ void EngineCleanup(Engine *pc)
 #define CALL_MAIN_NO_ARGS_RETURN_INT "__exit_value = main();"
 #define CALL_MAIN_WITH_ARGS_RETURN_INT "__exit_value = main(__argc,__argv);"
 
+/* define one of the variables main() is called with. if main()'s been
+    called before it's already defined, so point it at the new value */
+static void CallMainVar(Engine *pc, char *Ident, struct ValueType *Typ,
+    union AnyValue *FromValue, int IsWritable)
+{
+    char *RegIdent = TableStrRegister(pc, Ident, strlen(Ident));
+    struct Value *Var;
+
+    if (VariableDefined(pc, RegIdent)) {
+        VariableGet(pc, NULL, RegIdent, &Var);
+        Var->Val = FromValue;
+    } else
+        VariableDefinePlatformVar(pc, NULL, Ident, Typ, FromValue, IsWritable);
+}
+
 void EngineCallMain(Engine *pc, int argc, char **argv)
 {
     /* check if the program wants arguments */
@@ -71,35 +178,36 @@ void EngineCallMain(Engine *pc, int argc, char **argv)
     if (FuncValue->Typ->Base != TypeFunction)
         ProgramFailNoParser(pc, "main is not a function - can't call it");
 
+    StdErrnoThreadSetup(pc);
+
     if (FuncValue->Val->FuncDef.NumParams != 0) {
         /* define the arguments */
-        VariableDefinePlatformVar(pc, NULL, "__argc", &pc->IntType,
-            (union AnyValue*)&argc, false);
-        VariableDefinePlatformVar(pc, NULL, "__argv", pc->CharPtrPtrType,
-            (union AnyValue*)&argv, false);
+        CallMainVar(pc, "__argc", &pc->IntType, (union AnyValue*)&argc, false);
+        CallMainVar(pc, "__argv", pc->CharPtrPtrType, (union AnyValue*)&argv,
+            false);
     }
 
     if (FuncValue->Val->FuncDef.ReturnType == &pc->VoidType) {
         if (FuncValue->Val->FuncDef.NumParams == 0)
             EngineParse(pc, "startup", CALL_MAIN_NO_ARGS_RETURN_VOID,
                 strlen(CALL_MAIN_NO_ARGS_RETURN_VOID), true, true, false,
-                gEnableDebugger);
+                pc->EnableDebugger);
         else
             EngineParse(pc, "startup", CALL_MAIN_WITH_ARGS_RETURN_VOID,
                 strlen(CALL_MAIN_WITH_ARGS_RETURN_VOID), true, true, false,
-                gEnableDebugger);
+                pc->EnableDebugger);
     } else {
-        VariableDefinePlatformVar(pc, NULL, "__exit_value", &pc->IntType,
+        CallMainVar(pc, "__exit_value", &pc->IntType,
             (union AnyValue *)&pc->EngineExitValue, true);
 
         if (FuncValue->Val->FuncDef.NumParams == 0)
             EngineParse(pc, "startup", CALL_MAIN_NO_ARGS_RETURN_INT,
                 strlen(CALL_MAIN_NO_ARGS_RETURN_INT), true, true, false,
-                gEnableDebugger);
+                pc->EnableDebugger);
         else
             EngineParse(pc, "startup", CALL_MAIN_WITH_ARGS_RETURN_INT,
                 strlen(CALL_MAIN_WITH_ARGS_RETURN_INT), true, true, false,
-                gEnableDebugger);
+                pc->EnableDebugger);
     }
 }
 #endif
@@ -260,7 +368,7 @@ void PlatformVPrintf(IOFILE *Stream, const char *Format, va_list Args)
     }
 }
 
-/* make a new temporary name. takes a static buffer of char [7] as a parameter.
+/* make a new temporary name. takes a buffer of char [7] as a parameter.
  * should be initialized to "XX0000"
  * where XX can be any characters */
 char *PlatformMakeTempName(Engine *pc, char *TempNameBuffer)
@@ -13,6 +13,7 @@
 #include <setjmp.h>
 #include <math.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include "parse.h"
 #include "itrapc.h"
 
@@ -24,19 +25,34 @@
 #else
 # error ***** A platform must be explicitly defined! *****
 #endif
+
+/* engines on several threads. MSVC needs /experimental:c11atomics */
+#if defined(UNIX_HOST) || defined(WIN32)
+# include <stdatomic.h>
+#endif
 typedef FILE IOFILE;
-extern int gEnableDebugger;
 
 /* configurable options */
 /* select your host type (or do it in the Makefile):
  #define UNIX_HOST
  #define DEBUGGER
  #define USE_READLINE (defined by default for UNIX_HOST)
+ #define USE_MMAP_STACK (defined by default for UNIX_HOST)
+ #define USE_PROBES (defined by default for UNIX_HOST with <sys/sdt.h>,
+    unless NO_PROBES is defined)
  */
 #define USE_READLINE
+#define USE_MMAP_STACK
 
 #if defined(WIN32) /*(predefined on MSVC)*/
 #undef USE_READLINE
+#undef USE_MMAP_STACK
+#endif
+
+#if defined(UNIX_HOST) && !defined(NO_PROBES) && defined(__has_include)
+# if __has_include(<sys/sdt.h>)
+#  define USE_PROBES
+# endif
 #endif
 
 /* undocumented, but probably useful */
@@ -74,10 +90,18 @@ Mathematical properties - Primes minimize the chance that your hash function and
 #define VARIABLE_TYPE_TABLE_SIZE (HASH_PRIME) /* varialbe-type table size */
 #define STRING_LITERAL_TABLE_SIZE (HASH_PRIME) /* string literal table size */
 #define RESERVED_WORD_TABLE_SIZE (HASH_PRIME)  /* reserved word table size */
+#define MACRO_EXPANSION_TABLE_SIZE (HASH_PRIME) /* cached macro expansions */
 #define PARAMETER_MAX (16)     /* maximum number of parameters to a function */
 #define LINEBUFFER_MAX (256)   /* maximum number of characters on a line */
 #define LOCAL_TABLE_SIZE (11)  /* size of local variable table (can expand) */
+#define LOCAL_CHAIN_MAX (8)    /* locals kept in a plain list before hashing */
 #define STRUCT_TABLE_SIZE (11) /* size of struct/union member table (can expand) */
+#define HEAP_SLAB_SIZE (64*1024)    /* memory carved up for small heap allocations */
+#define HEAP_SIZE_CLASS (16)        /* small heap allocations are rounded up to this */
+#define FREELIST_BUCKETS (16)       /* freelists for 16, 32, 48 ... 256 byte allocs */
+#define HEAP_GUARD_SIZE (64*1024)   /* inaccessible space above a mmap()ed stack */
+#define HEAP_STACK_MIN (64*1024)    /* smallest stack tried if a bigger one can't be had */
+#define WORKER_STACK_SIZE_MAX (64*1024*1024) /* stack of each batch, parallel_for or thread engine */
 
 #ifdef _WIN32
 #define INTERACTIVE_PROMPT_START "starting " PROGRAM_NAME " " PROGRAM_VERSION " (Ctrl+C to quit)\n"
@@ -87,8 +111,6 @@ Mathematical properties - Primes minimize the chance that your hash function and
 #define INTERACTIVE_PROMPT_STATEMENT "> "
 #define INTERACTIVE_PROMPT_LINE "     > "
 
-extern jmp_buf ExitBuf;
-
 /* platform.h */
 /* the following are defined in engine.h:
  * void EngineCallMain(int argc, char **argv);
@@ -104,15 +126,23 @@ void AssignFail(struct ParseState *Parser, const char *Format,
     struct ValueType *Type1, struct ValueType *Type2, int Num1, int Num2,
     const char *FuncName, int ParamNo);
 void LexFail(Engine *pc, struct LexState *Lexer, const char *Message, ...);
+void EngineInitializeShared(Engine *pc, int StackSize, Engine *StringOwner);
 void PlatformInit(Engine *pc);
 void PlatformCleanup(Engine *pc);
+int PlatformBreakRequested(void);
 char *PlatformGetLine(char *Buf, int MaxLen, const char *Prompt);
 int PlatformGetCharacter();
 void PlatformPutc(unsigned char OutCh, union OutputStreamInfo *);
 void PlatformPrintf(IOFILE *Stream, const char *Format, ...);
 void PlatformVPrintf(IOFILE *Stream, const char *Format, va_list Args);
 void PlatformExit(Engine *pc, int ExitVal);
+char *PlatformReadFile(Engine *pc, const char *FileName);
 char *PlatformMakeTempName(Engine *pc, char *TempNameBuffer);
 void PlatformLibraryInit(Engine *pc);
 
+/* program.c */
+int ProgramOwnsTokens(Engine *pc, const void *Pos);
+void ProgramHashResume(struct ParseState *Parser,
+    const struct LexTokenRecord *Include);
+
 #endif /* PLATFORM_H */
@@ -1,14 +1,6 @@
 #include "../itrapc.h"
 #include "../interpreter.h"
-
-#ifdef DEBUGGER
-static int gEnableDebugger = true;
-#else
-static int gEnableDebugger = false;
-#endif
-
-/* mark where to end the program for platforms which require this */
-jmp_buf EngineExitBuf;
+#include "../heap.h"
 
 void PlatformInit(Engine *pc)
 {
@@ -18,6 +10,12 @@ void PlatformCleanup(Engine *pc)
 {
 }
 
+/* there's no break key here */
+int PlatformBreakRequested(void)
+{
+    return false;
+}
+
 /* get a line of interactive input */
 char *PlatformGetLine(char *Buf, int MaxLen, const char *Prompt)
 {
@@ -54,7 +52,7 @@ char *PlatformReadFile(Engine *pc, const char *FileName)
     if (stat(FileName, &FileInfo))
         ProgramFailNoParser(pc, "can't read file %s\n", FileName);
 
-    ReadText = malloc(FileInfo.st_size + 1);
+    ReadText = HeapAllocMemNoClear(pc, FileInfo.st_size + 1);
     if (ReadText == NULL)
         ProgramFailNoParser(pc, "out of memory\n");
 
@@ -83,13 +81,14 @@ void EnginePlatformScanFile(Engine *pc, const char *FileName)
 {
     char *SourceStr = PlatformReadFile(pc, FileName);
     EngineParse(pc, FileName, SourceStr, strlen(SourceStr), true, false, true,
-        gEnableDebugger);
+        pc->EnableDebugger);
 }
 
 /* exit the program */
 void PlatformExit(Engine *pc, int RetVal)
 {
     pc->EngineExitValue = RetVal;
+    pc->StackGuard = NULL;  /* where it was set up is being left */
     longjmp(pc->EngineExitBuf, 1);
 //    fflush(stdout);
 }
@@ -1,38 +1,41 @@
 #include "../picoc.h"
 #include "../interpreter.h"
+#include "../heap.h"
 
 #ifdef USE_READLINE
 #include <readline/readline.h>
 #include <readline/history.h>
 #endif
 
-#ifdef DEBUGGER
-static int gEnableDebugger = true;
-#else
-static int gEnableDebugger = false;
-#endif
-
-/* mark where to end the program for platforms which require this */
-jmp_buf PicocExitBuf;
-
 #ifdef DEBUGGER
 #include <signal.h>
 
-Picoc *break_pc = NULL;
+/* the break key goes to the whole process rather than to one engine, so
+    it's only noted here. the next engine to check a statement takes it */
+static volatile sig_atomic_t BreakRequested = false;
 
 static void BreakHandler(int Signal)
 {
-    break_pc->DebugManualBreak = true;
+    BreakRequested = true;
 }
 
 void PlatformInit(Picoc *pc)
 {
     /* capture the break signal and pass it to the debugger */
-    break_pc = pc;
     signal(SIGINT, BreakHandler);
 }
+
+int PlatformBreakRequested(void)
+{
+    if (!BreakRequested)
+        return false;
+
+    BreakRequested = false;
+    return true;
+}
 #else
 void PlatformInit(Picoc *pc) { }
+int PlatformBreakRequested(void) { return false; }
 #endif
 
 void PlatformCleanup(Picoc *pc) { }
@@ -91,7 +94,7 @@ char *PlatformReadFile(Picoc *pc, const char *FileName)
     if (stat(FileName, &FileInfo))
         ProgramFailNoParser(pc, "can't read file %s\n", FileName);
 
-    ReadText = malloc(FileInfo.st_size + 1);
+    ReadText = HeapAllocMemNoClear(pc, FileInfo.st_size + 1);
     if (ReadText == NULL)
         ProgramFailNoParser(pc, "out of memory\n");
 
@@ -127,13 +130,14 @@ void PicocPlatformScanFile(Picoc *pc, const char *FileName)
     }
 
     PicocParse(pc, FileName, SourceStr, strlen(SourceStr), true, false, true,
-        gEnableDebugger);
+        pc->EnableDebugger);
 }
 
 /* exit the program */
 void PlatformExit(Picoc *pc, int RetVal)
 {
     pc->PicocExitValue = RetVal;
+    pc->StackGuard = NULL;  /* where it was set up is being left */
     longjmp(pc->PicocExitBuf, 1);
 }
 
@@ -0,0 +1,38 @@
+/* probes.h - USDT tracepoints which bpftrace, perf and SystemTap can attach
+ * to as itrapc:function__entry and so on. each is a nop in the code until
+ * something attaches, so they're left in release builds */
+#ifndef PROBES_H
+#define PROBES_H
+
+#ifdef USE_PROBES
+#include <sys/sdt.h>
+
+/* a function's about to be called, from File at Line */
+#define PROBE_FUNCTION_ENTRY(FuncName, File, Line) \
+    DTRACE_PROBE3(itrapc, function__entry, FuncName, File, Line)
+
+/* it's returned */
+#define PROBE_FUNCTION_RETURN(FuncName, File, Line) \
+    DTRACE_PROBE3(itrapc, function__return, FuncName, File, Line)
+
+/* a statement's about to run */
+#define PROBE_STATEMENT(File, Line) \
+    DTRACE_PROBE2(itrapc, statement, File, Line)
+
+/* HeapAllocMem() returned Mem for Size bytes */
+#define PROBE_ALLOC(Mem, Size) \
+    DTRACE_PROBE2(itrapc, alloc, Mem, Size)
+
+/* HeapFreeMem() freed Mem, which held Size bytes */
+#define PROBE_FREE(Mem, Size) \
+    DTRACE_PROBE2(itrapc, free, Mem, Size)
+
+#else
+#define PROBE_FUNCTION_ENTRY(FuncName, File, Line) do { } while (0)
+#define PROBE_FUNCTION_RETURN(FuncName, File, Line) do { } while (0)
+#define PROBE_STATEMENT(File, Line) do { } while (0)
+#define PROBE_ALLOC(Mem, Size) do { } while (0)
+#define PROBE_FREE(Mem, Size) do { } while (0)
+#endif
+
+#endif /* PROBES_H */
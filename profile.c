@@ -0,0 +1,825 @@
+/* itrapc profilers. the function profiler counts and times every call of
+ * an interpreted or library function in a tree of the call stacks seen,
+ * which is written out as folded stacks for flamegraph.pl. the line
+ * profiler counts and times each statement by the line it starts on, and
+ * shows the source annotated with them. the sampler instead looks at the
+ * stack on a timer signal, which disturbs the program much less. all of
+ * them are written when the engine is cleaned up */
+
+#include "interpreter.h"
+#include "profile.h"
+#include "tracer.h"
+
+#include <time.h>
+#ifdef UNIX_HOST
+#include <errno.h>
+#include <signal.h>
+#include <sys/time.h>
+#endif
+
+#define SAMPLE_INTERVAL_US (1000)   /* how often the sampler looks */
+#define SAMPLE_DEPTH_MAX (128)      /* deepest stack a sample keeps */
+#define SAMPLE_BUFFER_SIZE (1 << 20) /* frames kept in all the samples */
+#define SAMPLE_REPORT_LINES (20)    /* hottest lines shown on stderr */
+
+/* a function called from a particular stack */
+struct ProfileNode {
+    const void *Key;                /* the function's value */
+    char *FuncName;
+    struct ProfileNode *Parent;
+    struct ProfileNode *Child;      /* the functions this one called */
+    struct ProfileNode *Sibling;
+    long Calls;
+    long long Inclusive;            /* nanoseconds, including callees */
+    long long Start;                /* when the running call began */
+};
+
+struct Profile {
+    char *FileName;                 /* where the folded stacks go */
+    struct ProfileNode Root;
+    struct ProfileNode *Current;    /* the function running now */
+};
+
+/* the statements run in one source file */
+struct LineProfileFile {
+    const char *Key;                /* the registered file name */
+    char *FileName;
+    int NumLines;
+    long *Hits;                     /* by line number */
+    long long *Time;
+    struct LineProfileFile *Next;
+};
+
+struct LineProfile {
+    struct LineProfileFile *Files;
+    struct LineProfileFile *LastFile;   /* where the last statement was */
+    int LastLine;
+    long long LastTime;             /* and when it started */
+};
+
+/* a function and the line in it, as seen by the sampler. each sample is
+    a header with a NULL FuncName and the number of frames as its Line,
+    followed by the frames from the innermost out */
+struct SampleFrame {
+    const char *FuncName;
+    int Line;
+};
+
+/* how many samples were taken on a line */
+struct SampleCount {
+    const char *FuncName;
+    int Line;
+    int Count;
+};
+
+struct Sampler {
+    char *FileName;                 /* where the folded stacks go */
+    struct SampleFrame *Frame;      /* SAMPLE_BUFFER_SIZE of them */
+    int Used;
+    int Samples;
+    int Dropped;                    /* samples there was no room for */
+#ifdef UNIX_HOST
+    struct sigaction OldAction;
+#endif
+};
+
+/* one function's totals over all the stacks it was called from */
+struct ProfileTotal {
+    const char *FuncName;
+    long Calls;
+    long long Inclusive;
+    long long Self;
+};
+
+/* nanoseconds since some fixed point. the clock is monotonic where
+    there's one, so setting the time of day doesn't upset a measurement */
+long long ProfileNow(void)
+{
+    struct timespec Now;
+
+#if defined(CLOCK_MONOTONIC)
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+#elif defined(TIME_MONOTONIC)
+    timespec_get(&Now, TIME_MONOTONIC);
+#else
+    timespec_get(&Now, TIME_UTC);
+#endif
+    return Now.tv_sec * 1000000000LL + Now.tv_nsec;
+}
+
+/* profile this engine's function calls, writing the folded stacks to
+    FileName when it's cleaned up */
+void EngineSetProfile(Engine *pc, const char *FileName)
+{
+    struct Profile *Prof = calloc(1, sizeof(struct Profile));
+
+    if (Prof == NULL || (Prof->FileName = strdup(FileName)) == NULL) {
+        free(Prof);
+        fprintf(stderr, "can't profile: out of memory\n");
+        return;
+    }
+
+    Prof->Current = &Prof->Root;
+    pc->Profile = Prof;
+}
+
+/* a function's about to be called */
+void ProfileEnter(Engine *pc, const void *Key, const char *FuncName)
+{
+    struct Profile *Prof = pc->Profile;
+    struct ProfileNode *Parent = Prof->Current;
+    struct ProfileNode **Link;
+    struct ProfileNode *Node;
+
+    for (Link = &Parent->Child; *Link != NULL; Link = &(*Link)->Sibling) {
+        if ((*Link)->Key == Key)
+            break;
+    }
+
+    Node = *Link;
+    if (Node == NULL) {
+        Node = calloc(1, sizeof(struct ProfileNode));
+        if (Node == NULL || (Node->FuncName = strdup(FuncName)) == NULL) {
+            free(Node);
+            ProgramFailNoParser(pc, "(ProfileEnter) out of memory");
+        }
+
+        Node->Key = Key;
+        Node->Parent = Parent;
+    } else {
+        /* keep the busiest callees at the front */
+        *Link = Node->Sibling;
+    }
+
+    Node->Sibling = Parent->Child;
+    Parent->Child = Node;
+    Node->Calls++;
+    Prof->Current = Node;
+    Node->Start = ProfileNow();
+}
+
+/* the function last entered has returned */
+void ProfileLeave(Engine *pc)
+{
+    struct Profile *Prof = pc->Profile;
+    struct ProfileNode *Node = Prof->Current;
+
+    Node->Inclusive += ProfileNow() - Node->Start;
+    Prof->Current = Node->Parent;
+}
+
+/* how long a node spent in its own code */
+static long long ProfileSelf(struct ProfileNode *Node)
+{
+    long long Self = Node->Inclusive;
+    struct ProfileNode *Child;
+
+    for (Child = Node->Child; Child != NULL; Child = Child->Sibling)
+        Self -= Child->Inclusive;
+
+    return Self > 0 ? Self : 0;
+}
+
+/* write a line for this node and each of its callees, in microseconds */
+static void ProfileWriteFolded(FILE *Out, struct ProfileNode *Node,
+    struct ProfileNode **Path, int Depth)
+{
+    struct ProfileNode *Child;
+    long long Self = ProfileSelf(Node) / 1000;
+    int Count;
+
+    Path[Depth++] = Node;
+    if (Self > 0) {
+        for (Count = 0; Count < Depth; Count++)
+            fprintf(Out, "%s%s", Count > 0 ? ";" : "", Path[Count]->FuncName);
+
+        fprintf(Out, " %lld\n", Self);
+    }
+
+    for (Child = Node->Child; Child != NULL; Child = Child->Sibling)
+        ProfileWriteFolded(Out, Child, Path, Depth);
+}
+
+/* add a node and its callees to the per-function totals. a recursive
+    call's time is already in its outermost call's inclusive time */
+static int ProfileAddTotals(struct ProfileNode *Node, struct ProfileTotal *Total,
+    int NumTotals)
+{
+    struct ProfileNode *Child;
+    struct ProfileNode *Caller;
+    int Count;
+
+    for (Count = 0; Count < NumTotals; Count++) {
+        if (strcmp(Total[Count].FuncName, Node->FuncName) == 0)
+            break;
+    }
+
+    if (Count == NumTotals) {
+        Total[Count].FuncName = Node->FuncName;
+        NumTotals++;
+    }
+
+    Total[Count].Calls += Node->Calls;
+    Total[Count].Self += ProfileSelf(Node);
+    for (Caller = Node->Parent; Caller->Parent != NULL; Caller = Caller->Parent) {
+        if (strcmp(Caller->FuncName, Node->FuncName) == 0)
+            break;
+    }
+
+    if (Caller->Parent == NULL)
+        Total[Count].Inclusive += Node->Inclusive;
+
+    for (Child = Node->Child; Child != NULL; Child = Child->Sibling)
+        NumTotals = ProfileAddTotals(Child, Total, NumTotals);
+
+    return NumTotals;
+}
+
+static int ProfileCompareTotals(const void *A, const void *B)
+{
+    long long SelfA = ((const struct ProfileTotal*)A)->Self;
+    long long SelfB = ((const struct ProfileTotal*)B)->Self;
+
+    return SelfA < SelfB ? 1 : SelfA > SelfB ? -1 : 0;
+}
+
+/* count the nodes under this one, and how deep they go */
+static int ProfileCountNodes(struct ProfileNode *Node, int Depth, int *MaxDepth)
+{
+    struct ProfileNode *Child;
+    int Count = 1;
+
+    if (Depth > *MaxDepth)
+        *MaxDepth = Depth;
+
+    for (Child = Node->Child; Child != NULL; Child = Child->Sibling)
+        Count += ProfileCountNodes(Child, Depth + 1, MaxDepth);
+
+    return Count;
+}
+
+static void ProfileFreeNodes(struct ProfileNode *Node)
+{
+    struct ProfileNode *Child;
+    struct ProfileNode *Next;
+
+    for (Child = Node->Child; Child != NULL; Child = Next) {
+        Next = Child->Sibling;
+        ProfileFreeNodes(Child);
+        free(Child->FuncName);
+        free(Child);
+    }
+}
+
+/* write the folded stacks and a summary of each function on stderr */
+static void ProfileWrite(Engine *pc, struct Profile *Prof)
+{
+    struct ProfileNode *Child;
+    struct ProfileNode **Path;
+    struct ProfileTotal *Total;
+    int MaxDepth = 0;
+    int NumNodes = ProfileCountNodes(&Prof->Root, 0, &MaxDepth);
+    int NumTotals = 0;
+    int Count;
+    FILE *Out = fopen(Prof->FileName, "w");
+
+    if (Out == NULL) {
+        fprintf(stderr, "can't write profile %s\n", Prof->FileName);
+        return;
+    }
+
+    Path = malloc(sizeof(struct ProfileNode*) * (MaxDepth + 1));
+    Total = calloc(NumNodes, sizeof(struct ProfileTotal));
+    if (Path == NULL || Total == NULL) {
+        fprintf(stderr, "can't write profile %s\n", Prof->FileName);
+        fclose(Out);
+        free(Path);
+        free(Total);
+        return;
+    }
+
+    for (Child = Prof->Root.Child; Child != NULL; Child = Child->Sibling) {
+        ProfileWriteFolded(Out, Child, Path, 0);
+        NumTotals = ProfileAddTotals(Child, Total, NumTotals);
+    }
+
+    fclose(Out);
+    qsort(Total, NumTotals, sizeof(struct ProfileTotal), ProfileCompareTotals);
+    fflush(pc->StdoutValue);
+    fprintf(stderr, "%-24s %10s %12s %12s\n", "function", "calls",
+        "total ms", "self ms");
+    for (Count = 0; Count < NumTotals; Count++)
+        fprintf(stderr, "%-24s %10ld %12.3f %12.3f\n", Total[Count].FuncName,
+            Total[Count].Calls, Total[Count].Inclusive / 1e6,
+            Total[Count].Self / 1e6);
+
+    free(Path);
+    free(Total);
+}
+
+/* write out and free a profile. calls which never returned, because the
+    program failed or exit()ed, are timed up to now */
+void ProfileCleanup(Engine *pc, struct Profile *Prof)
+{
+    long long Now = ProfileNow();
+    struct ProfileNode *Node;
+
+    for (Node = Prof->Current; Node != &Prof->Root; Node = Node->Parent)
+        Node->Inclusive += Now - Node->Start;
+
+    Prof->Current = &Prof->Root;
+    ProfileWrite(pc, Prof);
+    ProfileFreeNodes(&Prof->Root);
+    free(Prof->FileName);
+    free(Prof);
+}
+
+/* count and time the statements this engine runs, showing them against
+    the source when it's cleaned up */
+void EngineSetLineProfile(Engine *pc)
+{
+    pc->LineProfile = calloc(1, sizeof(struct LineProfile));
+    if (pc->LineProfile == NULL)
+        fprintf(stderr, "can't profile: out of memory\n");
+    else
+        pc->ProfileStatements = true;
+}
+
+/* find a file's counts, adding it if it's new */
+static struct LineProfileFile *LineProfileFind(Engine *pc, const char *FileName)
+{
+    struct LineProfile *Prof = pc->LineProfile;
+    struct LineProfileFile *File;
+
+    for (File = Prof->Files; File != NULL; File = File->Next) {
+        if (File->Key == FileName)
+            return File;
+    }
+
+    File = calloc(1, sizeof(struct LineProfileFile));
+    if (File == NULL || (File->FileName = strdup(FileName)) == NULL) {
+        free(File);
+        ProgramFailNoParser(pc, "(LineProfileFind) out of memory");
+    }
+
+    File->Key = FileName;
+    File->Next = Prof->Files;
+    Prof->Files = File;
+    return File;
+}
+
+/* a statement's about to run. the time from one statement starting to
+    the next goes to the first one */
+static void LineProfileStatement(struct ParseState *Parser)
+{
+    struct LineProfile *Prof = Parser->pc->LineProfile;
+    struct LineProfileFile *File = Prof->LastFile;
+    long long Now = ProfileNow();
+    int Line = Parser->Line;
+
+    if (File != NULL)
+        File->Time[Prof->LastLine] += Now - Prof->LastTime;
+
+    if (File == NULL || File->Key != Parser->FileName)
+        File = LineProfileFind(Parser->pc, Parser->FileName);
+
+    if (Line >= File->NumLines) {
+        int NumLines = File->NumLines > 0 ? File->NumLines : 64;
+        long *Hits;
+        long long *Time;
+
+        while (NumLines <= Line)
+            NumLines *= 2;
+
+        Hits = realloc(File->Hits, sizeof(long) * NumLines);
+        if (Hits != NULL)
+            File->Hits = Hits;
+        Time = realloc(File->Time, sizeof(long long) * NumLines);
+        if (Time != NULL)
+            File->Time = Time;
+        if (Hits == NULL || Time == NULL)
+            ProgramFailNoParser(Parser->pc, "(LineProfileStatement) out of memory");
+
+        memset(&Hits[File->NumLines], '\0',
+            sizeof(long) * (NumLines - File->NumLines));
+        memset(&Time[File->NumLines], '\0',
+            sizeof(long long) * (NumLines - File->NumLines));
+        File->NumLines = NumLines;
+    }
+
+    File->Hits[Line]++;
+    Prof->LastFile = File;
+    Prof->LastLine = Line;
+    Prof->LastTime = Now;
+}
+
+/* a statement's about to run */
+void ProfileStatement(struct ParseState *Parser)
+{
+    Engine *pc = Parser->pc;
+
+    pc->SampleLine = Parser->Line;
+    if (pc->LineProfile != NULL)
+        LineProfileStatement(Parser);
+}
+
+/* show a file's lines with how often and for how long they ran. if the
+    source can't be read just the lines which ran are shown */
+static void LineProfileWriteFile(struct LineProfileFile *File)
+{
+    FILE *Source = fopen(File->FileName, "r");
+    long Statements = 0;
+    long long Time = 0;
+    int Line;
+
+    for (Line = 0; Line < File->NumLines; Line++) {
+        Statements += File->Hits[Line];
+        Time += File->Time[Line];
+    }
+
+    fprintf(stderr, "%s: %ld statements, %.3f ms\n%10s %10s %6s\n",
+        File->FileName, Statements, Time / 1e6, "hits", "ms", "line");
+    for (Line = 1; Source != NULL || Line < File->NumLines; Line++) {
+        int Ran = Line < File->NumLines && File->Hits[Line] > 0;
+        int Char;
+
+        if (Source != NULL && (Char = fgetc(Source)) == EOF) {
+            fclose(Source);
+            Source = NULL;
+        }
+
+        if (Source == NULL && !Ran)
+            continue;
+
+        if (Ran)
+            fprintf(stderr, "%10ld %10.3f %6d: ", File->Hits[Line],
+                File->Time[Line] / 1e6, Line);
+        else
+            fprintf(stderr, "%10s %10s %6d: ", "-", "-", Line);
+
+        if (Source != NULL) {
+            for (; Char != EOF && Char != '\n'; Char = fgetc(Source))
+                fputc(Char, stderr);
+        }
+
+        fputc('\n', stderr);
+    }
+}
+
+static void LineProfileCleanup(Engine *pc, struct LineProfile *Prof)
+{
+    struct LineProfileFile *File;
+    struct LineProfileFile *Next;
+
+    if (Prof->LastFile != NULL)
+        Prof->LastFile->Time[Prof->LastLine] += ProfileNow() - Prof->LastTime;
+
+    fflush(pc->StdoutValue);
+    for (File = Prof->Files; File != NULL; File = Next) {
+        Next = File->Next;
+        LineProfileWriteFile(File);
+        free(File->FileName);
+        free(File->Hits);
+        free(File->Time);
+        free(File);
+    }
+
+    free(Prof);
+}
+
+#ifdef UNIX_HOST
+/* the engine running on this thread which is being sampled */
+static _Thread_local Engine *SampleEngine;
+
+/* the timer's process-wide, so SIGPROF also lands on other threads while
+    they use the processor. those samples can't be taken, but they're
+    counted so the report can say how much it missed */
+static atomic_int SampleElsewhere;
+
+/* record where we are. this runs in a signal handler, so it only reads
+    the stack frames and writes to memory allocated beforehand */
+static void SampleSignal(int Signal)
+{
+    Engine *pc = SampleEngine;
+    struct Sampler *S;
+    struct StackFrame *Frame;
+    struct SampleFrame *Out;
+    int Depth = 0;
+    int Line;
+
+    /* SIGPROF can arrive on any thread, but only this one's stack can be
+        safely looked at */
+    if (pc == NULL || (S = pc->Sampler) == NULL) {
+        atomic_fetch_add_explicit(&SampleElsewhere, 1, memory_order_relaxed);
+        return;
+    }
+
+    if (S->Used + 1 + SAMPLE_DEPTH_MAX > SAMPLE_BUFFER_SIZE) {
+        S->Dropped++;
+        return;
+    }
+
+    Out = &S->Frame[S->Used + 1];
+    Line = pc->SampleLine;
+    for (Frame = pc->TopStackFrame; Frame != NULL && Depth < SAMPLE_DEPTH_MAX;
+            Frame = Frame->PreviousStackFrame) {
+        Out[Depth].FuncName = Frame->FuncName;
+        Out[Depth].Line = Line;
+        Line = Frame->ReturnPos != NULL ? Frame->ReturnPos->Line : 0;
+        Depth++;
+    }
+
+    if (Depth == 0) {
+        /* a script's top level statements */
+        Out[0].FuncName = "(top level)";
+        Out[0].Line = Line;
+        Depth = 1;
+    }
+
+    S->Frame[S->Used].FuncName = NULL;
+    S->Frame[S->Used].Line = Depth;
+    S->Used += 1 + Depth;
+    S->Samples++;
+}
+
+/* sample this engine's stack every millisecond of processor time it uses,
+    writing folded stacks to FileName when it's cleaned up. only the thread
+    which calls this is sampled */
+void EngineStartSampling(Engine *pc, const char *FileName)
+{
+    struct Sampler *S = calloc(1, sizeof(struct Sampler));
+    struct sigaction Action;
+    struct itimerval Timer;
+
+    if (S == NULL || (S->FileName = strdup(FileName)) == NULL ||
+            (S->Frame = malloc(sizeof(struct SampleFrame) *
+                SAMPLE_BUFFER_SIZE)) == NULL) {
+        if (S != NULL)
+            free(S->FileName);
+        free(S);
+        fprintf(stderr, "can't sample: out of memory\n");
+        return;
+    }
+
+    pc->Sampler = S;
+    pc->ProfileStatements = true;
+    SampleEngine = pc;
+    atomic_store(&SampleElsewhere, 0);
+    memset(&Action, '\0', sizeof(Action));
+    Action.sa_handler = SampleSignal;
+    Action.sa_flags = SA_RESTART;
+    sigemptyset(&Action.sa_mask);
+    sigaction(SIGPROF, &Action, &S->OldAction);
+
+    Timer.it_interval.tv_sec = 0;
+    Timer.it_interval.tv_usec = SAMPLE_INTERVAL_US;
+    Timer.it_value = Timer.it_interval;
+    if (setitimer(ITIMER_PROF, &Timer, NULL) != 0)
+        fprintf(stderr, "can't sample: %s\n", strerror(errno));
+}
+
+/* write a sample's frames outermost first, as "func:line;func:line" */
+static char *SampleFolded(struct SampleFrame *Header)
+{
+    int Depth = Header->Line;
+    int Len = 0;
+    int Count;
+    char *Folded;
+
+    for (Count = 1; Count <= Depth; Count++)
+        Len += strlen(Header[Count].FuncName) + 13;
+
+    Folded = malloc(Len + 1);
+    if (Folded == NULL)
+        return NULL;
+
+    Len = 0;
+    for (Count = Depth; Count >= 1; Count--)
+        Len += sprintf(&Folded[Len], "%s%s:%d", Count < Depth ? ";" : "",
+            Header[Count].FuncName, Header[Count].Line);
+
+    return Folded;
+}
+
+static int SampleCompareStrings(const void *A, const void *B)
+{
+    return strcmp(*(char *const *)A, *(char *const *)B);
+}
+
+/* the innermost frames, ordered so the same lines are together */
+static int SampleCompareFrames(const void *A, const void *B)
+{
+    const struct SampleCount *CountA = A;
+    const struct SampleCount *CountB = B;
+    int Order = strcmp(CountA->FuncName, CountB->FuncName);
+
+    return Order != 0 ? Order : CountA->Line - CountB->Line;
+}
+
+/* the lines with the most samples first */
+static int SampleCompareCounts(const void *A, const void *B)
+{
+    return ((const struct SampleCount*)B)->Count -
+        ((const struct SampleCount*)A)->Count;
+}
+
+/* write the folded stacks and the hottest lines on stderr */
+static void SamplerWrite(Engine *pc, struct Sampler *S)
+{
+    char **Stack = malloc(sizeof(char*) * (S->Samples + 1));
+    struct SampleCount *Leaf = malloc(sizeof(struct SampleCount) *
+        (S->Samples + 1));
+    int NumStacks = 0;
+    int NumLeaves = 0;
+    int Count;
+    int Pos;
+    FILE *Out = fopen(S->FileName, "w");
+
+    if (Stack == NULL || Leaf == NULL || Out == NULL) {
+        fprintf(stderr, "can't write profile %s\n", S->FileName);
+        if (Out != NULL)
+            fclose(Out);
+        free(Stack);
+        free(Leaf);
+        return;
+    }
+
+    for (Pos = 0; Pos < S->Used; Pos += 1 + S->Frame[Pos].Line) {
+        Stack[NumStacks] = SampleFolded(&S->Frame[Pos]);
+        if (Stack[NumStacks] != NULL)
+            NumStacks++;
+
+        Leaf[NumLeaves].FuncName = S->Frame[Pos + 1].FuncName;
+        Leaf[NumLeaves].Line = S->Frame[Pos + 1].Line;
+        Leaf[NumLeaves++].Count = 1;
+    }
+
+    /* count the same stacks together */
+    qsort(Stack, NumStacks, sizeof(char*), SampleCompareStrings);
+    for (Pos = 0; Pos < NumStacks; Pos += Count) {
+        for (Count = 1; Pos + Count < NumStacks &&
+                strcmp(Stack[Pos], Stack[Pos + Count]) == 0; Count++)
+            free(Stack[Pos + Count]);
+
+        fprintf(Out, "%s %d\n", Stack[Pos], Count);
+        free(Stack[Pos]);
+    }
+    fclose(Out);
+
+    /* and the same innermost lines */
+    qsort(Leaf, NumLeaves, sizeof(struct SampleCount), SampleCompareFrames);
+    for (Pos = 0, Count = 0; Pos < NumLeaves; Count++) {
+        Leaf[Count] = Leaf[Pos++];
+        while (Pos < NumLeaves && SampleCompareFrames(&Leaf[Count], &Leaf[Pos]) == 0)
+            Leaf[Count].Count += Leaf[Pos++].Count;
+    }
+
+    NumLeaves = Count;
+    qsort(Leaf, NumLeaves, sizeof(struct SampleCount), SampleCompareCounts);
+    fflush(pc->StdoutValue);
+    fprintf(stderr, "%d samples, %d dropped, %d on other threads not taken\n"
+        "%10s %6s  %s\n", S->Samples, S->Dropped, atomic_load(&SampleElsewhere),
+        "samples", "%", "line");
+    for (Count = 0; Count < NumLeaves && Count < SAMPLE_REPORT_LINES; Count++)
+        fprintf(stderr, "%10d %6.1f  %s:%d\n", Leaf[Count].Count,
+            Leaf[Count].Count * 100.0 / S->Samples, Leaf[Count].FuncName,
+            Leaf[Count].Line);
+
+    free(Stack);
+    free(Leaf);
+}
+
+/* stop sampling, and write and free the samples */
+static void SamplerCleanup(Engine *pc, struct Sampler *S)
+{
+    struct itimerval Timer;
+
+    memset(&Timer, '\0', sizeof(Timer));
+    setitimer(ITIMER_PROF, &Timer, NULL);
+    sigaction(SIGPROF, &S->OldAction, NULL);
+    SampleEngine = NULL;
+    SamplerWrite(pc, S);
+    free(S->Frame);
+    free(S->FileName);
+    free(S);
+}
+#endif
+
+#define STARTUP_SPANS_MAX 256      /* includes and files timed */
+
+static const char *InitPhaseName[InitPhases] = {
+    "PlatformInit", "BasicIOInit", "HeapInit", "TableInit", "VariableInit",
+    "LexInit", "TypeInit", "IncludeInit", "LibraryInit", "PlatformLibraryInit"
+};
+
+/* an include, or a file being lexed or parsed */
+struct StartupSpan {
+    const char *What;
+    const char *Name;
+    int Depth;                      /* how many spans it's inside */
+    long long Time;                 /* or -1 if it hasn't finished */
+};
+
+struct StartupTimer {
+    int NumSpans;
+    int Depth;
+    struct StartupSpan Span[STARTUP_SPANS_MAX];
+};
+
+/* time includes and the lexing and parsing of files, as well as the
+    parts of EngineInitialize() which are always timed */
+void EngineSetTimeStartup(Engine *pc)
+{
+    pc->StartupTimer = calloc(1, sizeof(struct StartupTimer));
+    if (pc->StartupTimer == NULL)
+        fprintf(stderr, "can't time start up: out of memory\n");
+}
+
+/* start timing a span. Name must last until the timer's shown. returns
+    the slot to pass to StartupEnd(), or -1 if there's no room */
+int StartupBegin(Engine *pc, const char *What, const char *Name)
+{
+    struct StartupTimer *Timer = pc->StartupTimer;
+    struct StartupSpan *Span;
+
+    if (Timer->NumSpans == STARTUP_SPANS_MAX)
+        return -1;
+
+    Span = &Timer->Span[Timer->NumSpans];
+    Span->What = What;
+    Span->Name = Name;
+    Span->Depth = Timer->Depth++;
+    Span->Time = -ProfileNow();
+    return Timer->NumSpans++;
+}
+
+void StartupEnd(Engine *pc, int Slot)
+{
+    struct StartupTimer *Timer = pc->StartupTimer;
+
+    Timer->Depth--;
+    if (Slot >= 0)
+        Timer->Span[Slot].Time += ProfileNow();
+}
+
+/* show how long starting up took, in microseconds, and stop timing it.
+    it's called just before main() runs */
+void EnginePrintStartup(Engine *pc, FILE *Stream)
+{
+    struct StartupTimer *Timer = pc->StartupTimer;
+    long long Total = 0;
+    int Count;
+
+    for (Count = 0; Count < InitPhases; Count++) {
+        fprintf(Stream, "startup: %-28s %10.1f us\n", InitPhaseName[Count],
+            pc->InitTime[Count] / 1e3);
+        Total += pc->InitTime[Count];
+    }
+    fprintf(Stream, "startup: %-28s %10.1f us\n", "EngineInitialize", Total / 1e3);
+
+    for (Count = 0; Timer != NULL && Count < Timer->NumSpans; Count++) {
+        struct StartupSpan *Span = &Timer->Span[Count];
+        char Label[256];
+
+        snprintf(Label, sizeof(Label), "%*s%s %s", Span->Depth * 2, "",
+            Span->What, Span->Name);
+        if (Span->Time < 0)
+            fprintf(Stream, "startup: %-28s    running\n", Label);
+        else
+            fprintf(Stream, "startup: %-28s %10.1f us\n", Label, Span->Time / 1e3);
+    }
+
+    fprintf(Stream, "startup: %-28s %10.1f us\n", "total",
+        (ProfileNow() - pc->InitStart) / 1e3);
+    pc->StartupTimer = NULL;
+    free(Timer);
+}
+
+/* write the profiles and trace now rather than when the engine's cleaned
+    up */
+void EngineWriteProfile(Engine *pc)
+{
+    struct Profile *Prof = pc->Profile;
+    struct LineProfile *LineProf = pc->LineProfile;
+    struct Sampler *S = pc->Sampler;
+    struct Trace *T = pc->Trace;
+
+    pc->Profile = NULL;
+    pc->LineProfile = NULL;
+    pc->Sampler = NULL;
+    pc->Trace = NULL;
+    pc->ProfileStatements = false;
+    atomic_signal_fence(memory_order_seq_cst);
+#ifdef UNIX_HOST
+    if (S != NULL)
+        SamplerCleanup(pc, S);
+#endif
+    if (Prof != NULL)
+        ProfileCleanup(pc, Prof);
+    if (LineProf != NULL)
+        LineProfileCleanup(pc, LineProf);
+    if (T != NULL)
+        TraceCleanup(pc, T);
+    free(pc->StartupTimer);
+    pc->StartupTimer = NULL;
+}
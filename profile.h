@@ -0,0 +1,13 @@
+/* profile.h */
+struct Profile;
+struct LineProfile;
+struct Sampler;
+struct StartupTimer;
+
+void ProfileEnter(Engine *pc, const void *Key, const char *FuncName);
+void ProfileLeave(Engine *pc);
+void ProfileCleanup(Engine *pc, struct Profile *Prof);
+void ProfileStatement(struct ParseState *Parser);
+long long ProfileNow(void);
+int StartupBegin(Engine *pc, const char *What, const char *Name);
+void StartupEnd(Engine *pc, int Slot);
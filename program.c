@@ -0,0 +1,162 @@
+/* itrapc compiled programs. a program's source is read and lexed once by an
+ * engine of its own, which is then never run again. any number of other
+ * engines, on any threads, can run the program from those tokens at the
+ * same time, each with its own globals, stack and heap. only the lexing is
+ * shared - each engine still parses the tokens to define its own functions
+ * and types */
+
+#include "interpreter.h"
+#include "heap.h"
+#include "table.h"
+#include "lex.h"
+
+#if defined(UNIX_HOST) || defined(WIN32)
+#include <threads.h>
+#include <stdatomic.h>
+
+struct Program {
+    atomic_int RefCount;
+    Engine Compiler;            /* owns the source, tokens and strings */
+    char *FileName;             /* registered in the compiler's strings */
+    char *Source;
+    void *Tokens;
+    int NumTokens;
+    mtx_t Resolving;            /* held while the #ifs after an #include
+                                    are resolved */
+};
+
+/* read and lex a source file. errors are reported on Out, as
+    EngineSetOutput() would send them, and NULL is returned. the caller
+    holds the only reference */
+Program *ProgramCompile(const char *FileName, int StackSize, IOFILE *Out,
+    IOFILE *Err)
+{
+    Program *Prog = malloc(sizeof(Program));
+
+    if (Prog == NULL)
+        return NULL;
+
+    atomic_init(&Prog->RefCount, 1);
+    if (mtx_init(&Prog->Resolving, mtx_plain) != thrd_success) {
+        free(Prog);
+        return NULL;
+    }
+
+    EngineInitialize(&Prog->Compiler, StackSize);
+    EngineSetOutput(&Prog->Compiler, Out, Err);
+    if (EnginePlatformSetExitPoint(&Prog->Compiler)) {
+        Prog->Compiler.ArenaTeardown = true;
+        EngineCleanup(&Prog->Compiler);
+        mtx_destroy(&Prog->Resolving);
+        free(Prog);
+        return NULL;
+    }
+
+    Prog->Source = PlatformReadFile(&Prog->Compiler, FileName);
+    Prog->FileName = TableStrRegister(&Prog->Compiler, FileName,
+        strlen(FileName));
+    Prog->Tokens = LexAnalyse(&Prog->Compiler, Prog->FileName, Prog->Source,
+        strlen(Prog->Source), &Prog->NumTokens);
+    return Prog;
+}
+
+void ProgramRetain(Program *Prog)
+{
+    atomic_fetch_add(&Prog->RefCount, 1);
+}
+
+/* drop a reference, freeing the program when it was the last */
+void ProgramRelease(Program *Prog)
+{
+    if (atomic_fetch_sub(&Prog->RefCount, 1) != 1)
+        return;
+
+    Prog->Compiler.ArenaTeardown = true;
+    EngineCleanup(&Prog->Compiler);
+    mtx_destroy(&Prog->Resolving);
+    free(Prog);
+}
+
+/* initialize an engine to run a compiled program. the engine keeps a
+    reference to it until EngineCleanup() */
+void EngineInitializeProgram(Engine *pc, int StackSize, Program *Prog)
+{
+    EngineInitializeShared(pc, StackSize, &Prog->Compiler);
+    ProgramRetain(Prog);
+    pc->Program = Prog;
+}
+
+/* define the program's globals and functions in our engine, the same as
+    EnginePlatformScanFile() does for a source file */
+void EngineParseProgram(Engine *pc)
+{
+    Program *Prog = pc->Program;
+
+    EngineParseTokens(pc, Prog->FileName, Prog->Source, Prog->Tokens, true,
+        pc->EnableDebugger);
+}
+
+/* is this token in the compiled program we're running? those live as
+    long as we do, so function bodies can point straight at them */
+int ProgramOwnsTokens(Engine *pc, const void *Pos)
+{
+    const struct LexTokenRecord *Tokens;
+
+    if (pc->Program == NULL)
+        return false;
+
+    Tokens = pc->Program->Tokens;
+    return (const struct LexTokenRecord*)Pos >= Tokens &&
+        (const struct LexTokenRecord*)Pos < Tokens + pc->Program->NumTokens;
+}
+
+/* LexHashResume() for an #include in the program. the tokens are shared, so
+    they're resolved in a copy - that can fail, and other engines running
+    the program mustn't be left waiting for us - then the first engine to
+    finish puts its copy back */
+void ProgramHashResume(struct ParseState *Parser,
+    const struct LexTokenRecord *Include)
+{
+    Engine *pc = Parser->pc;
+    Program *Prog = pc->Program;
+    struct LexTokenRecord *Copy;
+    int NumTokens;
+
+    mtx_lock(&Prog->Resolving);
+    NumTokens = LexHashDeferred(Include);
+    if (NumTokens == 0) {
+        mtx_unlock(&Prog->Resolving);
+        return;
+    }
+
+    Copy = HeapAllocMemIn(pc, sizeof(struct LexTokenRecord) * NumTokens,
+        MemTokens);
+    if (Copy != NULL)
+        memcpy(Copy, &Include[2], sizeof(struct LexTokenRecord) * NumTokens);
+    mtx_unlock(&Prog->Resolving);
+    if (Copy == NULL)
+        ProgramFail(Parser, "out of memory");
+
+    NumTokens = LexHashResolveDeferred(Parser, Include, Copy, NumTokens);
+
+    mtx_lock(&Prog->Resolving);
+    if (Include->Value.LongInteger != 0) {
+        memcpy((struct LexTokenRecord *)&Include[2], Copy,
+            sizeof(struct LexTokenRecord) * NumTokens);
+        ((struct LexTokenRecord *)Include)->Value.LongInteger = 0;
+    }
+    mtx_unlock(&Prog->Resolving);
+    HeapFreeMem(pc, Copy);
+}
+#else
+int ProgramOwnsTokens(Engine *pc, const void *Pos)
+{
+    return false;
+}
+
+void ProgramHashResume(struct ParseState *Parser,
+    const struct LexTokenRecord *Include)
+{
+    LexHashResume(Parser, Include);
+}
+#endif
@@ -0,0 +1,248 @@
+/* itrapc fork server. one engine is initialized with all the system
+ * headers, then each request is run in a fork()ed copy of it so the
+ * start up cost is only paid once */
+
+#include "interpreter.h"
+
+#ifdef UNIX_HOST
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define SERVE_REQUEST_MAX (4096)    /* longest request line */
+#define SERVE_ARGS_MAX (64)         /* most words in a request */
+
+/* a job which is still running, and the connection its reply goes to */
+struct ServeChild {
+    pid_t Pid;
+    int Conn;
+    struct ServeChild *Next;
+};
+
+/* SIGCHLD is passed on to the accept loop through this pipe */
+static int ServeChildPipe[2];
+
+static void ServeChildExited(int Signal)
+{
+    int SavedErrno = errno;
+    char Byte = 0;
+
+    if (write(ServeChildPipe[1], &Byte, 1) < 0) {
+        /* the pipe's full, so the loop will wake anyway */
+    }
+    errno = SavedErrno;
+}
+
+/* read the request line from a new connection */
+static int ServeReadRequest(int Conn, char *Buf, int MaxLen)
+{
+    int Len = 0;
+
+    while (Len < MaxLen-1) {
+        ssize_t Got = read(Conn, &Buf[Len], 1);
+        if (Got <= 0 || Buf[Len] == '\n')
+            break;
+
+        Len++;
+    }
+
+    Buf[Len] = '\0';
+    return Len;
+}
+
+/* in the child - run the requested program in our copy of the engine
+    with its output going back down the connection */
+static void ServeRunJob(Engine *pc, int Conn)
+{
+    char Request[SERVE_REQUEST_MAX];
+    char *Argv[SERVE_ARGS_MAX];
+    int Argc = 0;
+    char *Word;
+
+    if (ServeReadRequest(Conn, Request, sizeof(Request)) == 0)
+        _exit(1);
+
+    for (Word = strtok(Request, " \t\r"); Word != NULL && Argc < SERVE_ARGS_MAX;
+            Word = strtok(NULL, " \t\r"))
+        Argv[Argc++] = Word;
+
+    if (Argc == 0) {
+        static const char NoProgram[] = "no program file name given\n";
+
+        if (write(Conn, NoProgram, sizeof(NoProgram)-1) < 0) {
+            /* the client has gone away */
+        }
+        _exit(1);
+    }
+
+    dup2(Conn, STDOUT_FILENO);
+    dup2(Conn, STDERR_FILENO);
+    close(Conn);
+
+    if (!EnginePlatformSetExitPoint(pc)) {
+        EnginePlatformScanFile(pc, Argv[0]);
+        EngineCallMain(pc, Argc, Argv);
+    }
+
+    /* the process is thrown away, so there's nothing to clean up */
+    fflush(stdout);
+    fflush(stderr);
+    _exit(pc->EngineExitValue);
+}
+
+/* tell the client how its job ended and hang up */
+static void ServeReply(int Conn, int Status)
+{
+    char Trailer[32];
+    int Len;
+
+    if (WIFEXITED(Status))
+        Len = snprintf(Trailer, sizeof(Trailer), "%cexit %d\n", '\0',
+            WEXITSTATUS(Status));
+    else
+        Len = snprintf(Trailer, sizeof(Trailer), "%csignal %d\n", '\0',
+            WIFSIGNALED(Status) ? WTERMSIG(Status) : 0);
+
+    if (write(Conn, Trailer, Len) < 0) {
+        /* the client has gone away */
+    }
+    close(Conn);
+}
+
+/* collect finished jobs */
+static void ServeReap(struct ServeChild **Running)
+{
+    int Status;
+    pid_t Pid;
+
+    while ((Pid = waitpid(-1, &Status, WNOHANG)) > 0) {
+        struct ServeChild **Child;
+
+        for (Child = Running; *Child != NULL; Child = &(*Child)->Next) {
+            if ((*Child)->Pid == Pid) {
+                struct ServeChild *Done = *Child;
+
+                ServeReply(Done->Conn, Status);
+                *Child = Done->Next;
+                free(Done);
+                break;
+            }
+        }
+    }
+}
+
+/* serve requests on a unix socket at SocketPath. each connection sends one
+    line holding a program file name and its arguments. the reply is the
+    program's output, then a NUL byte and "exit N" or "signal N". only
+    returns if the socket can't be set up */
+int EngineServe(Engine *pc, const char *SocketPath)
+{
+    struct sockaddr_un Addr;
+    struct sigaction Action;
+    struct ServeChild *Running = NULL;
+    int Listener;
+
+    if (strlen(SocketPath) >= sizeof(Addr.sun_path)) {
+        fprintf(stderr, "socket path %s is too long\n", SocketPath);
+        return 1;
+    }
+
+    memset(&Addr, '\0', sizeof(Addr));
+    Addr.sun_family = AF_UNIX;
+    strcpy(Addr.sun_path, SocketPath);
+    unlink(SocketPath);
+
+    Listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (Listener < 0 || bind(Listener, (struct sockaddr*)&Addr, sizeof(Addr)) < 0 ||
+            listen(Listener, SOMAXCONN) < 0 || pipe(ServeChildPipe) < 0) {
+        fprintf(stderr, "can't serve on %s: %s\n", SocketPath, strerror(errno));
+        return 1;
+    }
+
+    fcntl(ServeChildPipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(ServeChildPipe[1], F_SETFL, O_NONBLOCK);
+    memset(&Action, '\0', sizeof(Action));
+    Action.sa_handler = ServeChildExited;
+    Action.sa_flags = SA_NOCLDSTOP;
+    sigemptyset(&Action.sa_mask);
+    sigaction(SIGCHLD, &Action, NULL);
+
+    /* a client which hangs up early makes write() fail with EPIPE
+        rather than killing the server */
+    signal(SIGPIPE, SIG_IGN);
+
+    while (true) {
+        struct pollfd Wait[2];
+
+        Wait[0].fd = Listener;
+        Wait[0].events = POLLIN;
+        Wait[1].fd = ServeChildPipe[0];
+        Wait[1].events = POLLIN;
+        if (poll(Wait, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+
+            break;
+        }
+
+        if (Wait[1].revents & POLLIN) {
+            char Drain[64];
+
+            while (read(ServeChildPipe[0], Drain, sizeof(Drain)) > 0) {
+            }
+            ServeReap(&Running);
+        }
+
+        if (Wait[0].revents & POLLIN) {
+            int Conn = accept(Listener, NULL, NULL);
+            struct ServeChild *Child;
+            pid_t Pid;
+
+            if (Conn < 0)
+                continue;
+
+            fflush(stdout);
+            fflush(stderr);
+            Pid = fork();
+            if (Pid == 0) {
+                close(Listener);
+                close(ServeChildPipe[0]);
+                close(ServeChildPipe[1]);
+                signal(SIGCHLD, SIG_DFL);
+                signal(SIGPIPE, SIG_DFL);
+                ServeRunJob(pc, Conn);
+            }
+
+            if (Pid < 0) {
+                ServeReply(Conn, 1 << 8);   /* as if it did exit(1) */
+                continue;
+            }
+
+            Child = malloc(sizeof(struct ServeChild));
+            if (Child == NULL) {
+                /* can't keep track of it, so wait for it here */
+                int Status = 1 << 8;
+
+                while (waitpid(Pid, &Status, 0) < 0 && errno == EINTR) {
+                }
+                ServeReply(Conn, Status);
+                continue;
+            }
+
+            Child->Pid = Pid;
+            Child->Conn = Conn;
+            Child->Next = Running;
+            Running = Child;
+        }
+    }
+
+    fprintf(stderr, "server stopped: %s\n", strerror(errno));
+    close(Listener);
+    unlink(SocketPath);
+    return 1;
+}
+#endif
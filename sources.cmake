@@ -1,5 +1,7 @@
 CMakeLists.txt
 sources.cmake
+batch.c
+benchmark.c
 clibrary.c
 clibrary.h
 debug.c
@@ -37,9 +39,18 @@ parse_macro.h
 parse_statement.c
 platform.c
 platform.h
+probes.h
+program.c
+profile.c
+profile.h
+server.c
 table.c
 table.h
+tracer.c
+tracer.h
 type.c
 type.h
 variable.c
-variable.h
\ No newline at end of file
+variable.h
+worker.c
+worker.h
\ No newline at end of file
@@ -14,6 +14,15 @@ void TableInit(Engine *pc)
 {
     TableInitTable(&pc->StringTable, &pc->StringHashTable[0],
             STRING_TABLE_SIZE, true);
+    if (pc->StringOwner != NULL) {
+        /* strings are only ever added at the front of a chain, so copying
+            the chain heads gives a table of just the strings the owner has
+            now, which is safe to read even while the owner adds more */
+        TableInitTable(&pc->OwnerStrings, &pc->OwnerStringHashTable[0],
+            STRING_TABLE_SIZE, true);
+        memcpy(pc->OwnerStringHashTable, pc->StringOwner->StringTable.HashTable,
+            sizeof(pc->OwnerStringHashTable));
+    }
     pc->StrEmpty = TableStrRegister(pc, "",0);
     /* Initialize VarTypeMap hash table to NULL, not really necessary as Engine memset everything to zero */
     memset(pc->VarTypeMap.HashTable, 0, sizeof(pc->VarTypeMap.HashTable));
@@ -43,9 +52,34 @@ void TableInitTable(struct Table *Tbl, struct TableEntry **HashTable, int Size,
     Tbl->Size = Size;
     Tbl->OnHeap = OnHeap;
     Tbl->HashTable = HashTable;
+    Tbl->Searches = 0;
+    Tbl->Probes = 0;
     memset((void*)HashTable, '\0', sizeof(struct TableEntry*) * Size);
 }
 
+/* move all of a table's entries into a new hash table. out of scope keys
+    have their low bit set so they're hashed as they were when added */
+void TableRehash(struct Table *Tbl, struct TableEntry **HashTable, int Size)
+{
+    int Count;
+    struct TableEntry *Entry;
+    struct TableEntry *NextEntry;
+
+    memset((void*)HashTable, '\0', sizeof(struct TableEntry*) * Size);
+    for (Count = 0; Count < Tbl->Size; Count++) {
+        for (Entry = Tbl->HashTable[Count]; Entry != NULL; Entry = NextEntry) {
+            uintptr_t HashValue = ((uintptr_t)Entry->p.v.Key & ~(uintptr_t)1) % Size;
+
+            NextEntry = Entry->Next;
+            Entry->Next = HashTable[HashValue];
+            HashTable[HashValue] = Entry;
+        }
+    }
+
+    Tbl->Size = Size;
+    Tbl->HashTable = HashTable;
+}
+
 /* check a hash table entry for a key */
 struct TableEntry *TableSearch(struct Table *Tbl, const char *Key,
     int *AddAt)
@@ -54,12 +88,22 @@ struct TableEntry *TableSearch(struct Table *Tbl, const char *Key,
        The Key parameter is not hashed by its string content - it's hashed by its memory address. */
     uintptr_t HashValue = ((uintptr_t)Key) % Tbl->Size;
     struct TableEntry *Entry;
+    unsigned long Probes = 0;   /* added to the table's count once */
+
     for (Entry = Tbl->HashTable[HashValue]; Entry != NULL; Entry = Entry->Next) {
+        Probes++;
         if (Entry->p.v.Key == Key)
-            return Entry;   /* found */
+            break;      /* found */
     }
-    *AddAt = HashValue;    /* didn't find it in the chain */
-    return NULL;
+
+#ifndef NO_STATS
+    Tbl->Searches++;
+    Tbl->Probes += Probes;
+#endif
+    if (Entry == NULL)
+        *AddAt = HashValue;    /* didn't find it in the chain */
+
+    return Entry;
 }
 
 /* set an identifier to a value. returns FALSE if it already exists.
@@ -72,7 +116,7 @@ int TableSet(Engine *pc, struct Table *Tbl, char *Key, struct Value *Val,
 
     if (FoundEntry == NULL) {   /* add it to the table */
         struct TableEntry *NewEntry = VariableAlloc(pc, NULL,
-            sizeof(struct TableEntry), Tbl->OnHeap);
+            sizeof(struct TableEntry), Tbl->OnHeap, MemTables);
         NewEntry->DeclFileName = DeclFileName;
         NewEntry->DeclLine = DeclLine;
         NewEntry->DeclColumn = DeclColumn;
@@ -99,6 +143,7 @@ int TableGet(struct Table *Tbl, const char *Key, struct Value **Val,
 #endif
     int AddAt;
     struct TableEntry *FoundEntry = TableSearch(Tbl, Key, &AddAt);
+
     if (FoundEntry == NULL)
     {   ShowX("<TableSearch","NOT found",Key,0);
         return false;
@@ -193,9 +238,9 @@ char *TableSetIdentifier(Engine *pc, struct Table *Tbl, const char *Ident,
     }
     /* add it to the table - we economise by not allocating
         the whole structure here */
-    struct TableEntry *NewEntry = HeapAllocMem(pc,
+    struct TableEntry *NewEntry = HeapAllocMemIn(pc,
         sizeof(struct TableEntry) -
-        sizeof(union TableEntryPayload) + IdentLen + 1);
+        sizeof(union TableEntryPayload) + IdentLen + 1, MemStrings);
     if (NewEntry == NULL)
         ProgramFailNoParser(pc, "(TableSetIdentifier) out of memory");
     strncpy((char *)&NewEntry->p.Key[0], (char *)Ident, IdentLen);
@@ -220,6 +265,14 @@ char *TableStrRegister(Engine *pc, const char *Str, size_t Len)
     }
 #endif
     ShowX(">Search: TableStrRegister","StringTable",Str,Len);
+    for (Engine *Sharer = pc; Sharer->StringOwner != NULL;
+            Sharer = Sharer->StringOwner) {
+        int AddAt;
+        struct TableEntry *Shared = TableSearchIdentifier(&Sharer->OwnerStrings,
+            Str, Len, &AddAt);
+        if (Shared != NULL)
+            return &Shared->p.Key[0];
+    }
     return TableSetIdentifier(pc, &pc->StringTable, Str, Len);
 }
 
@@ -254,7 +307,8 @@ void TableStrFree(Engine *pc)
 void StoreVarType(Engine *pc, const char *VarName, const char *TypeName)
 {
     int hash = TableHash(VarName, strlen(VarName)) % VARIABLE_TYPE_TABLE_SIZE;
-    struct TypeNameEntry *entry = HeapAllocMem(pc, sizeof(struct TypeNameEntry));
+    struct TypeNameEntry *entry = HeapAllocMemIn(pc, sizeof(struct TypeNameEntry),
+        MemTables);
     if (entry == NULL)
         ProgramFailNoParser(pc,"StoreVarType out of memory");
     entry->VarName = VarName;
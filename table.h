@@ -8,6 +8,7 @@ char *TableStrRegister(Engine *pc, const char *Str, size_t Len);
 char *TableMemberFunctionRegister(Engine *pc, const char *Str);
 void TableInitTable(struct Table *Tbl, struct TableEntry **HashTable,
     int Size, int OnHeap);
+void TableRehash(struct Table *Tbl, struct TableEntry **HashTable, int Size);
 int TableSet(Engine *pc, struct Table *Tbl, char *Key, struct Value *Val,
     const char *DeclFileName, int DeclLine, int DeclColumn);
 int TableGet(struct Table *Tbl, const char *Key, struct Value **Val,
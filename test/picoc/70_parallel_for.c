@@ -0,0 +1,48 @@
+#include <stdio.h>
+#include <parallel.h>
+
+#define N 100
+
+int Squares[N];
+int Scale = 2;
+
+void Square(int i)
+{
+    int Local = i * Scale;
+
+    Squares[i] = Local * i + 1;
+}
+
+void Negate(int i)
+{
+    Squares[i] = -Squares[i];
+}
+
+int main()
+{
+    int Total = 0;
+    int i;
+
+    parallel_for(0, N, "Square");
+    for (i = 0; i < N; i++)
+        Total += Squares[i];
+
+    printf("%d %d %d\n", Squares[3], Squares[N-1], Total);
+
+    /* the workers see a global changed between loops */
+    Scale = 3;
+    parallel_for(0, N, "Square");
+    printf("%d %d\n", Squares[3], Squares[N-1]);
+
+    parallel_for(0, N, "Negate");
+    printf("%d %d\n", Squares[3], Squares[N-1]);
+
+    Squares[0] = 0;
+    parallel_for(5, 5, "Square");
+    parallel_for(0, 1, "Square");
+    printf("%d %d\n", Squares[0], Squares[5]);
+
+    parallel_for(0, N, "Scale");
+    printf("not reached\n");
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <thread.h>
+
+chan_t Work;
+chan_t Done;
+int Seen[4];
+
+int Sum(int Which)
+{
+    int Total = 0;
+    int Item;
+
+    while (chan_recv(Work, &Item)) {
+        Total += Item;
+        Seen[Which]++;
+    }
+
+    chan_send(Done, Which);
+    return Total;
+}
+
+void Halve()
+{
+    double Value;
+
+    chan_recv_double(Work, &Value);
+    chan_send_double(Done, Value / 2);
+}
+
+int main()
+{
+    thread_t Adder[4];
+    int Total = 0;
+    int Count = 0;
+    int Which;
+    double Half;
+    char *Word = "pointer";
+    void *Got;
+    int i;
+
+    Work = chan_new(8);
+    Done = chan_new(4);
+    for (i = 0; i < 4; i++)
+        Adder[i] = thread_spawn("Sum", i);
+
+    for (i = 1; i <= 1000; i++)
+        chan_send(Work, i);
+
+    chan_close(Work);
+    for (i = 0; i < 4; i++) {
+        chan_recv(Done, &Which);
+        Total += thread_join(Adder[Which]);
+        Count += Seen[Which];
+    }
+
+    printf("%d %d %d\n", Total, Count, chan_recv(Work, &i));
+    chan_free(Work);
+
+    Work = chan_new(1);
+    Adder[0] = thread_spawn("Halve", 0);
+    chan_send_double(Work, 5.0);
+    chan_recv_double(Done, &Half);
+    thread_join(Adder[0]);
+    printf("%d\n", (int)(Half * 10));
+
+    chan_send_ptr(Done, Word);
+    chan_recv_ptr(Done, &Got);
+    printf("%s\n", (char *)Got);
+
+    chan_free(Work);
+    chan_free(Done);
+    return 0;
+}
@@ -0,0 +1,69 @@
+#include <stdio.h>
+
+#define SQR(x) ((x)*(x))
+#define ADD(a, b) ((a) + (b))
+#define DBL(x) (x*2)
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define AT(i) Arr[i]
+#define TEN 10
+#define TWENTY (TEN*2)
+
+int Arr[5];
+int Calls;
+
+int Count(int x)
+{
+    Calls++;
+    return x;
+}
+
+int Sum(int a, int b)
+{
+    return a + b;
+}
+
+int Square(int v)
+{
+    return SQR(v);
+}
+
+void main()
+{
+    int i;
+    int Total = 0;
+
+    /* the result has the type of the expression, not double */
+    printf("%d %d\n", SQR(3), sizeof(SQR(3)) == sizeof(int));
+    printf("%d\n", sizeof(SQR(1.5)) == sizeof(double));
+    printf("%d\n", SQR(7) / 2);
+
+    /* arguments are substituted as tokens, not evaluated first */
+    printf("%d\n", DBL(1+2));
+    printf("%d %d\n", SQR(Count(3)), Calls);
+
+    /* nested uses, and commas inside an argument's brackets */
+    printf("%d\n", SQR(SQR(2)));
+    printf("%d\n", ADD(SQR(2), ADD(1, 2)));
+    printf("%d\n", MAX(Sum(1, 2), 2));
+    printf("%d %d\n", TEN, TWENTY);
+
+    /* an expansion can be assigned to */
+    AT(2) = 5;
+    AT(3) = AT(2) + 1;
+    printf("%d %d\n", Arr[2], Arr[3]);
+
+    /* the same call site run again, with different values */
+    for (i = 0; i < 4; i++)
+        Total += SQR(i);
+    printf("%d %d %d\n", Total, Square(5), Square(6));
+
+    /* nothing is evaluated in code that isn't run */
+    Calls = 0;
+    if (0)
+        Total = SQR(Count(2));
+    else
+        Total = ADD(Count(1), 1);
+    while (Total < 0)
+        Total = MAX(Count(4), 0);
+    printf("%d %d\n", Total, Calls);
+}
@@ -0,0 +1,59 @@
+#define BEFORE
+
+#ifdef BEFORE
+int A = 1;
+#else
+int A = 2;
+#endif
+
+#include <stdio.h>
+
+#ifdef EOF
+int F = 1;
+#else
+int F = 0;
+#endif
+
+#ifdef BEFORE
+#include "73_hashif_include.h"
+int G = 10;
+#else
+int G = 11;
+#endif
+
+#ifdef BEFORE
+int B = 3;
+#else
+int B = 4;
+#endif
+
+#ifdef FROM_HEADER
+int C = FROM_HEADER;
+#else
+int C = 0;
+#endif
+
+#ifndef NOT_DEFINED
+int D = 7;
+#endif
+
+#if HEADER_LEVEL
+int E = 8;
+#else
+int E = 9;
+#endif
+
+void main()
+{
+    int i;
+
+    printf("%d %d %d %d %d %d %d\n", A, B, C, D, E, F, G);
+    for (i = 0; i < 3; i++) {
+#ifdef BEFORE
+        printf("in loop %d\n", i);
+#else
+        printf("wrong branch %d\n", i);
+#endif
+    }
+    printf("%d\n", HeaderTwice(21));
+}
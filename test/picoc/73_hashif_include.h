@@ -0,0 +1,15 @@
+/* included by 73_hashif_include.c */
+#define FROM_HEADER 5
+#define HEADER_LEVEL 0
+
+#ifdef BEFORE
+int HeaderTwice(int x)
+{
+    return x * 2;
+}
+#else
+int HeaderTwice(int x)
+{
+    return -1;
+}
+#endif
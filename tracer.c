@@ -0,0 +1,206 @@
+/* itrapc timeline tracer. function calls, lexing, parsing, includes and
+ * markers the program sets are recorded in memory as they happen, then
+ * written as trace event JSON for chrome://tracing or Perfetto when the
+ * engine is cleaned up */
+
+#include "interpreter.h"
+#include "profile.h"
+#include "tracer.h"
+
+#define TRACE_EVENTS_MAX (1 << 22)  /* events kept before we drop them */
+
+/* something which happened. spans are written as complete events once
+    they've finished, and the program's markers as begin and end events */
+struct TraceEvent {
+    const char *Name;
+    const char *Category;
+    char Phase;
+    long long Start;                /* nanoseconds since the trace began */
+    long long Duration;
+};
+
+/* a span which hasn't finished */
+struct TraceSpan {
+    const char *Name;
+    const char *Category;
+    long long Start;
+};
+
+struct Trace {
+    char *FileName;                 /* where the JSON goes */
+    long long Origin;               /* when the trace began */
+    struct TraceEvent *Event;
+    int NumEvents;
+    int MaxEvents;
+    long Dropped;                   /* events there was no room for */
+    struct TraceSpan *Span;         /* a stack of the unfinished spans */
+    int NumSpans;
+    int MaxSpans;
+    int MarkersOpen;                /* trace_begin()s without a trace_end() */
+};
+
+/* trace this engine, writing the events to FileName when it's cleaned up */
+void EngineSetTrace(Engine *pc, const char *FileName)
+{
+    struct Trace *T = calloc(1, sizeof(struct Trace));
+
+    if (T == NULL || (T->FileName = strdup(FileName)) == NULL) {
+        free(T);
+        fprintf(stderr, "can't trace: out of memory\n");
+        return;
+    }
+
+    T->Origin = ProfileNow();
+    pc->Trace = T;
+}
+
+/* add an event to the buffer */
+static void TraceAdd(Engine *pc, const char *Category, const char *Name,
+    char Phase, long long Start, long long Duration)
+{
+    struct Trace *T = pc->Trace;
+    struct TraceEvent *Event;
+
+    if (T->NumEvents == T->MaxEvents) {
+        int MaxEvents = T->MaxEvents > 0 ? T->MaxEvents * 2 : 4096;
+
+        if (MaxEvents > TRACE_EVENTS_MAX ||
+                (Event = realloc(T->Event,
+                    sizeof(struct TraceEvent) * MaxEvents)) == NULL) {
+            T->Dropped++;
+            return;
+        }
+
+        T->Event = Event;
+        T->MaxEvents = MaxEvents;
+    }
+
+    Event = &T->Event[T->NumEvents++];
+    Event->Name = Name;
+    Event->Category = Category;
+    Event->Phase = Phase;
+    Event->Start = Start;
+    Event->Duration = Duration;
+}
+
+/* start a span. Category should be a string constant and Name a
+    registered string, since they're only written out at the end */
+void TraceBegin(Engine *pc, const char *Category, const char *Name)
+{
+    struct Trace *T = pc->Trace;
+    struct TraceSpan *Span;
+
+    if (T->NumSpans == T->MaxSpans) {
+        int MaxSpans = T->MaxSpans > 0 ? T->MaxSpans * 2 : 256;
+
+        Span = realloc(T->Span, sizeof(struct TraceSpan) * MaxSpans);
+        if (Span == NULL)
+            ProgramFailNoParser(pc, "(TraceBegin) out of memory");
+
+        T->Span = Span;
+        T->MaxSpans = MaxSpans;
+    }
+
+    Span = &T->Span[T->NumSpans++];
+    Span->Name = Name;
+    Span->Category = Category;
+    Span->Start = ProfileNow() - T->Origin;
+}
+
+/* finish the span last started */
+void TraceEnd(Engine *pc)
+{
+    struct Trace *T = pc->Trace;
+    struct TraceSpan *Span;
+
+    if (T->NumSpans == 0)
+        return;
+
+    Span = &T->Span[--T->NumSpans];
+    TraceAdd(pc, Span->Category, Span->Name, 'X', Span->Start,
+        ProfileNow() - T->Origin - Span->Start);
+}
+
+/* the program's own markers. Name is NULL for the end of one */
+void TraceMarker(Engine *pc, const char *Name)
+{
+    struct Trace *T = pc->Trace;
+
+    if (Name == NULL) {
+        if (T->MarkersOpen == 0)
+            return;
+
+        T->MarkersOpen--;
+    } else
+        T->MarkersOpen++;
+
+    TraceAdd(pc, "user", Name, Name == NULL ? 'E' : 'B',
+        ProfileNow() - T->Origin, 0);
+}
+
+/* write a string with JSON escapes */
+static void TraceWriteString(FILE *Out, const char *Str)
+{
+    fputc('"', Out);
+    for (; *Str != '\0'; Str++) {
+        unsigned char Char = *Str;
+
+        if (Char == '"' || Char == '\\')
+            fprintf(Out, "\\%c", Char);
+        else if (Char < ' ')
+            fprintf(Out, "\\u%04x", Char);
+        else
+            fputc(Char, Out);
+    }
+    fputc('"', Out);
+}
+
+static void TraceWrite(struct Trace *T)
+{
+    FILE *Out = fopen(T->FileName, "w");
+    int Count;
+
+    if (Out == NULL) {
+        fprintf(stderr, "can't write trace %s\n", T->FileName);
+        return;
+    }
+
+    fprintf(Out, "{\"traceEvents\":[\n");
+    for (Count = 0; Count < T->NumEvents; Count++) {
+        struct TraceEvent *Event = &T->Event[Count];
+
+        fprintf(Out, "{\"ph\":\"%c\",\"pid\":1,\"tid\":1,\"ts\":%.3f",
+            Event->Phase, Event->Start / 1e3);
+        if (Event->Phase == 'X')
+            fprintf(Out, ",\"dur\":%.3f", Event->Duration / 1e3);
+        if (Event->Name != NULL) {
+            fprintf(Out, ",\"cat\":\"%s\",\"name\":", Event->Category);
+            TraceWriteString(Out, Event->Name);
+        }
+        fprintf(Out, "},\n");
+    }
+
+    fprintf(Out, "{\"ph\":\"M\",\"pid\":1,\"tid\":1,\"name\":\"thread_name\","
+        "\"args\":{\"name\":\"itrapc\"}}\n],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(Out);
+    if (T->Dropped > 0)
+        fprintf(stderr, "trace: %ld events dropped\n", T->Dropped);
+}
+
+/* write out and free a trace. spans and markers which never finished,
+    because the program failed or exit()ed, end now */
+void TraceCleanup(Engine *pc, struct Trace *T)
+{
+    pc->Trace = T;
+    while (T->NumSpans > 0)
+        TraceEnd(pc);
+    while (T->MarkersOpen > 0)
+        TraceMarker(pc, NULL);
+
+    pc->Trace = NULL;
+    TraceWrite(T);
+    free(T->Event);
+    free(T->Span);
+    free(T->FileName);
+    free(T);
+}
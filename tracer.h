@@ -0,0 +1,7 @@
+/* tracer.h */
+struct Trace;
+
+void TraceBegin(Engine *pc, const char *Category, const char *Name);
+void TraceEnd(Engine *pc);
+void TraceMarker(Engine *pc, const char *Name);
+void TraceCleanup(Engine *pc, struct Trace *T);
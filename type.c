@@ -5,6 +5,7 @@
 #include "variable.h"
 #include "platform.h"
 #include "type.h"
+#include "heap.h"
 
 static struct ValueType *TypeAdd(Engine *pc, struct ParseState *Parser,
     struct ValueType *ParentType, enum BaseType Base, int ArraySize,
@@ -20,9 +21,11 @@ static struct ValueType *TypeParseBack(struct ParseState *Parser,
 
 
 
-/* some basic types */
-static int PointerAlignBytes;
-static int IntAlignBytes;
+/* some basic types. these are the same for every engine */
+struct IntAlignCheck {char x; int y;};
+struct PointerAlignCheck {char x; void *y;};
+#define IntAlignBytes ((int)offsetof(struct IntAlignCheck, y))
+#define PointerAlignBytes ((int)offsetof(struct PointerAlignCheck, y))
 
 
 /* add a new type to the set of types we know about */
@@ -31,7 +34,7 @@ struct ValueType *TypeAdd(Engine *pc, struct ParseState *Parser,
     const char *Identifier, int Sizeof, int AlignBytes)
 {
     struct ValueType *NewType = VariableAlloc(pc, Parser,
-        sizeof(struct ValueType), true);
+        sizeof(struct ValueType), true, MemTypes);
     NewType->Base = Base;
     NewType->ArraySize = ArraySize;
     NewType->Sizeof = Sizeof;
@@ -149,15 +152,13 @@ void TypeAddBaseType(Engine *pc, struct ValueType *TypeNode, enum BaseType Base,
 /* initialize the type system */
 void TypeInit(Engine *pc)
 {
-    struct IntAlign {char x; int y;} ia;
     struct ShortAlign {char x; short y;} sa;
     struct CharAlign {char x; char y;} ca;
     struct LongAlign {char x; long y;} la;
     struct DoubleAlign {char x; double y;} da;
-    struct PointerAlign {char x; void *y;} pa;
 
-    IntAlignBytes = (char*)&ia.y - &ia.x;
-    PointerAlignBytes = (char*)&pa.y - &pa.x;
+    strcpy(pc->StructTempName, "^s0000");
+    strcpy(pc->EnumTempName, "^e0000");
 
     pc->UberType.DerivedTypeList = NULL;
     TypeAddBaseType(pc, &pc->IntType, TypeInt, sizeof(int), IntAlignBytes);
@@ -252,8 +253,7 @@ void TypeParseStruct(struct ParseState *Parser, struct ValueType **Typ,
         StructIdentifier = LexValue->Val->Identifier;
         Token = LexGetToken(Parser, NULL, false);
     } else {
-        static char TempNameBuf[7] = "^s0000";
-        StructIdentifier = PlatformMakeTempName(pc, TempNameBuf);
+        StructIdentifier = PlatformMakeTempName(pc, pc->StructTempName);
     }
 
     *Typ = TypeGetMatching(pc, Parser, &Parser->pc->UberType,
@@ -276,7 +276,8 @@ void TypeParseStruct(struct ParseState *Parser, struct ValueType **Typ,
 
     LexGetToken(Parser, NULL, true);
     (*Typ)->Members = VariableAlloc(pc, Parser,
-        sizeof(struct Table)+STRUCT_TABLE_SIZE*sizeof(struct TableEntry), true);
+        sizeof(struct Table)+STRUCT_TABLE_SIZE*sizeof(struct TableEntry), true,
+        MemTypes);
     (*Typ)->Members->HashTable =
         (struct TableEntry**)((char*)(*Typ)->Members + sizeof(struct Table));
     TableInitTable((*Typ)->Members,
@@ -349,7 +350,8 @@ struct ValueType *TypeCreateOpaqueStruct(Engine *pc, struct ParseState *Parser,
     /* create the (empty) table */
     Typ->Members = VariableAlloc(pc,
         Parser,
-        sizeof(struct Table)+STRUCT_TABLE_SIZE*sizeof(struct TableEntry), true);
+        sizeof(struct Table)+STRUCT_TABLE_SIZE*sizeof(struct TableEntry), true,
+        MemTypes);
     Typ->Members->HashTable = (struct TableEntry**)((char*)Typ->Members +
         sizeof(struct Table));
     TableInitTable(Typ->Members,
@@ -376,8 +378,7 @@ void TypeParseEnum(struct ParseState *Parser, struct ValueType **Typ)
         EnumIdentifier = LexValue->Val->Identifier;
         Token = LexGetToken(Parser, NULL, false);
     } else {
-        static char TempNameBuf[7] = "^e0000";
-        EnumIdentifier = PlatformMakeTempName(pc, TempNameBuf);
+        EnumIdentifier = PlatformMakeTempName(pc, pc->EnumTempName);
     }
 
     TypeGetMatching(pc, Parser, &pc->UberType, TypeEnum, 0, EnumIdentifier,
@@ -426,14 +427,14 @@ int TypeParseFront(struct ParseState *Parser, struct ValueType **Typ,
     int Unsigned = false;
     int StaticQualifier = false;
     enum LexToken Token;
-    struct ParseState Before;
+    ParseCheckpoint Before;
     struct Value *LexerValue = 0;
     struct Value *VarValue = 0;
     Engine *pc = Parser->pc;
     *Typ = NULL;
 
     /* ignore leading type qualifiers */
-    ParserCopy(&Before, Parser);
+    ParserCheckpoint(Parser, &Before);
     Token = LexGetToken(Parser, &LexerValue, true);
     while (Token == TokenStaticType || Token == TokenAutoType ||
             Token == TokenRegisterType || Token == TokenExternType) {
@@ -502,7 +503,7 @@ int TypeParseFront(struct ParseState *Parser, struct ValueType **Typ,
         break;
 
     default:
-        ParserCopy(Parser, &Before);
+        ParserRewind(Parser, &Before);
         return false;
     }
 
@@ -515,9 +516,9 @@ struct ValueType *TypeParseBack(struct ParseState *Parser,
     struct ValueType *FromType)
 {
     enum LexToken Token;
-    struct ParseState Before;
+    ParseCheckpoint Before;
 
-    ParserCopy(&Before, Parser);
+    ParserCheckpoint(Parser, &Before);
     Token = LexGetToken(Parser, NULL, true);
     if (Token == TokenLeftSquareBracket) {
         /* add another array bound */
@@ -544,7 +545,7 @@ struct ValueType *TypeParseBack(struct ParseState *Parser,
         }
     } else {
         /* the type specification has finished */
-        ParserCopy(Parser, &Before);
+        ParserRewind(Parser, &Before);
         return FromType;
     }
 }
@@ -557,12 +558,12 @@ void TypeParseIdentPart(struct ParseState *Parser, struct ValueType *BasicTyp,
     int Done = false;
     enum LexToken Token;
     struct Value *LexValue;
-    struct ParseState Before;
+    ParseCheckpoint Before;
     *Typ = BasicTyp;
     *Identifier = Parser->pc->StrEmpty;
 
     while (!Done) {
-        ParserCopy(&Before, Parser);
+        ParserCheckpoint(Parser, &Before);
         Token = LexGetToken(Parser, &LexValue, true);
         switch (Token) {
         case TokenOpenParen:
@@ -590,7 +591,7 @@ void TypeParseIdentPart(struct ParseState *Parser, struct ValueType *BasicTyp,
             Done = true;
             break;
 
-        default: ParserCopy(Parser, &Before); Done = true; break;
+        default: ParserRewind(Parser, &Before); Done = true; break;
         }
     }
 
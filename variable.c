@@ -1,6 +1,8 @@
 /* itrapc variable storage. This provides ways of defining and accessing
  * variables */
 
+#include <limits.h>
+
 #include "interpreter.h"
 #include "heap.h"
 #include "table.h"
@@ -27,7 +29,8 @@ void VariableFree(Engine *pc, struct Value *Val)
         /* free function bodies */
         if (Val->Typ == &pc->FunctionType &&
                 Val->Val->FuncDef.Intrinsic == NULL &&
-                Val->Val->FuncDef.Body.Pos != NULL)
+                Val->Val->FuncDef.Body.Pos != NULL &&
+                !ProgramOwnsTokens(pc, Val->Val->FuncDef.Body.Pos))
             HeapFreeMem(pc, (void*)Val->Val->FuncDef.Body.Pos);
 
         /* free macro bodies */
@@ -70,18 +73,23 @@ void VariableCleanup(Engine *pc)
     VariableTableCleanup(pc, &pc->StringLiteralTable);
 }
 
-/* allocate some memory, either on the heap or the stack
-    and check if we've run out */
-void *VariableAlloc(Engine *pc, struct ParseState *Parser, int Size, int OnHeap)
+/* allocate some memory, either on the heap, where it's counted against
+    Category, or the stack and check if we've run out */
+void *VariableAlloc(Engine *pc, struct ParseState *Parser, int Size, int OnHeap,
+    enum MemCategory Category)
 {
     void *NewValue;
 
-    if (OnHeap)
-        NewValue = HeapAllocMem(pc, Size);
-    else
+    if (OnHeap) {
+        NewValue = HeapAllocMemIn(pc, Size, Category);
+        if (NewValue != NULL)
+            memset(NewValue, '\0', Size);
+    } else
         NewValue = HeapAllocStack(pc, Size);
 
-    if (NewValue == NULL)
+    if (NewValue == NULL && Parser == NULL)
+        ProgramFailNoParser(pc, "(VariableAlloc) out of memory");
+    else if (NewValue == NULL)
         ProgramFail(Parser, "(VariableAlloc) out of memory");
 
 #ifdef DEBUG_HEAP
@@ -98,7 +106,7 @@ struct Value *VariableAllocValueAndData(Engine *pc, struct ParseState *Parser,
     int DataSize, int IsLValue, struct Value *LValueFrom, int OnHeap)
 {
     struct Value *NewValue = VariableAlloc(pc, Parser,
-        MEM_ALIGN(sizeof(struct Value)) + DataSize, OnHeap);
+        MEM_ALIGN(sizeof(struct Value)) + DataSize, OnHeap, MemValues);
     NewValue->Val = (union AnyValue*)((char*)NewValue +
         MEM_ALIGN(sizeof(struct Value)));
     NewValue->ValOnHeap = OnHeap;
@@ -155,7 +163,7 @@ struct Value *VariableAllocValueFromExistingData(struct ParseState *Parser,
     struct Value *LValueFrom)
 {
     struct Value *NewValue = VariableAlloc(Parser->pc, Parser,
-        sizeof(struct Value), false);
+        sizeof(struct Value), false, MemValues);
     NewValue->Typ = Typ;
     NewValue->Val = FromValue;
     NewValue->ValOnHeap = false;
@@ -184,7 +192,8 @@ void VariableRealloc(struct ParseState *Parser, struct Value *FromValue,
     if (FromValue->AnyValOnHeap)
         HeapFreeMem(Parser->pc, FromValue->Val);
 
-    FromValue->Val = VariableAlloc(Parser->pc, Parser, NewSize, true);
+    FromValue->Val = VariableAlloc(Parser->pc, Parser, NewSize, true,
+        MemValues);
     FromValue->AnyValOnHeap = true;
 }
 
@@ -203,10 +212,12 @@ int VariableScopeBegin(struct ParseState *Parser, int* OldScopeID)
     struct Table *HashTable = (Parser->pc->TopStackFrame == NULL) ?
         &(Parser->pc->GlobalTable) : &(Parser->pc->TopStackFrame)->LocalTable;
 
-    /* XXX dumb hash, let's hope for no collisions... */
+    /* every token has its own address, so the one the block starts at
+        names it. fold in the high bits since token buffers can be far
+        apart, and other engines' buffers are shared now */
     *OldScopeID = Parser->ScopeID;
-    Parser->ScopeID = (int)(intptr_t)(Parser->SourceText) *
-        ((int)(intptr_t)(Parser->Pos) / sizeof(char*));
+    uintptr_t Where = (uintptr_t)Parser->Pos / sizeof(struct LexTokenRecord);
+    Parser->ScopeID = (int)((Where ^ (Where >> 31)) & INT_MAX);
     /* or maybe a more human-readable hash for debugging? */
     /* Parser->ScopeID = Parser->Line * 0x10000 + Parser->CharacterPos; */
 
@@ -289,6 +300,17 @@ int VariableDefinedAndOutOfScope(Engine *pc, const char* Ident)
     return false;
 }
 
+/* give the current stack frame a proper hash table for its locals */
+static void VariableStackFrameHash(Engine *pc)
+{
+    struct TableEntry **HashTable = HeapAllocMemIn(pc,
+        sizeof(struct TableEntry*) * LOCAL_TABLE_SIZE, MemTables);
+    if (HashTable == NULL)
+        ProgramFailNoParser(pc, "(VariableStackFrameHash) out of memory");
+
+    TableRehash(&pc->TopStackFrame->LocalTable, HashTable, LOCAL_TABLE_SIZE);
+}
+
 /* define a variable. Ident must be registered */
 struct Value *VariableDefine(Engine *pc, struct ParseState *Parser, char *Ident,
     struct Value *InitValue, struct ValueType *Typ, int MakeWritable)
@@ -319,6 +341,11 @@ struct Value *VariableDefine(Engine *pc, struct ParseState *Parser, char *Ident,
             Parser ? Parser->CharacterPos : 0))
         ProgramFail(Parser, "'%s' is already defined", Ident);
 
+    if (pc->TopStackFrame != NULL &&
+            currentTable->HashTable == &pc->TopStackFrame->LocalChain &&
+            ++pc->TopStackFrame->NumLocals > LOCAL_CHAIN_MAX)
+        VariableStackFrameHash(pc);
+
     return AssignValue;
 }
 
@@ -507,38 +534,45 @@ void VariableStackPop(struct ParseState *Parser, struct Value *Var)
         ProgramFail(Parser, "stack underrun");
 }
 
-/* add a stack frame when doing a function call */
-void VariableStackFrameAdd(struct ParseState *Parser, const char *FuncName,
-    int NumParams)
+/* add a stack frame when doing a function call. it goes in the heap
+    stack frame the caller pushed for the parameters, so it's released
+    along with them */
+void VariableStackFrameAdd(struct ParseState *Parser, const char *FuncName)
 {
-    struct StackFrame *NewFrame = 0;
-
-    HeapPushStackFrame(Parser->pc);
-    NewFrame = HeapAllocStack(Parser->pc,
-        sizeof(struct StackFrame)+sizeof(struct Value*)*NumParams);
+    struct StackFrame *NewFrame = HeapAllocStack(Parser->pc,
+        sizeof(struct StackFrame));
     if (NewFrame == NULL)
         ProgramFail(Parser, "(VariableStackFrameAdd) out of memory");
 
-    ParserCopy(&NewFrame->ReturnParser, Parser);
+    NewFrame->ReturnPos = Parser->Pos;
     NewFrame->FuncName = FuncName;
-    NewFrame->Parameter = (NumParams > 0) ?
-        ((void*)((char*)NewFrame+sizeof(struct StackFrame))) : NULL;
-    TableInitTable(&NewFrame->LocalTable, &NewFrame->LocalHashTable[0],
-        LOCAL_TABLE_SIZE, false);
+    /* most functions have a handful of locals, so they start out in a
+        single chain. VariableDefine() hashes them if there get to be more */
+    TableInitTable(&NewFrame->LocalTable, &NewFrame->LocalChain, 1, false);
     NewFrame->PreviousStackFrame = Parser->pc->TopStackFrame;
 //    NewFrame->HasThis = false;  /* Initialize to false, will be set for member functions */
+    /* the sampling profiler's signal handler mustn't see it half made */
+    atomic_signal_fence(memory_order_release);
     Parser->pc->TopStackFrame = NewFrame;
 }
 
 /* remove a stack frame */
 void VariableStackFramePop(struct ParseState *Parser)
 {
-    if (Parser->pc->TopStackFrame == NULL)
+    struct StackFrame *Frame = Parser->pc->TopStackFrame;
+
+    if (Frame == NULL)
         ProgramFail(Parser, "stack is empty - can't go back");
 
-    ParserCopy(Parser, &Parser->pc->TopStackFrame->ReturnParser);
-    Parser->pc->TopStackFrame = Parser->pc->TopStackFrame->PreviousStackFrame;
-    HeapPopStackFrame(Parser->pc);
+    if (Frame->LocalTable.HashTable != &Frame->LocalChain)
+        HeapFreeMem(Parser->pc, Frame->LocalTable.HashTable);
+
+#ifndef NO_STATS
+    Parser->pc->Stats.LocalSearches += Frame->LocalTable.Searches;
+    Parser->pc->Stats.LocalProbes += Frame->LocalTable.Probes;
+#endif
+    Parser->Pos = Frame->ReturnPos;
+    Parser->pc->TopStackFrame = Frame->PreviousStackFrame;
 }
 
 /* get a string literal. assumes that Ident is already
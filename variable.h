@@ -4,7 +4,8 @@ void VariableInit(Engine *pc);
 void VariableCleanup(Engine *pc);
 void VariableFree(Engine *pc, struct Value *Val);
 void VariableTableCleanup(Engine *pc, struct Table *HashTable);
-void *VariableAlloc(Engine *pc, struct ParseState *Parser, int Size, int OnHeap);
+void *VariableAlloc(Engine *pc, struct ParseState *Parser, int Size, int OnHeap,
+    enum MemCategory Category);
 void VariableStackPop(struct ParseState *Parser, struct Value *Var);
 struct Value *VariableAllocValueAndData(Engine *pc, struct ParseState *Parser,
     int DataSize, int IsLValue, struct Value *LValueFrom, int OnHeap);
@@ -31,8 +32,7 @@ void VariableGet(Engine *pc, struct ParseState *Parser, const char *Ident,
     struct Value **LVal);
 void VariableDefinePlatformVar(Engine *pc, struct ParseState *Parser,
     char *Ident, struct ValueType *Typ, union AnyValue *FromValue, int IsWritable);
-void VariableStackFrameAdd(struct ParseState *Parser, const char *FuncName,
-    int NumParams);
+void VariableStackFrameAdd(struct ParseState *Parser, const char *FuncName);
 void VariableStackFramePop(struct ParseState *Parser);
 struct Value *VariableStringLiteralGet(Engine *pc, char *Ident);
 void VariableStringLiteralDefine(Engine *pc, char *Ident, struct Value *Val);
@@ -0,0 +1,577 @@
+/* itrapc worker engines. a worker is an engine on a thread of its own which
+ * shares its parent engine's global variables, so independent pieces of
+ * work can run on several processors. each worker has its own stack, heap
+ * and types. the parent waits while a worker starts, and for all the
+ * workers of a parallel_for(). parallel_for()'s workers are started the
+ * first time it's called and wait for the next loop after that */
+
+#include <limits.h>
+
+#include "interpreter.h"
+#include "heap.h"
+#include "table.h"
+#include "variable.h"
+#include "lex.h"
+#include "parse_macro.h"
+#include "worker.h"
+
+#if defined(UNIX_HOST) || defined(WIN32)
+#include <threads.h>
+#include <stdatomic.h>
+
+#define WORKER_NAME_MAX (256)       /* longest function name we'll call */
+#define WORKER_CHUNKS (8)           /* pieces of the loop for each thread */
+
+/* a loop being shared out between the workers */
+struct WorkerLoop {
+    const char *FuncName;
+    long End;
+    long Chunk;
+    atomic_long Next;               /* the first iteration nobody's taken */
+    atomic_int Stop;                /* a worker has exited */
+};
+
+struct Worker {
+    struct WorkerPool *Pool;
+    Engine *pc;                     /* NULL if it couldn't be made */
+    thrd_t Thread;
+    int Index;                      /* the program sees this as __parallel_index */
+    char Call[WORKER_NAME_MAX + 32];
+    void *Tokens;                   /* Call, lexed */
+    int Broken;                     /* failed while it was being set up */
+    int Exited;                     /* called exit() or failed */
+    int ExitValue;
+};
+
+/* an engine's parallel_for() workers */
+struct WorkerPool {
+    Engine *Parent;
+    struct CleanupTokenNode *Defined;   /* the parent's source when we
+                                            defined its program */
+    struct WorkerLoop Loop;
+    mtx_t Lock;
+    cnd_t Go;                       /* there's a new loop, or we're done */
+    cnd_t Done;                     /* the last busy worker has finished */
+    int Generation;                 /* counts the loops */
+    int Busy;                       /* workers still on this loop */
+    int Quit;
+    int NumWorkers;                 /* the ones which started */
+    struct Worker *Workers;
+};
+
+/* a thread started by thread_spawn() */
+struct WorkerThread {
+    Engine *Parent;
+    thrd_t Thread;
+    mtx_t Lock;
+    cnd_t Started;
+    int Ready;                      /* the parent can carry on */
+    int Arg;                        /* the program sees this as __thread_arg */
+    int Result;                     /* and this as __thread_result */
+    char Call[WORKER_NAME_MAX + 64];
+    int Exited;
+    int ExitValue;
+};
+
+/* run the top level of the parent's source files again, oldest first.
+    included files are run again by their #include */
+static void WorkerReplay(Engine *pc, struct CleanupTokenNode *Node)
+{
+    if (Node == NULL)
+        return;
+
+    WorkerReplay(pc, Node->Next);
+    if (!Node->Included)
+        EngineParseTokens(pc, Node->FileName, Node->SourceText, Node->Tokens,
+            true, false);
+}
+
+/* point our global variables at the parent's. library variables, which
+    have no declaration, stay our own */
+static void WorkerShareGlobals(Engine *pc, Engine *Parent)
+{
+    int Count;
+    struct TableEntry *Entry;
+
+    /* other workers may be doing this too, so we walk the parent's table
+        rather than search it, which would change its counts */
+    for (Count = 0; Count < Parent->GlobalTable.Size; Count++) {
+        for (Entry = Parent->GlobalTable.HashTable[Count]; Entry != NULL;
+                Entry = Entry->Next) {
+            struct Value *Theirs = Entry->p.v.Val;
+            struct TableEntry *Mine;
+            int AddAt;
+
+            if (Entry->DeclFileName == NULL || ((uintptr_t)Entry->p.v.Key & 1))
+                continue;
+
+            switch (Theirs->Typ->Base) {
+            case TypeFunction:
+            case TypeMacro:
+            case Type_Type:
+            case TypeVoid:
+                continue;
+            default:
+                break;
+            }
+
+            Mine = TableSearch(&pc->GlobalTable, Entry->p.v.Key, &AddAt);
+            if (Mine != NULL && Mine->DeclFileName != NULL &&
+                    Mine->p.v.Val->Typ->Base == Theirs->Typ->Base &&
+                    Mine->p.v.Val->Typ->Sizeof == Theirs->Typ->Sizeof)
+                Mine->p.v.Val->Val = Theirs->Val;
+        }
+    }
+}
+
+/* define everything the program defined at the top level, then share the
+    parent's globals. top level statements which aren't declarations aren't
+    run again, and global variables are declared without running their
+    initializers, so anything those do only happens once. a worker's
+    parent may itself be a worker, so the definitions come from the engine
+    the program was first run in */
+static void WorkerDefine(Engine *pc, Engine *Parent)
+{
+    Engine *Root = Parent;
+
+    while (Root->WorkerParent != NULL)
+        Root = Root->WorkerParent;
+
+    pc->DefineOnly = true;
+    if (Root->Program != NULL) {
+        ProgramRetain(Root->Program);
+        pc->Program = Root->Program;
+        EngineParseProgram(pc);
+    }
+
+    WorkerReplay(pc, Root->CleanupTokenList);
+    pc->DefineOnly = false;
+    WorkerShareGlobals(pc, Parent);
+}
+
+/* call the function for each iteration of the pool's loop we can take */
+static void WorkerRun(struct Worker *W)
+{
+    struct WorkerLoop *Loop = &W->Pool->Loop;
+    Engine *pc = W->pc;
+    char *FileName;
+    char Call[sizeof(W->Call)];
+    long Start;
+
+    if (W->Broken || EnginePlatformSetExitPoint(pc)) {
+        W->Exited = true;
+        if (!W->Broken)
+            W->ExitValue = pc->EngineExitValue;
+        atomic_store(&Loop->Stop, true);
+        return;
+    }
+
+    /* the call's only lexed again when it's to another function */
+    FileName = TableStrRegister(pc, "parallel_for", 12);
+    snprintf(Call, sizeof(Call), "%s(__parallel_index);", Loop->FuncName);
+    if (W->Tokens == NULL || strcmp(Call, W->Call) != 0) {
+        if (W->Tokens != NULL)
+            HeapFreeMem(pc, W->Tokens);
+
+        W->Tokens = NULL;
+        strcpy(W->Call, Call);
+        W->Tokens = LexAnalyse(pc, FileName, W->Call, strlen(W->Call), NULL);
+    }
+
+    while (!atomic_load(&Loop->Stop) &&
+            (Start = atomic_fetch_add(&Loop->Next, Loop->Chunk)) < Loop->End) {
+        long Last = Start + Loop->Chunk < Loop->End ? Start + Loop->Chunk :
+            Loop->End;
+
+        for (W->Index = (int)Start; W->Index < Last; W->Index++)
+            EngineParseTokens(pc, FileName, W->Call, W->Tokens, true, false);
+    }
+}
+
+/* make an engine for this thread which can share Parent's program */
+static Engine *WorkerEngineNew(Engine *Parent)
+{
+    Engine *pc = malloc(sizeof(Engine));
+
+    if (pc == NULL)
+        return NULL;
+
+    EngineInitializeShared(pc, Parent->StackSize > WORKER_STACK_SIZE_MAX ?
+        WORKER_STACK_SIZE_MAX : Parent->StackSize, Parent);
+    pc->WorkerParent = Parent;
+    EngineSetOutput(pc, Parent->StdoutValue, Parent->StderrValue);
+    pc->CStdOut = Parent->CStdOut;
+    pc->StdinValue = Parent->StdinValue;
+    return pc;
+}
+
+/* free a worker's engine, unless threads it started still need it */
+static void WorkerEngineFree(Engine *pc)
+{
+    pc->ArenaTeardown = true;
+    EngineCleanup(pc);
+    if (atomic_load(&pc->ThreadsRunning) == 0)
+        free(pc);
+}
+
+/* a pool worker. it defines the program once, then runs each loop the
+    parent gives the pool until it's told to quit */
+static int WorkerMain(void *Arg)
+{
+    struct Worker *W = Arg;
+    struct WorkerPool *Pool = W->Pool;
+    int Generation = 0;
+
+    W->pc = WorkerEngineNew(Pool->Parent);
+    if (W->pc == NULL) {
+        W->Broken = true;
+        W->ExitValue = 1;
+    } else if (EnginePlatformSetExitPoint(W->pc)) {
+        W->Broken = true;
+        W->ExitValue = W->pc->EngineExitValue;
+    } else {
+        WorkerDefine(W->pc, Pool->Parent);
+        VariableDefinePlatformVar(W->pc, NULL, "__parallel_index",
+            &W->pc->IntType, (union AnyValue*)&W->Index, false);
+    }
+
+    mtx_lock(&Pool->Lock);
+    for (;;) {
+        while (Pool->Generation == Generation && !Pool->Quit)
+            cnd_wait(&Pool->Go, &Pool->Lock);
+
+        if (Pool->Quit)
+            break;
+
+        Generation = Pool->Generation;
+        mtx_unlock(&Pool->Lock);
+        WorkerRun(W);
+        mtx_lock(&Pool->Lock);
+        if (--Pool->Busy == 0)
+            cnd_signal(&Pool->Done);
+    }
+    mtx_unlock(&Pool->Lock);
+
+    if (W->pc != NULL)
+        WorkerEngineFree(W->pc);
+
+    return 0;
+}
+
+/* how many threads to use for a loop */
+static int WorkerThreads(long Iterations)
+{
+    const char *Env = getenv("ITRAPC_THREADS");
+    int Threads = 1;
+
+    if (Env != NULL)
+        Threads = atoi(Env);
+#ifdef UNIX_HOST
+    else
+        Threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    if (Threads > Iterations)
+        Threads = (int)Iterations;
+    if (Threads < 1)
+        Threads = 1;
+
+    return Threads;
+}
+
+/* call the function in this engine for each iteration. the call's lexed
+    once, and each iteration's index is written into its argument */
+static void WorkerForHere(struct ParseState *Parser, int Begin, int End,
+    const char *FuncName)
+{
+    Engine *pc = Parser->pc;
+    char *FileName = TableStrRegister(pc, "parallel_for", 12);
+    char Call[WORKER_NAME_MAX + 32];
+    struct LexTokenRecord *Tokens;
+    struct LexTokenRecord *Arg;
+    int NumTokens;
+    int Index;
+
+    snprintf(Call, sizeof(Call), "%s(0);", FuncName);
+    Tokens = LexAnalyse(pc, FileName, Call, strlen(Call), &NumTokens);
+    for (Arg = Tokens; Arg->Token != TokenIntegerConstant; Arg++) {
+    }
+
+    for (Index = Begin; Index < End; Index++) {
+        Arg->Value.LongInteger = Index;
+        EngineParseTokens(pc, FileName, Call, Tokens, true, false);
+    }
+
+    ParseMacroCacheFree(pc, Tokens, NumTokens);
+    HeapFreeMem(pc, Tokens);
+}
+
+/* find a function we can start a worker on */
+static struct FuncDef *WorkerFunction(struct ParseState *Parser,
+    const char *FuncName)
+{
+    struct Value *FuncValue;
+
+    if (strlen(FuncName) > WORKER_NAME_MAX ||
+            !VariableGetDefined(Parser->pc, Parser,
+                TableStrRegister(Parser->pc, FuncName, strlen(FuncName)),
+                &FuncValue) ||
+            FuncValue->Typ->Base != TypeFunction)
+        ProgramFail(Parser, "'%s' isn't a function", FuncName);
+
+    return &FuncValue->Val->FuncDef;
+}
+
+/* stop an engine's parallel_for() workers and free their engines */
+void WorkerPoolFree(Engine *pc)
+{
+    struct WorkerPool *Pool = pc->WorkerPool;
+    int Count;
+
+    if (Pool == NULL)
+        return;
+
+    mtx_lock(&Pool->Lock);
+    Pool->Quit = true;
+    cnd_broadcast(&Pool->Go);
+    mtx_unlock(&Pool->Lock);
+
+    for (Count = 0; Count < Pool->NumWorkers; Count++)
+        thrd_join(Pool->Workers[Count].Thread, NULL);
+
+    mtx_destroy(&Pool->Lock);
+    cnd_destroy(&Pool->Go);
+    cnd_destroy(&Pool->Done);
+    free(Pool->Workers);
+    free(Pool);
+    pc->WorkerPool = NULL;
+}
+
+/* start a worker for each of Threads. the workers define the program
+    while the parent waits for the first loop. returns NULL if none of
+    them started */
+static struct WorkerPool *WorkerPoolNew(Engine *pc, int Threads)
+{
+    struct WorkerPool *Pool = calloc(1, sizeof(struct WorkerPool));
+    int Count;
+
+    if (Pool == NULL)
+        return NULL;
+
+    Pool->Workers = calloc(Threads, sizeof(struct Worker));
+    if (Pool->Workers == NULL) {
+        free(Pool);
+        return NULL;
+    }
+
+    Pool->Parent = pc;
+    Pool->Defined = pc->CleanupTokenList;
+    mtx_init(&Pool->Lock, mtx_plain);
+    cnd_init(&Pool->Go);
+    cnd_init(&Pool->Done);
+    pc->WorkerPool = Pool;
+
+    fflush(pc->StdoutValue);
+    for (Count = 0; Count < Threads; Count++) {
+        Pool->Workers[Pool->NumWorkers].Pool = Pool;
+        if (thrd_create(&Pool->Workers[Pool->NumWorkers].Thread, WorkerMain,
+                &Pool->Workers[Pool->NumWorkers]) == thrd_success)
+            Pool->NumWorkers++;
+    }
+
+    if (Pool->NumWorkers == 0) {
+        WorkerPoolFree(pc);
+        return NULL;
+    }
+
+    return Pool;
+}
+
+/* call FuncName(i) for each i from Begin up to End, sharing the work between
+    a thread for each processor. the function can use its own locals and any
+    global, and the iterations can run in any order. a worker can't start
+    any more workers, so a parallel_for() in one runs in that worker */
+void WorkerFor(struct ParseState *Parser, int Begin, int End,
+    const char *FuncName)
+{
+    Engine *pc = Parser->pc;
+    struct WorkerPool *Pool;
+    int Exited = false;
+    int ExitValue = 0;
+    int Count;
+
+    if (WorkerFunction(Parser, FuncName)->NumParams != 1)
+        ProgramFail(Parser, "%s() should take just the loop index", FuncName);
+
+    if (Begin >= End)
+        return;
+
+    if (WorkerThreads((long)End - Begin) == 1 || pc->WorkerParent != NULL) {
+        WorkerForHere(Parser, Begin, End, FuncName);
+        return;
+    }
+
+    /* the workers only know what the program had defined when they
+        started, so they start again if more source has been parsed */
+    if (pc->WorkerPool != NULL && pc->WorkerPool->Defined != pc->CleanupTokenList)
+        WorkerPoolFree(pc);
+
+    Pool = pc->WorkerPool;
+    if (Pool == NULL)
+        Pool = WorkerPoolNew(pc, WorkerThreads(LONG_MAX));
+
+    if (Pool == NULL) {
+        WorkerForHere(Parser, Begin, End, FuncName);
+        return;
+    }
+
+    fflush(pc->StdoutValue);
+    mtx_lock(&Pool->Lock);
+    Pool->Loop.FuncName = FuncName;
+    Pool->Loop.End = End;
+    Pool->Loop.Chunk = ((long)End - Begin + Pool->NumWorkers * WORKER_CHUNKS - 1) /
+        (Pool->NumWorkers * WORKER_CHUNKS);
+    atomic_init(&Pool->Loop.Next, Begin);
+    atomic_init(&Pool->Loop.Stop, false);
+    for (Count = 0; Count < Pool->NumWorkers; Count++)
+        Pool->Workers[Count].Exited = false;
+
+    Pool->Busy = Pool->NumWorkers;
+    Pool->Generation++;
+    cnd_broadcast(&Pool->Go);
+    while (Pool->Busy > 0)
+        cnd_wait(&Pool->Done, &Pool->Lock);
+    mtx_unlock(&Pool->Lock);
+
+    for (Count = 0; Count < Pool->NumWorkers && !Exited; Count++) {
+        if (Pool->Workers[Count].Exited) {
+            Exited = true;
+            ExitValue = Pool->Workers[Count].ExitValue;
+        }
+    }
+
+    /* a worker which called exit() or failed ends the whole program. its
+        engine may be half way through something, so the pool goes too */
+    if (Exited) {
+        WorkerPoolFree(pc);
+        PlatformExit(pc, ExitValue);
+    }
+}
+
+/* let the parent carry on */
+static void WorkerThreadReady(struct WorkerThread *T)
+{
+    mtx_lock(&T->Lock);
+    T->Ready = true;
+    cnd_signal(&T->Started);
+    mtx_unlock(&T->Lock);
+}
+
+static int WorkerThreadMain(void *Arg)
+{
+    struct WorkerThread *T = Arg;
+    Engine *Parent = T->Parent;
+    Engine *pc = WorkerEngineNew(Parent);
+
+    if (pc == NULL) {
+        T->Exited = true;
+        T->ExitValue = 1;
+    } else if (EnginePlatformSetExitPoint(pc)) {
+        T->Exited = true;
+        T->ExitValue = pc->EngineExitValue;
+    } else {
+        WorkerDefine(pc, Parent);
+        VariableDefinePlatformVar(pc, NULL, "__thread_arg", &pc->IntType,
+            (union AnyValue*)&T->Arg, false);
+        VariableDefinePlatformVar(pc, NULL, "__thread_result", &pc->IntType,
+            (union AnyValue*)&T->Result, true);
+        WorkerThreadReady(T);
+        EngineParse(pc, "thread_spawn", T->Call, strlen(T->Call), true, true,
+            false, false);
+    }
+
+    /* if we failed before the parent was let go */
+    if (!T->Ready)
+        WorkerThreadReady(T);
+
+    if (pc != NULL)
+        WorkerEngineFree(pc);
+
+    atomic_fetch_sub(&Parent->ThreadsRunning, 1);
+    return 0;
+}
+
+/* start a thread running FuncName(Arg), or FuncName() if it takes nothing.
+    we wait until it's set up, after which it runs alongside us. returns a
+    handle for WorkerJoin() */
+void *WorkerSpawn(struct ParseState *Parser, const char *FuncName, int Arg)
+{
+    Engine *pc = Parser->pc;
+    struct FuncDef *Func = WorkerFunction(Parser, FuncName);
+    struct WorkerThread *T;
+
+    if (Func->NumParams > 1)
+        ProgramFail(Parser, "%s() should take at most one int", FuncName);
+
+    if (Func->ReturnType->Base != TypeVoid && Func->ReturnType->Base != TypeInt)
+        ProgramFail(Parser, "%s() should return int or void", FuncName);
+
+    T = calloc(1, sizeof(struct WorkerThread));
+    if (T == NULL)
+        ProgramFail(Parser, "(WorkerSpawn) out of memory");
+
+    T->Parent = pc;
+    T->Arg = Arg;
+    snprintf(T->Call, sizeof(T->Call), "%s%s(%s);",
+        Func->ReturnType->Base == TypeVoid ? "" : "__thread_result = ",
+        FuncName, Func->NumParams == 1 ? "__thread_arg" : "");
+    mtx_init(&T->Lock, mtx_plain);
+    cnd_init(&T->Started);
+
+    fflush(pc->StdoutValue);
+    atomic_fetch_add(&pc->ThreadsRunning, 1);
+    if (thrd_create(&T->Thread, WorkerThreadMain, T) != thrd_success) {
+        atomic_fetch_sub(&pc->ThreadsRunning, 1);
+        mtx_destroy(&T->Lock);
+        cnd_destroy(&T->Started);
+        free(T);
+        ProgramFail(Parser, "can't start a thread");
+    }
+
+    mtx_lock(&T->Lock);
+    while (!T->Ready)
+        cnd_wait(&T->Started, &T->Lock);
+    mtx_unlock(&T->Lock);
+    return T;
+}
+
+/* wait for a thread to finish and return what its function returned. if
+    it failed or called exit() the whole program exits */
+int WorkerJoin(struct ParseState *Parser, void *Thread)
+{
+    struct WorkerThread *T = Thread;
+    int Result;
+    int Exited;
+    int ExitValue;
+
+    if (T == NULL)
+        ProgramFail(Parser, "can't join a NULL thread");
+
+    thrd_join(T->Thread, NULL);
+    Result = T->Result;
+    Exited = T->Exited;
+    ExitValue = T->ExitValue;
+    mtx_destroy(&T->Lock);
+    cnd_destroy(&T->Started);
+    free(T);
+
+    if (Exited)
+        PlatformExit(Parser->pc, ExitValue);
+
+    return Result;
+}
+#else
+void WorkerPoolFree(Engine *pc)
+{
+}
+#endif
@@ -0,0 +1,6 @@
+/* worker.h */
+void WorkerFor(struct ParseState *Parser, int Begin, int End,
+    const char *FuncName);
+void *WorkerSpawn(struct ParseState *Parser, const char *FuncName, int Arg);
+int WorkerJoin(struct ParseState *Parser, void *Thread);
+void WorkerPoolFree(Engine *pc);